@@ -14,25 +14,107 @@
 
 #include "gic-400.h"
 
+#include "benchmarks.h"
+#include "frame-arena.h"
+#include "heap.h"
+#include "irq-stats.h"
+#include "page-alloc.h"
+#include "pool.h"
+
 #include "rpi-aux.h"
 #include "rpi-armtimer.h"
+#include "rpi-cursor.h"
+#include "rpi-dma.h"
 #include "rpi-framebuffer.h"
 #include "rpi-gpio.h"
 #include "rpi-interrupts.h"
+#include "rpi-local-intc.h"
 #include "rpi-mailbox-interface.h"
+#include "rpi-pmu.h"
+#include "rpi-smp.h"
 #include "rpi-systimer.h"
 
 #include "effects.h"
+#include "fb-console.h"
 #include "fonts/font09.h"
+#include "fonts/font09-glyphs.h"
 #include "image-font.h"
+#include "plasma.h"
 #include "starfield.h"
+#include "surface.h"
+#include "task.h"
+#include "tile-render.h"
+#include "work-queue.h"
+
+/* Set to 1 for the 8bpp demo - a plasma that's only animated by cycling its palette, under the
+   starfield, with a quarter of the pixels */
+#define PALETTE_DEMO    0
 
 #define SCREEN_WIDTH    800
 #define SCREEN_HEIGHT   600
+
+#if( PALETTE_DEMO == 1 )
+#define SCREEN_DEPTH    8
+#define SCREEN_SCALE    RPI_FB_SCALE_PERFORMANCE
+#else
 #define SCREEN_DEPTH    16
 
+/* The percentage of the screen size that's drawn, see RPI_SetFramebufferScale() */
+#define SCREEN_SCALE    RPI_FB_SCALE_NATIVE
+#endif
+
+/* Set to 1 to show stdout on the screen instead of the demo */
+#define FRAMEBUFFER_CONSOLE     0
+
 extern void _enable_interrupts(void);
 
+static volatile unsigned int frame_count = 0;
+
+/** The worker task. Runs the work the interrupt handlers have deferred to us, preempted by the
+    render loop whenever a frame is due */
+static void worker_task( void* arg )
+{
+    while( 1 )
+    {
+        WQ_Drain( 0 );
+        TASK_Sleep( 1000000 / TASK_TICK_HZ );
+    }
+}
+
+/** The logging task. Reports the frame rate and the interrupt statistics at the lowest priority so
+    the UART output never holds up a frame */
+static void logger_task( void* arg )
+{
+    int irq_stats_report = 60;
+    arena_stats_t arena_stats;
+    uint32_t next_report = RPI_GetSystemTimer()->counter_lo;
+
+    while( 1 )
+    {
+        next_report += 10000000;
+        TASK_SleepUntil( next_report );
+
+        if( uptime ) {
+            float fps = (float)frame_count / uptime;
+            printf( "Uptime: %4ds Frames: %10d FPS: %.2f\r\n", uptime, frame_count, fps );
+        }
+
+        if( uptime >= irq_stats_report ) {
+            IRQSTAT_Dump();
+            HEAP_Dump();
+            PAGE_Dump();
+            POOL_Dump();
+
+            ARENA_GetStats( &arena_stats );
+            printf( "Frame arena: peak %u of %u bytes, %u failures\r\n",
+                    (unsigned int)arena_stats.peak,
+                    (unsigned int)arena_stats.size,
+                    (unsigned int)arena_stats.failures );
+            irq_stats_report += 60;
+        }
+    }
+}
+
 /** Main function - we'll never return from here */
 void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
 {
@@ -40,12 +122,12 @@ void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
     int width = 0, height = 0;
     int pitch_bytes = 0;
     int pixel_offset;
-    unsigned int frame_count = 0;
     rpi_mailbox_property_t *mp;
     uint32_t pixel_value = 0;
     image_t* font_image;
     image_font_t* font;
     rpi_cpu_time_t cputime;
+    uint32_t next_frame;
 
     /* Write 1 to the LED init nibble in the Function Select GPIO peripheral register to enable
        LED pin as an output */
@@ -65,12 +147,11 @@ void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
     mp = RPI_PropertyGet(TAG_GET_CLOCK_RATE);
     uint32_t core_frequency = mp->data.buffer_32[1];
 
-    /* Calculate the timer reload register value so we achieve an interrupt rate of 2Hz. Every
-       second interrupt will therefore be one second. It's approximate, the division doesn't
-       really work out to be precisely 1s because of the divisor options and the core
-       frequency. */
+    /* Calculate the timer reload register value so we achieve an interrupt rate of TASK_TICK_HZ
+       for the scheduler tick. It's approximate, the division doesn't really work out to be
+       precisely 1ms because of the divisor options and the core frequency. */
     uint16_t prescales[] = {1, 16, 256, 1};
-    uint32_t timer_load = (1.0 / 2) / (1.0/(core_frequency / (RPI_GetArmTimer()->PreDivider + 1) * (prescales[(RPI_GetArmTimer()->Control & 0xC) >> 2])));
+    uint32_t timer_load = (1.0 / TASK_TICK_HZ) / (1.0/(core_frequency / (RPI_GetArmTimer()->PreDivider + 1) * (prescales[(RPI_GetArmTimer()->Control & 0xC) >> 2])));
     RPI_GetArmTimer()->Load = timer_load;
 
     /* Setup the ARM Timer */
@@ -80,6 +161,18 @@ void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
     /* Enable the ARM Interrupt controller in the BCM interrupt controller */
     RPI_EnableARMTimerInterrupt();
 
+    /* Start the cycle counter for the interrupt statistics and run a 100Hz system timer interrupt
+       that measures the interrupt entry latency */
+    RPI_PmuInit();
+    RPI_SystemTimerCompareInit( 10000 );
+    RPI_EnableSystemTimerInterrupt();
+
+#if defined( RPI_LOCAL_BASE )
+    /* Make sure the GPU interrupts (including the ARM Timer) are delivered to this core. The other
+       cores are then left with only their own local interrupt sources */
+    RPI_LocalRouteGpuInterrupts( RPI_GetCoreId() );
+#endif
+
     /* Globally enable interrupts */
     _enable_interrupts();
 
@@ -188,12 +281,108 @@ void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
         printf( "Serial Number: %8.8X%8.8X\r\n", mp->data.buffer_32[0], mp->data.buffer_32[1] );
     }
 
+    RPI_DmaInit();
+
+#if( RUN_BENCHMARKS == 1 )
+    BENCH_CoreMessagePingPong( 10000 );
+    BENCH_HeapThroughput( 10000 );
+    BENCH_LockContention( 100000 );
+    BENCH_RingThroughput( 1000000 );
+#endif
+
     RPI_InitFramebuffer( SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_DEPTH );
 
+#if( RUN_BENCHMARKS == 1 )
+    BENCH_DmaFramebuffer( 50 );
+    BENCH_TileRender( 50 );
+    BENCH_FramebufferScale( 50 );
+    BENCH_Scroll( 200 );
+    BENCH_BlitConvert( 20 );
+    BENCH_Sprite( 200 );
+    BENCH_FontGlyphs( 200 );
+#endif
+
+    RPI_SetFramebufferScale( SCREEN_SCALE );
+
     font_image = image16_from_gimp( &font09 );
     font = font_from_image( 29, 35, font_image, 0 );
 
+    /* The render loop becomes the highest priority task and sleeps between frames while the
+       lower priority tasks run */
+    TASK_Init( TASK_PRIORITY_HIGH );
+    TASK_Create( "worker", worker_task, NULL, 0, TASK_PRIORITY_NORMAL );
+    TASK_Create( "logger", logger_task, NULL, 0, TASK_PRIORITY_LOW );
+
+#if( RUN_BENCHMARKS == 1 )
+    BENCH_ContextSwitch( 10000 );
+#endif
+
     RPI_GetCurrentCpuTime( &cputime );
+    next_frame = cputime.lo;
+
+#if( FRAMEBUFFER_CONSOLE == 1 )
+    /* The console has the screen, so the render loop just keeps the frame count going for the
+       logger */
+    if( CONSOLE_Init( font ) == 0 )
+    {
+        CONSOLE_SetStdout( CONSOLE_STDOUT_UART | CONSOLE_STDOUT_FRAMEBUFFER );
+
+        while( 1 )
+        {
+            next_frame += 20000;
+            TASK_SleepUntil( next_frame );
+            frame_count++;
+        }
+    }
+#endif
+
+#if( PALETTE_DEMO == 1 )
+    {
+        framebuffer_info_t* fb = RPI_GetFramebuffer();
+        surface_t* plasma = SURFACE_Create( fb->physical_width, fb->physical_height, SURFACE_FORMAT_PAL8 );
+        surface_t* frames[2] = {
+            SURFACE_Create( fb->physical_width, fb->physical_height, SURFACE_FORMAT_PAL8 ),
+            SURFACE_Create( fb->physical_width, fb->physical_height, SURFACE_FORMAT_PAL8 ) };
+        palette_cycle_effect_t* plasma_fx = FX_NewPaletteCycle( (palette_cycle_settings_t){
+                .first = 0,
+                .count = PLASMA_COLOURS,
+                .step = 1,
+                .period = 1 } );
+
+        if( plasma && frames[0] && frames[1] && ( fb->bits_per_pixel == 8 ) )
+        {
+            /* The plasma is only ever drawn once */
+            PLASMA_Draw( plasma );
+            PLASMA_SetPalette();
+            starfield_set_palette();
+
+            printf( "Palette demo: %dx%d at 8bpp, %d bytes per frame\r\n",
+                    fb->physical_width, fb->physical_height, fb->physical_width * fb->physical_height );
+
+            while( 1 )
+            {
+                /* Each frame is drawn while the last one is copied to the framebuffer */
+                surface_t* frame = frames[frame_count & 1];
+
+                RPI_SetDrawSurface( frame );
+                memcpy( frame->memory, plasma->memory, frame->pitch * frame->height );
+                process_starfield();
+                FX_AnimatePaletteCycle( plasma_fx );
+                RPI_Present( frame );
+
+                next_frame += 20000;
+                TASK_SleepUntil( next_frame );
+                frame_count++;
+            }
+        }
+    }
+#endif
+
+    /* The stars show through the gaps in the text rather than going out behind each character. The
+       glyphs are converted from the font by create-sprite.py when the kernel is built, if they
+       don't fit the font they're found from its image instead */
+    if( font_set_glyphs( font, font09_glyphs, FONT09_GLYPHS_COUNT, FONT09_GLYPHS_COLUMNS ) != 0 )
+        font_set_transparent( font, 0 );
 
     int idx = 0;
     int screen_centre = ( RPI_GetFramebuffer()->physical_height >> 1 ) - ( font->pixel_height >> 1 );
@@ -210,10 +399,55 @@ void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
             .speed = 1,
             .fb = RPI_GetFramebuffer() });
 
+    /* Render into cached surfaces and present each finished frame to the framebuffer in one pass.
+       There are two so that each frame is drawn while the DMA copies the one before it */
+    surface_t* canvases[2];
+    surface_t* canvas = NULL;
+
+    for( int i = 0; i < 2; i++ )
+        canvases[i] = SURFACE_Create( RPI_GetFramebuffer()->physical_width,
+                                      RPI_GetFramebuffer()->physical_height,
+                                      RPI_GetFramebuffer()->current_surface->format );
+
+    static tile_list_t frame_list;
+
+    /* The hardware cursor follows the text about. The VideoCore draws it over the display, so it
+       costs nothing to move and never has to be drawn into the frame */
+    int cursor = ( RPI_CursorSetArrow( 0xFFFFFFFF, 0xFF000000 ) == 0 ) && ( RPI_CursorShow( 1 ) == 0 );
+
+    if( ( canvases[0] == NULL ) || ( canvases[1] == NULL ) )
+    {
+        SURFACE_Free( canvases[0] );
+        SURFACE_Free( canvases[1] );
+        canvases[0] = canvases[1] = NULL;
+
+        /* Draw straight into the framebuffer, the back buffer's cleared while we wait for the
+           next frame */
+        RPI_QueueClearScreen( 0 );
+    }
+
     while( 1 )
     {
         /* Force 50Hz Framerate - we do not have access to a vsync :( */
-        RPI_ClearScreen();
+
+        if( canvases[0] )
+        {
+            canvas = canvases[frame_count & 1];
+            RPI_SetDrawSurface( canvas );
+        }
+        else
+        {
+            /* Don't draw over the clear before it's done */
+            RPI_FramebufferFence();
+        }
+
+        /* Record the frame into a tile binned display list, which is rendered into the canvas a
+           tile at a time (cleared as it goes) by every core that's free */
+        if( canvas && ( TILE_Begin( &frame_list, canvas->width, canvas->height, canvas->format, 1, 0 ) == 0 ) )
+            RPI_SetDrawList( &frame_list );
+        else if( canvas )
+            SURFACE_Clear( canvas, 0 );
+
         process_starfield();
         FX_AnimateSine( text_fx );
         FX_AnimateSine( position_fx );
@@ -221,14 +455,30 @@ void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
         font_puts( 200, screen_centre + position_fx->effect.vertical_blit_y_processor(0, &position_fx->effect ),
                    "HELLO WORLD!", font, &text_fx->effect );
 
-        RPI_SwitchFramebuffer();
-        RPI_TimeEvent( &cputime, 20000 );
+        if( cursor )
+            RPI_CursorMove( 200 + ( frame_count % 400 ),
+                            screen_centre + position_fx->effect.vertical_blit_y_processor( 0, &position_fx->effect ) );
 
-        frame_count++;
+        if( RPI_GetDrawList() )
+        {
+            RPI_SetDrawList( NULL );
+            TILE_Render( &frame_list, canvas, RPI_CORE_COUNT );
+        }
 
-        if( uptime && ( ( uptime % 10 ) == 0 ) ) {
-            float fps = (float)frame_count / uptime;
-            printf( "Uptime: %4ds Frames: %10d FPS: %.2f\r\n", uptime, frame_count, fps );
+        if( canvas )
+        {
+            RPI_Present( canvas );
         }
+        else
+        {
+            RPI_SwitchFramebuffer();
+            RPI_QueueClearScreen( 0 );
+        }
+
+        /* Let the lower priority tasks run until the next frame is due */
+        next_frame += 20000;
+        TASK_SleepUntil( next_frame );
+
+        frame_count++;
     }
 }
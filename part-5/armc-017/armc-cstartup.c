@@ -8,6 +8,10 @@
 
 */
 
+#include "heap.h"
+#include "page-alloc.h"
+#include "rpi-gpio.h"
+
 extern int __bss_start__;
 extern int __bss_end__;
 
@@ -30,6 +34,22 @@ void _cstartup( unsigned int r0, unsigned int r1, unsigned int r2 )
     while( bss < bss_end )
         *bss++ = 0;
 
+    /* Enable the MMU and hand the memory after the kernel image to the page allocator, then take
+       the heap from it so that malloc works in main */
+    PAGE_Init();
+
+    if( HEAP_Init() != 0 )
+    {
+        /* There's no memory for anything to run in. The UART isn't up yet, so trap here with the
+           LED on like the exception handlers do */
+        RPI_SetGpioPinFunction( LED_GPIO, FS_OUTPUT );
+
+        while(1)
+        {
+            LED_ON();
+        }
+    }
+
     /* We should never return from main ... */
     kernel_main( r0, r1, r2 );
 
@@ -45,6 +45,9 @@ extern int errno;
 /* Prototype for the UART write function */
 #include "rpi-aux.h"
 
+/* The framebuffer console stdout backend */
+#include "fb-console.h"
+
 /* A pointer to a list of environment variables and their values. For a minimal
    environment, this empty list is adequate: */
 char *__env[1] = {0};
@@ -160,23 +163,13 @@ int _read( int file, char *ptr, int len )
 }
 
 
-/* Increase program data space. As malloc and related functions depend on this,
-   it is useful to have a working implementation. The following suffices for a
-   standalone system; it exploits the symbol _end automatically defined by the
-   GNU linker. */
+/* Increase program data space. newlib's malloc is replaced by the TLSF heap in heap.c, which owns
+   all of the memory from the symbol _end automatically defined by the GNU linker to the end of
+   the ARM's memory, so there's nothing left for sbrk to give out. */
 caddr_t _sbrk( int incr )
 {
-    extern char _end;
-    static char* heap_end = 0;
-    char* prev_heap_end;
-
-    if( heap_end == 0 )
-        heap_end = &_end;
-
-     prev_heap_end = heap_end;
-     heap_end += incr;
-
-     return (caddr_t)prev_heap_end;
+    errno = ENOMEM;
+    return (caddr_t)-1;
 }
 
 
@@ -226,9 +219,17 @@ void outbyte( char b )
 int _write( int file, char *ptr, int len )
 {
     int todo;
+    int backends = CONSOLE_GetStdout();
+
+    /* The framebuffer console is the alternative (or addition) to the UART, see CONSOLE_SetStdout() */
+    if( backends & CONSOLE_STDOUT_FRAMEBUFFER )
+        CONSOLE_Write( ptr, len );
 
-    for( todo = 0; todo < len; todo++ )
-      outbyte(*ptr++);
+    if( backends & CONSOLE_STDOUT_UART )
+    {
+        for( todo = 0; todo < len; todo++ )
+          outbyte(*ptr++);
+    }
 
     return len;
 }
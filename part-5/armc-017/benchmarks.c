@@ -0,0 +1,1259 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchmarks.h"
+#include "blit-convert.h"
+#include "fonts/font09.h"
+#include "fonts/font09-glyphs.h"
+#include "frame-arena.h"
+#include "image-font.h"
+#include "page-alloc.h"
+#include "ring-buffer.h"
+#include "rpi-atomic.h"
+#include "rpi-barrier.h"
+#include "rpi-cache.h"
+#include "rpi-core-message.h"
+#include "rpi-dma.h"
+#include "rpi-framebuffer.h"
+#include "rpi-local-intc.h"
+#include "rpi-pmu.h"
+#include "rpi-smp.h"
+#include "rpi-spinlock.h"
+#include "rpi-systimer.h"
+#include "sprite.h"
+#include "surface.h"
+#include "task.h"
+#include "tile-render.h"
+
+/** @brief The message types used by the core messaging benchmark */
+typedef enum {
+    BENCH_MESSAGE_PING = 1,
+    BENCH_MESSAGE_PONG,
+    BENCH_MESSAGE_STOP,
+    } bench_message_type_t;
+
+#define BENCH_BATCH_SIZE    32
+
+
+#if defined( RPI_LOCAL_BASE )
+
+/* Convert generic timer counts to nanoseconds */
+static uint32_t counts_to_ns( uint64_t counts )
+{
+    uint32_t frequency = RPI_GenericTimerGetFrequency();
+
+    if( frequency == 0 )
+        frequency = RPI_LOCAL_DEFAULT_TIMER_FREQ;
+
+    return (uint32_t)( ( counts * 1000000000ULL ) / frequency );
+}
+
+
+/* The secondary core's side of the ping-pong test. Every ping is returned as a pong */
+static void pong_core( int core )
+{
+    rpi_core_message_t message;
+
+    while( 1 )
+    {
+        RPI_CoreMessageWait( &message, RPI_CORE_WAIT_WFE );
+
+        if( message.type == BENCH_MESSAGE_STOP )
+            return;
+
+        message.type = BENCH_MESSAGE_PONG;
+        while( RPI_CoreMessageSend( 0, &message ) != 0 ) { }
+    }
+}
+
+#endif
+
+
+/**
+    @brief Measure the round trip latency of a message between core 0 and core 1
+
+    Core 1 is woken just for the test and parks again when it completes. The second half of the
+    test sends batches of pings behind a single doorbell to show the cost per message when batched.
+*/
+void BENCH_CoreMessagePingPong( int iterations )
+{
+#if defined( RPI_LOCAL_BASE )
+    rpi_core_message_t message = { 0 };
+    rpi_core_message_t batch[BENCH_BATCH_SIZE];
+    uint64_t start, elapsed, total = 0, min = UINT64_MAX, max = 0;
+    int batches = iterations / BENCH_BATCH_SIZE;
+
+    if( RPI_CoreStart( 1, pong_core ) != 0 )
+    {
+        printf( "BENCH: Could not start core 1 for the ping-pong test\r\n" );
+        return;
+    }
+
+    for( int i = 0; i < iterations; i++ )
+    {
+        message.type = BENCH_MESSAGE_PING;
+        message.data[0] = i;
+
+        start = RPI_GenericTimerGetCount();
+        RPI_CoreMessageSend( 1, &message );
+        RPI_CoreMessageWait( &message, RPI_CORE_WAIT_WFE );
+        elapsed = RPI_GenericTimerGetCount() - start;
+
+        total += elapsed;
+        if( elapsed < min )
+            min = elapsed;
+        if( elapsed > max )
+            max = elapsed;
+    }
+
+    printf( "BENCH: Core message round trip: min %uns avg %uns max %uns (%d iterations)\r\n",
+            (unsigned int)counts_to_ns( min ),
+            (unsigned int)counts_to_ns( total / iterations ),
+            (unsigned int)counts_to_ns( max ),
+            iterations );
+
+    for( int i = 0; i < BENCH_BATCH_SIZE; i++ )
+    {
+        batch[i].type = BENCH_MESSAGE_PING;
+        batch[i].data[0] = i;
+    }
+
+    start = RPI_GenericTimerGetCount();
+    for( int b = 0; b < batches; b++ )
+    {
+        RPI_CoreMessageSendBatch( 1, batch, BENCH_BATCH_SIZE );
+
+        for( int i = 0; i < BENCH_BATCH_SIZE; i++ )
+            RPI_CoreMessageWait( &message, RPI_CORE_WAIT_WFE );
+    }
+    elapsed = RPI_GenericTimerGetCount() - start;
+
+    if( batches )
+    {
+        printf( "BENCH: Core message batched (%d): %uns per message\r\n",
+                BENCH_BATCH_SIZE,
+                (unsigned int)counts_to_ns( elapsed / ( batches * BENCH_BATCH_SIZE ) ) );
+    }
+
+    message.type = BENCH_MESSAGE_STOP;
+    RPI_CoreMessageSend( 1, &message );
+#else
+    printf( "BENCH: The core messaging benchmark needs a multi-core RPI\r\n" );
+#endif
+}
+
+
+/* The context switch benchmark's partner task and the semaphores it ping-pongs on */
+static task_semaphore_t switch_ping;
+static task_semaphore_t switch_pong;
+static volatile int switch_stop;
+
+static void switch_partner( void* arg )
+{
+    while( 1 )
+    {
+        TASK_SemaphoreWait( &switch_ping );
+
+        if( switch_stop )
+            return;
+
+        TASK_SemaphorePost( &switch_pong );
+    }
+}
+
+
+/**
+    @brief Measure the cost of a task context switch
+
+    The calling task (which must have been set up with TASK_Init()) and a partner task of the same
+    priority hand two semaphores back and forth, so every iteration is two switches. The cost
+    includes the semaphore operations, which is what a real hand-over between tasks costs.
+*/
+void BENCH_ContextSwitch( int iterations )
+{
+    task_stats_t before, after;
+    uint32_t start_cycles, cycles;
+    uint32_t start_us, us;
+    int switches;
+
+    TASK_SemaphoreInit( &switch_ping, 0 );
+    TASK_SemaphoreInit( &switch_pong, 0 );
+    switch_stop = 0;
+
+    if( TASK_Create( "bench", switch_partner, NULL, 0, TASK_Current()->priority ) == NULL )
+    {
+        printf( "BENCH: Could not create the context switch partner task\r\n" );
+        return;
+    }
+
+    TASK_GetStats( &before );
+    start_us = RPI_GetSystemTimer()->counter_lo;
+    start_cycles = RPI_PmuGetCycles();
+
+    for( int i = 0; i < iterations; i++ )
+    {
+        TASK_SemaphorePost( &switch_ping );
+        TASK_SemaphoreWait( &switch_pong );
+    }
+
+    cycles = RPI_PmuGetCycles() - start_cycles;
+    us = RPI_GetSystemTimer()->counter_lo - start_us;
+    TASK_GetStats( &after );
+
+    switch_stop = 1;
+    TASK_SemaphorePost( &switch_ping );
+    TASK_Yield();
+
+    switches = after.switches - before.switches;
+
+    if( switches )
+    {
+        printf( "BENCH: Context switch: %u cycles %uns per switch (%d switches, %u preempted)\r\n",
+                (unsigned int)( cycles / switches ),
+                (unsigned int)( ( us * 1000ULL ) / switches ),
+                switches,
+                (unsigned int)( after.preemptions - before.preemptions ) );
+    }
+}
+
+
+/* Run a benchmark function on every core at once. The secondary cores are started and wait for
+   a go signal so that all of the cores start together. Returns the number of cores that ran it and
+   each core's result (normally the time it took) in results[]. While the function runs,
+   all_cores_started has a bit set for each core that's running it */
+typedef uint32_t (*bench_core_function_t)( int core, int iterations );
+
+static bench_core_function_t all_cores_function;
+static int all_cores_iterations;
+static volatile int all_cores_go;
+static volatile uint32_t all_cores_started;
+static volatile int all_cores_done[RPI_CORE_COUNT];
+static uint32_t all_cores_results[RPI_CORE_COUNT];
+
+#if defined( RPI_LOCAL_BASE )
+
+static void all_cores_entry( int core )
+{
+    while( !all_cores_go )
+        RPI_WaitForEvent();
+
+    all_cores_results[core] = all_cores_function( core, all_cores_iterations );
+
+    RPI_DataSyncBarrier();
+    all_cores_done[core] = 1;
+}
+
+#endif
+
+static int bench_all_cores( bench_core_function_t function, int iterations, uint32_t* results )
+{
+    int cores = 1;
+
+    all_cores_function = function;
+    all_cores_iterations = iterations;
+    all_cores_go = 0;
+    all_cores_started = 1 << 0;
+
+#if defined( RPI_LOCAL_BASE )
+    for( int core = 1; core < RPI_CORE_COUNT; core++ )
+    {
+        all_cores_done[core] = 0;
+
+        /* The core may still be on its way back to being parked after an earlier benchmark */
+        while( RPI_CoreGetState( core ) != RPI_CORE_PARKED ) { }
+
+        if( RPI_CoreStart( core, all_cores_entry ) == 0 )
+        {
+            all_cores_started |= 1 << core;
+            cores++;
+        }
+        else
+            all_cores_done[core] = 1;
+    }
+#endif
+
+    all_cores_go = 1;
+    RPI_DataSyncBarrier();
+    RPI_SendEvent();
+
+    all_cores_results[0] = function( 0, iterations );
+
+    for( int core = 1; core < RPI_CORE_COUNT; core++ )
+    {
+        while( !all_cores_done[core] ) { }
+    }
+
+    for( int core = 0; core < cores; core++ )
+        results[core] = all_cores_results[core];
+
+    return cores;
+}
+
+
+/* The heap benchmark. Every participating core allocates a set of blocks and frees them again,
+   mostly small blocks served by the per-core caches with every eighth block big enough to go to
+   the central heap */
+#define BENCH_HEAP_BLOCKS       64
+
+static uint32_t heap_bench_run( int core, int iterations )
+{
+    void* blocks[BENCH_HEAP_BLOCKS];
+    uint32_t start = RPI_GetSystemTimer()->counter_lo;
+
+    for( int i = 0; i < iterations; i++ )
+    {
+        for( int b = 0; b < BENCH_HEAP_BLOCKS; b++ )
+            blocks[b] = malloc( ( b & 7 ) ? 16 + ( ( b * 24 ) % 240 ) : 1024 );
+
+        for( int b = 0; b < BENCH_HEAP_BLOCKS; b++ )
+            free( blocks[b] );
+    }
+
+    return RPI_GetSystemTimer()->counter_lo - start;
+}
+
+
+/**
+    @brief Measure malloc/free throughput on one core and then on all of the cores at once
+
+    Each iteration is BENCH_HEAP_BLOCKS allocations and frees. With per-core caches the aggregate
+    throughput should scale with the number of cores rather than being limited by the heap lock.
+*/
+void BENCH_HeapThroughput( int iterations )
+{
+    uint32_t operations = 2 * BENCH_HEAP_BLOCKS * iterations;
+    uint32_t us[RPI_CORE_COUNT];
+    uint32_t single, slowest = 0;
+    int cores;
+
+    single = heap_bench_run( 0, iterations );
+
+    if( single )
+    {
+        printf( "BENCH: Heap 1 core: %uns per operation, %u operations/s\r\n",
+                (unsigned int)( ( single * 1000ULL ) / operations ),
+                (unsigned int)( ( operations * 1000000ULL ) / single ) );
+    }
+
+    if( RPI_CORE_COUNT == 1 )
+        return;
+
+    cores = bench_all_cores( heap_bench_run, iterations, us );
+
+    for( int core = 0; core < cores; core++ )
+    {
+        if( us[core] > slowest )
+            slowest = us[core];
+
+        printf( "BENCH: Heap core %d of %d: %uns per operation\r\n",
+                core,
+                cores,
+                (unsigned int)( ( us[core] * 1000ULL ) / operations ) );
+    }
+
+    if( slowest )
+    {
+        printf( "BENCH: Heap %d cores: %u operations/s aggregate (%u.%02ux one core)\r\n",
+                cores,
+                (unsigned int)( ( operations * (uint64_t)cores * 1000000ULL ) / slowest ),
+                (unsigned int)( ( (uint64_t)single * cores ) / slowest ),
+                (unsigned int)( ( ( (uint64_t)single * cores * 100 ) / slowest ) % 100 ) );
+    }
+}
+
+
+/* The lock contention benchmark. Every core increments a shared counter protected by each kind of
+   lock in turn, so the cores fight over the same cache line. The counter ends up on a line of its
+   own, away from the locks' neighbours */
+typedef enum {
+    LOCK_BENCH_ATOMIC = 0,
+    LOCK_BENCH_SPINLOCK,
+    LOCK_BENCH_RWLOCK_WRITE,
+    LOCK_BENCH_RWLOCK_READ,
+    LOCK_BENCH_COUNT
+    } lock_bench_t;
+
+static const char* lock_bench_names[LOCK_BENCH_COUNT] = {
+    "atomic add", "ticket spinlock", "rwlock write", "rwlock read" };
+
+static lock_bench_t lock_bench;
+static rpi_atomic_t lock_bench_atomic __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
+static rpi_spinlock_t lock_bench_spinlock __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
+static rpi_rwlock_t lock_bench_rwlock __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
+static volatile uint32_t lock_bench_counter __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
+
+static uint32_t lock_bench_run( int core, int iterations )
+{
+    uint32_t start = RPI_GetSystemTimer()->counter_lo;
+    uint32_t sum = 0;
+
+    for( int i = 0; i < iterations; i++ )
+    {
+        switch( lock_bench )
+        {
+            case LOCK_BENCH_ATOMIC:
+                RPI_AtomicFetchAdd( &lock_bench_atomic, 1 );
+                break;
+
+            case LOCK_BENCH_SPINLOCK:
+                RPI_SpinLock( &lock_bench_spinlock );
+                lock_bench_counter++;
+                RPI_SpinUnlock( &lock_bench_spinlock );
+                break;
+
+            case LOCK_BENCH_RWLOCK_WRITE:
+                RPI_WriteLock( &lock_bench_rwlock );
+                lock_bench_counter++;
+                RPI_WriteUnlock( &lock_bench_rwlock );
+                break;
+
+            case LOCK_BENCH_RWLOCK_READ:
+                RPI_ReadLock( &lock_bench_rwlock );
+                sum += lock_bench_counter;
+                RPI_ReadUnlock( &lock_bench_rwlock );
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    (void)sum;
+    return RPI_GetSystemTimer()->counter_lo - start;
+}
+
+
+/**
+    @brief Measure the cost of the atomics and locks with every core contending for them
+
+    The shared counter is checked afterwards, a wrong count means the lock doesn't work.
+*/
+void BENCH_LockContention( int iterations )
+{
+    uint32_t us[RPI_CORE_COUNT];
+
+    for( lock_bench = 0; lock_bench < LOCK_BENCH_COUNT; lock_bench++ )
+    {
+        uint32_t slowest = 0;
+        uint32_t count;
+        int cores;
+
+        RPI_AtomicStore( &lock_bench_atomic, 0 );
+        RPI_SpinLockInit( &lock_bench_spinlock );
+        RPI_RwLockInit( &lock_bench_rwlock );
+        lock_bench_counter = 0;
+
+        cores = bench_all_cores( lock_bench_run, iterations, us );
+
+        for( int core = 0; core < cores; core++ )
+        {
+            if( us[core] > slowest )
+                slowest = us[core];
+        }
+
+        count = ( lock_bench == LOCK_BENCH_ATOMIC ) ? RPI_AtomicLoad( &lock_bench_atomic ) : lock_bench_counter;
+
+        printf( "BENCH: %s, %d cores: %uns per operation",
+                lock_bench_names[lock_bench],
+                cores,
+                (unsigned int)( ( slowest * 1000ULL ) / iterations ) );
+
+        if( ( lock_bench != LOCK_BENCH_RWLOCK_READ ) && ( count != (uint32_t)( cores * iterations ) ) )
+            printf( " FAILED: count %u expected %u", (unsigned int)count, (unsigned int)( cores * iterations ) );
+
+        printf( "\r\n" );
+    }
+}
+
+
+/* The ring buffer benchmark. Core 0 consumes from an SPSC ring fed by core 1, and then from an
+   MPSC ring fed by all of the other cores. Every element carries its producer and a sequence
+   number which the consumer checks */
+#define BENCH_RING_CAPACITY     256
+#define BENCH_RING_BATCH        16
+
+typedef struct {
+    uint32_t producer;
+    uint32_t sequence;
+    } ring_bench_element_t;
+
+RING_SPSC_TYPE( ring_bench_spsc_t, ring_bench_element_t, BENCH_RING_CAPACITY );
+RING_MPSC_TYPE( ring_bench_mpsc_t, ring_bench_element_t, BENCH_RING_CAPACITY );
+
+static ring_bench_spsc_t ring_bench_spsc;
+static ring_bench_mpsc_t ring_bench_mpsc;
+static int ring_bench_mpsc_mode;
+static int ring_bench_producers;       /**< Cores 1 to ring_bench_producers produce */
+static int ring_bench_started;         /**< The number of the producers that started */
+static uint32_t ring_bench_batch;
+static uint32_t ring_bench_errors;
+
+static uint32_t ring_bench_push( ring_bench_element_t* elements, uint32_t count )
+{
+    if( ring_bench_mpsc_mode )
+        return RING_MpscPushBatch( &ring_bench_mpsc, elements, count );
+
+    return RING_SpscPushBatch( &ring_bench_spsc, elements, count );
+}
+
+static uint32_t ring_bench_pop( ring_bench_element_t* elements, uint32_t max )
+{
+    if( ring_bench_mpsc_mode )
+        return RING_MpscPopBatch( &ring_bench_mpsc, elements, max );
+
+    return RING_SpscPopBatch( &ring_bench_spsc, elements, max );
+}
+
+static uint32_t ring_bench_run( int core, int count )
+{
+    ring_bench_element_t elements[BENCH_RING_BATCH];
+    uint32_t start = RPI_GetSystemTimer()->counter_lo;
+
+    if( core == 0 )
+    {
+        uint32_t expected[RPI_CORE_COUNT] = { 0 };
+        uint32_t total;
+
+        /* Only wait for the elements of the producers that are running */
+        ring_bench_started = 0;
+
+        for( int producer = 1; producer <= ring_bench_producers; producer++ )
+        {
+            if( all_cores_started & ( 1 << producer ) )
+                ring_bench_started++;
+        }
+
+        total = count * ring_bench_started;
+        ring_bench_errors = 0;
+
+        while( total )
+        {
+            uint32_t popped = ring_bench_pop( elements, ring_bench_batch );
+
+            for( uint32_t i = 0; i < popped; i++ )
+            {
+                if( ( elements[i].producer >= RPI_CORE_COUNT ) ||
+                    ( elements[i].sequence != expected[elements[i].producer]++ ) )
+                    ring_bench_errors++;
+            }
+
+            total -= popped;
+        }
+    }
+    else if( core <= ring_bench_producers )
+    {
+        for( uint32_t sent = 0; sent < (uint32_t)count; )
+        {
+            uint32_t batch = ( ( count - sent ) < ring_bench_batch ) ? count - sent : ring_bench_batch;
+            uint32_t pushed;
+
+            for( uint32_t i = 0; i < batch; i++ )
+            {
+                elements[i].producer = core;
+                elements[i].sequence = sent + i;
+            }
+
+            for( pushed = 0; pushed < batch; )
+                pushed += ring_bench_push( &elements[pushed], batch - pushed );
+
+            sent += batch;
+        }
+    }
+
+    return RPI_GetSystemTimer()->counter_lo - start;
+}
+
+
+/**
+    @brief Measure ring buffer throughput between cores, one element at a time and in batches
+*/
+void BENCH_RingThroughput( int count )
+{
+    uint32_t us[RPI_CORE_COUNT];
+
+    if( RPI_CORE_COUNT == 1 )
+    {
+        printf( "BENCH: The ring buffer benchmark needs a multi-core RPI\r\n" );
+        return;
+    }
+
+    for( int test = 0; test < 4; test++ )
+    {
+        uint32_t elements;
+
+        ring_bench_mpsc_mode = test >> 1;
+        ring_bench_producers = ring_bench_mpsc_mode ? RPI_CORE_COUNT - 1 : 1;
+        ring_bench_batch = ( test & 1 ) ? BENCH_RING_BATCH : 1;
+
+        bench_all_cores( ring_bench_run, count, us );
+
+        if( ring_bench_started == 0 )
+        {
+            printf( "BENCH: The ring buffer benchmark couldn't start a producer core\r\n" );
+            return;
+        }
+
+        /* The time the consumer took to see every element */
+        elements = count * ring_bench_started;
+
+        if( us[0] )
+        {
+            printf( "BENCH: %s ring, %d producer(s), batch %2u: %uns per element, %u elements/s%s\r\n",
+                    ring_bench_mpsc_mode ? "MPSC" : "SPSC",
+                    ring_bench_started,
+                    (unsigned int)ring_bench_batch,
+                    (unsigned int)( ( us[0] * 1000ULL ) / elements ),
+                    (unsigned int)( ( elements * 1000000ULL ) / us[0] ),
+                    ring_bench_errors ? " FAILED" : "" );
+        }
+    }
+}
+
+
+/* The DMA benchmark. A frame's worth of pixels is copied from cached memory into the back buffer
+   by the CPU and then by a DMA channel described in each of the ways the engine allows. The DMA
+   times include cleaning the source from the data cache, which a real frame would need too */
+typedef enum {
+    DMA_BENCH_CPU = 0,
+    DMA_BENCH_LINEAR,
+    DMA_BENCH_LINEAR_IRQ,
+    DMA_BENCH_2D,
+    DMA_BENCH_CHAIN,
+    DMA_BENCH_COUNT,
+    } dma_bench_t;
+
+static const char* dma_bench_names[DMA_BENCH_COUNT] = {
+    "CPU memcpy", "DMA linear", "DMA linear (irq)", "DMA 2D", "DMA row chain" };
+
+static volatile int dma_bench_done;
+
+static void dma_bench_complete( int channel, int error, void* arg )
+{
+    dma_bench_done = error ? -1 : 1;
+}
+
+
+/**
+    @brief Measure the bandwidth of copying a frame into the framebuffer with the CPU and with DMA
+*/
+void BENCH_DmaFramebuffer( int iterations )
+{
+    framebuffer_info_t* fb = RPI_GetFramebuffer();
+    uint32_t row_bytes = fb->physical_width * fb->bytes_per_pixel;
+    uint32_t height = fb->physical_height;
+    uint32_t bytes = row_bytes * height;
+    uint8_t* dest = (uint8_t*)fb->current_buffer;
+    rpi_dma_cb_pool_t pool = { 0 };
+    rpi_dma_cb_t* linear = NULL;
+    rpi_dma_cb_t* rect = NULL;
+    rpi_dma_cb_t* rows = NULL;
+    uint8_t* src;
+    int channel;
+
+    src = PAGE_Alloc( PAGE_ZONE_CACHED, PAGE_Order( bytes ) );
+    channel = RPI_DmaAllocChannel( RPI_DMA_CHANNEL_FULL );
+
+    if( ( src == NULL ) || ( channel < 0 ) || ( RPI_DmaCbPoolInit( &pool, height + 2 ) != 0 ) )
+    {
+        printf( "BENCH: The DMA benchmark couldn't get a buffer, a full channel and its control blocks\r\n" );
+        goto done;
+    }
+
+    for( uint32_t i = 0; i < bytes; i++ )
+        src[i] = i * 7;
+
+    /* The source is packed, the framebuffer has its own pitch */
+    linear = RPI_DmaCbAlloc( &pool );
+    rect = RPI_DmaCbAlloc( &pool );
+    RPI_DmaCbMemcpy( linear, dest, src, bytes );
+    RPI_DmaCb2D( rect, dest, fb->pitch, src, row_bytes, row_bytes, height );
+
+    for( uint32_t y = height; y > 0; y-- )
+    {
+        rpi_dma_cb_t* row = RPI_DmaCbAlloc( &pool );
+
+        RPI_DmaCbMemcpy( row, dest + ( ( y - 1 ) * fb->pitch ), src + ( ( y - 1 ) * row_bytes ), row_bytes );
+        RPI_DmaCbChain( row, rows );
+        rows = row;
+    }
+
+    for( int test = 0; test < DMA_BENCH_COUNT; test++ )
+    {
+        int errors = 0;
+        uint32_t us;
+        uint32_t start;
+
+        /* The linear copy ignores the pitch, so only compare a packed framebuffer */
+        if( ( test == DMA_BENCH_LINEAR || test == DMA_BENCH_LINEAR_IRQ ) && ( fb->pitch != row_bytes ) )
+            continue;
+
+        memset( dest, 0, fb->pitch * height );
+        start = RPI_GetSystemTimer()->counter_lo;
+
+        for( int i = 0; i < iterations; i++ )
+        {
+            if( test == DMA_BENCH_CPU )
+            {
+                for( uint32_t y = 0; y < height; y++ )
+                    memcpy( dest + ( y * fb->pitch ), src + ( y * row_bytes ), row_bytes );
+
+                continue;
+            }
+
+            RPI_CacheCleanRange( src, bytes );
+
+            if( test == DMA_BENCH_LINEAR_IRQ )
+            {
+                dma_bench_done = 0;
+                RPI_DmaStart( channel, linear, dma_bench_complete, NULL );
+
+                while( dma_bench_done == 0 ) { }
+
+                errors += ( dma_bench_done < 0 );
+                continue;
+            }
+
+            RPI_DmaStart( channel, ( test == DMA_BENCH_LINEAR ) ? linear :
+                                   ( test == DMA_BENCH_2D ) ? rect : rows, NULL, NULL );
+            errors += ( RPI_DmaWait( channel ) != 0 );
+        }
+
+        us = RPI_GetSystemTimer()->counter_lo - start;
+
+        /* Check the last row made it */
+        if( memcmp( dest + ( ( height - 1 ) * fb->pitch ), src + ( ( height - 1 ) * row_bytes ), row_bytes ) )
+            errors++;
+
+        if( us )
+        {
+            printf( "BENCH: Framebuffer copy %-16s: %uus per frame, %uMB/s%s\r\n",
+                    dma_bench_names[test],
+                    (unsigned int)( us / iterations ),
+                    (unsigned int)( ( (uint64_t)bytes * iterations ) / us ),
+                    errors ? " FAILED" : "" );
+        }
+    }
+
+done:
+    if( pool.blocks )
+        RPI_DmaCbPoolFree( &pool );
+
+    if( channel >= 0 )
+        RPI_DmaFreeChannel( channel );
+
+    if( src )
+        PAGE_Free( src );
+}
+
+
+#define TILE_BENCH_RECTANGLES   64
+#define TILE_BENCH_PIXELS       2000
+
+/* Draw the same scene of overlapping bordered rectangles and scattered pixels every time */
+static void tile_bench_scene( int width, int height )
+{
+    uint32_t seed = 12345;
+
+    for( int i = 0; i < TILE_BENCH_RECTANGLES; i++ )
+    {
+        graphic_rectangle_t rectangle = { 0 };
+
+        seed = ( seed * 1103515245 ) + 12345;
+        rectangle.width = 32 + ( ( seed >> 8 ) % 160 );
+        rectangle.height = 32 + ( ( seed >> 16 ) % 120 );
+        rectangle.position_x = ( seed >> 4 ) % width;
+        rectangle.position_y = ( seed >> 12 ) % height;
+        rectangle.border = 2;
+        rectangle.border_colour = 0x7FFF;
+        rectangle.fill_colour = i;
+        RPI_DrawRectangle( &rectangle );
+    }
+
+    for( int i = 0; i < TILE_BENCH_PIXELS; i++ )
+    {
+        seed = ( seed * 1103515245 ) + 12345;
+        RPI_PutPixel( ( seed >> 4 ) % width, ( seed >> 16 ) % height, 0xFFFF );
+    }
+}
+
+
+/**
+    @brief Compare drawing a scene straight into a cached surface with recording it into a tile
+    binned display list and rendering the list with one core and with every core
+*/
+void BENCH_TileRender( int iterations )
+{
+    framebuffer_info_t* fb = RPI_GetFramebuffer();
+    surface_t* previous = RPI_GetDrawSurface();
+    surface_t* surface;
+    tile_list_t list;
+
+    surface = SURFACE_Create( fb->physical_width, fb->physical_height, fb->current_surface->format );
+
+    if( surface == NULL )
+    {
+        printf( "BENCH: The tile render benchmark couldn't get a surface\r\n" );
+        return;
+    }
+
+    RPI_SetDrawSurface( surface );
+
+    /* No cores is drawing directly, then one core and every core rendering tiles */
+    for( int cores = 0; cores <= RPI_CORE_COUNT; cores = cores ? cores * 4 : 1 )
+    {
+        uint32_t start = RPI_GetSystemTimer()->counter_lo;
+        uint32_t dropped = 0;
+        uint32_t commands = 0;
+        int used = 0;
+        uint32_t us;
+
+        for( int i = 0; i < iterations; i++ )
+        {
+            uint32_t mark = ARENA_Mark();
+
+            if( cores == 0 )
+            {
+                SURFACE_Clear( surface, 0 );
+                tile_bench_scene( surface->width, surface->height );
+                ARENA_Release( mark );
+                continue;
+            }
+
+            if( TILE_Begin( &list, surface->width, surface->height, surface->format, 1, 0 ) != 0 )
+            {
+                dropped++;
+                ARENA_Release( mark );
+                continue;
+            }
+
+            RPI_SetDrawList( &list );
+            tile_bench_scene( surface->width, surface->height );
+            RPI_SetDrawList( NULL );
+
+            used = TILE_Render( &list, surface, cores );
+            dropped += list.dropped;
+            commands = list.commands;
+            ARENA_Release( mark );
+        }
+
+        us = RPI_GetSystemTimer()->counter_lo - start;
+
+        if( cores == 0 )
+            printf( "BENCH: Scene drawn directly: %uus per frame\r\n", (unsigned int)( us / iterations ) );
+        else
+            printf( "BENCH: Scene tiled, %u commands, %d core(s): %uus per frame%s\r\n",
+                    (unsigned int)commands, used, (unsigned int)( us / iterations ),
+                    dropped ? " (commands dropped)" : "" );
+    }
+
+    RPI_SetDrawSurface( previous == fb->current_surface ? NULL : previous );
+    SURFACE_Free( surface );
+}
+
+
+/**
+    @brief Measure the fill rate saved by drawing fewer pixels and letting the VideoCore scale them
+    up to the display (and the cost of drawing more and scaling them down)
+
+    Each frame is the tile benchmark scene rendered into a cached surface and presented, which is
+    what the demo does every frame.
+*/
+void BENCH_FramebufferScale( int iterations )
+{
+    static const int scales[] = { RPI_FB_SCALE_NATIVE, RPI_FB_SCALE_BALANCED,
+                                  RPI_FB_SCALE_PERFORMANCE, RPI_FB_SCALE_SUPERSAMPLE };
+    framebuffer_info_t* fb = RPI_GetFramebuffer();
+    surface_t* previous = RPI_GetDrawSurface();
+    int restore = fb->scale;
+    uint32_t native_us = 0;
+    tile_list_t list;
+
+    for( int s = 0; s < (int)( sizeof( scales ) / sizeof( scales[0] ) ); s++ )
+    {
+        surface_t* surface;
+        uint32_t start;
+        uint32_t us;
+
+        if( RPI_SetFramebufferScale( scales[s] ) != 0 )
+        {
+            printf( "BENCH: Couldn't allocate the framebuffer at %d%%\r\n", scales[s] );
+            continue;
+        }
+
+        surface = SURFACE_Create( fb->physical_width, fb->physical_height, fb->current_surface->format );
+
+        if( surface == NULL )
+        {
+            printf( "BENCH: The scale benchmark couldn't get a surface\r\n" );
+            break;
+        }
+
+        RPI_SetDrawSurface( surface );
+        start = RPI_GetSystemTimer()->counter_lo;
+
+        for( int i = 0; i < iterations; i++ )
+        {
+            /* There's only the one surface, so the last frame's copy has to finish first */
+            RPI_FramebufferFence();
+
+            if( TILE_Begin( &list, surface->width, surface->height, surface->format, 1, 0 ) == 0 )
+            {
+                RPI_SetDrawList( &list );
+                tile_bench_scene( surface->width, surface->height );
+                RPI_SetDrawList( NULL );
+                TILE_Render( &list, surface, RPI_CORE_COUNT );
+            }
+
+            /* Presenting ends the frame, which releases the list */
+            RPI_Present( surface );
+        }
+
+        RPI_SwitchFramebuffer();
+        us = ( RPI_GetSystemTimer()->counter_lo - start ) / iterations;
+
+        if( scales[s] == RPI_FB_SCALE_NATIVE )
+            native_us = us;
+
+        printf( "BENCH: Framebuffer scale %3d%%: %dx%d, %u pixels, %uus per frame",
+                scales[s], fb->physical_width, fb->physical_height,
+                (unsigned int)( fb->physical_width * fb->physical_height ), (unsigned int)us );
+
+        if( native_us && us )
+            printf( " (%u.%02ux native)", (unsigned int)( native_us / us ),
+                    (unsigned int)( ( ( native_us * 100 ) / us ) % 100 ) );
+
+        printf( "\r\n" );
+
+        RPI_SetDrawSurface( NULL );
+        SURFACE_Free( surface );
+    }
+
+    /* The framebuffer's own surfaces didn't survive the reallocation */
+    RPI_SetFramebufferScale( restore );
+
+    if( ( previous != &fb->surfaces[0] ) && ( previous != &fb->surfaces[1] ) )
+        RPI_SetDrawSurface( previous );
+}
+
+
+static uint32_t scroll_bench_pixels;
+
+/* A checkerboard world, so a mistake in the scroll position or mirroring shows */
+static void scroll_bench_draw( surface_t* region, int x, int y, void* arg )
+{
+    for( int py = 0; py < region->height; py++ )
+    {
+        uint8_t* row = SURFACE_PixelAddress( region, 0, py );
+
+        for( int px = 0; px < region->width; px++ )
+        {
+            uint32_t colour = ( ( ( x + px ) ^ ( y + py ) ) & 32 ) ? 0xFFFFFFFF : 0x001F001F;
+
+            if( region->bytes_per_pixel == 2 )
+                ( (uint16_t*)row )[px] = colour;
+            else if( region->bytes_per_pixel == 4 )
+                ( (uint32_t*)row )[px] = colour;
+            else
+                row[px] = colour;
+        }
+    }
+
+    scroll_bench_pixels += region->width * region->height;
+}
+
+
+/**
+    @brief Compare scrolling the screen with the virtual offset against redrawing all of it
+*/
+void BENCH_Scroll( int steps )
+{
+    static const struct { const char* name; int dx; int dy; int redraw; } tests[] = {
+        { "vertical, 2px", 0, 2, 0 },
+        { "horizontal, 2px", 2, 0, 0 },
+        { "diagonal, 2px", 2, 2, 0 },
+        { "full redraw", 0, 0, 1 } };
+
+    if( RPI_InitScrolling( RPI_SCROLL_HORIZONTAL | RPI_SCROLL_VERTICAL, scroll_bench_draw, NULL ) != 0 )
+    {
+        printf( "BENCH: Couldn't allocate a scrolling framebuffer\r\n" );
+        RPI_InitScrolling( 0, NULL, NULL );
+        return;
+    }
+
+    for( int t = 0; t < (int)( sizeof( tests ) / sizeof( tests[0] ) ); t++ )
+    {
+        uint32_t start = RPI_GetSystemTimer()->counter_lo;
+        uint32_t us;
+
+        scroll_bench_pixels = 0;
+
+        for( int i = 0; i < steps; i++ )
+        {
+            if( tests[t].redraw )
+                RPI_ScrollRedraw();
+            else
+                RPI_Scroll( tests[t].dx, tests[t].dy );
+        }
+
+        us = RPI_GetSystemTimer()->counter_lo - start;
+
+        printf( "BENCH: Scroll %-16s: %uus per step, %u pixels drawn per step\r\n",
+                tests[t].name, (unsigned int)( us / steps ),
+                (unsigned int)( scroll_bench_pixels / steps ) );
+    }
+
+    RPI_InitScrolling( 0, NULL, NULL );
+}
+
+
+/**
+    @brief Time BLIT_Convert() between each pair of formats, off screen
+*/
+void BENCH_BlitConvert( int iterations )
+{
+    static const struct { const char* name; surface_format_t from; surface_format_t to; int flags; } tests[] = {
+        { "8bpp -> 16bpp", SURFACE_FORMAT_PAL8, SURFACE_FORMAT_RGB565, 0 },
+        { "8bpp -> 32bpp", SURFACE_FORMAT_PAL8, SURFACE_FORMAT_ARGB8888, 0 },
+        { "16bpp -> 32bpp", SURFACE_FORMAT_RGB565, SURFACE_FORMAT_ARGB8888, 0 },
+        { "32bpp -> 16bpp", SURFACE_FORMAT_ARGB8888, SURFACE_FORMAT_RGB565, 0 },
+        { "32bpp -> 16bpp dither", SURFACE_FORMAT_ARGB8888, SURFACE_FORMAT_RGB565, BLIT_DITHER },
+        { "32bpp -> 32bpp", SURFACE_FORMAT_ARGB8888, SURFACE_FORMAT_ARGB8888, 0 } };
+    const int width = 320;
+    const int height = 240;
+    uint8_t* src = malloc( width * height * 4 );
+
+    if( src == NULL )
+    {
+        printf( "BENCH: The convert benchmark couldn't get a buffer\r\n" );
+        return;
+    }
+
+    for( int i = 0; i < ( width * height * 4 ); i++ )
+        src[i] = rand();
+
+    for( int t = 0; t < (int)( sizeof( tests ) / sizeof( tests[0] ) ); t++ )
+    {
+        surface_t* dest = SURFACE_Create( width, height, tests[t].to );
+        int pitch = width * SURFACE_BytesPerPixel( tests[t].from );
+        uint32_t start;
+        uint32_t us;
+
+        if( dest == NULL )
+        {
+            printf( "BENCH: The convert benchmark couldn't get a surface\r\n" );
+            break;
+        }
+
+        start = RPI_GetSystemTimer()->counter_lo;
+
+        for( int i = 0; i < iterations; i++ )
+            BLIT_Convert( dest, 0, 0, src, pitch, tests[t].from, width, height, NULL, tests[t].flags );
+
+        us = ( RPI_GetSystemTimer()->counter_lo - start ) / iterations;
+
+        printf( "BENCH: Convert %-22s: %uus per %dx%d, %u Mpixel/s\r\n", tests[t].name,
+                (unsigned int)us, width, height,
+                (unsigned int)( us ? ( width * height ) / us : 0 ) );
+
+        SURFACE_Free( dest );
+    }
+
+    free( src );
+}
+
+
+#define SPRITE_BENCH_SIZE       64
+
+/* A ball with a soft edge, on a background of 0 */
+static void sprite_bench_ball( uint8_t* pixels, surface_format_t format )
+{
+    const int radius = SPRITE_BENCH_SIZE / 2;
+
+    for( int y = 0; y < SPRITE_BENCH_SIZE; y++ )
+    {
+        for( int x = 0; x < SPRITE_BENCH_SIZE; x++ )
+        {
+            int dx = x - radius;
+            int dy = y - radius;
+            int edge = ( radius * radius ) - ( dx * dx ) - ( dy * dy );
+            uint32_t alpha = ( edge <= 0 ) ? 0 : ( edge >= 255 ) ? 255 : edge;
+            int i = ( y * SPRITE_BENCH_SIZE ) + x;
+
+            if( format == SURFACE_FORMAT_RGB565 )
+                ( (uint16_t*)pixels )[i] = alpha ? 0xF81F : 0;
+            else
+                ( (uint32_t*)pixels )[i] = alpha ? ( ( alpha << 24 ) | 0xFF00FF ) : 0;
+        }
+    }
+}
+
+
+/**
+    @brief Compare drawing a sprite as a plain copy, with a colour key tested on every pixel and
+    with the spans of SPRITE_Draw(), keyed, blended by alpha and with a constant alpha
+*/
+void BENCH_Sprite( int iterations )
+{
+    static const surface_format_t formats[] = { SURFACE_FORMAT_RGB565, SURFACE_FORMAT_ARGB8888 };
+    static const char* tests[] = { "copy", "per-pixel key", "key spans", "alpha spans", "constant alpha" };
+    uint8_t* pixels = malloc( SPRITE_BENCH_SIZE * SPRITE_BENCH_SIZE * 4 );
+
+    if( pixels == NULL )
+    {
+        printf( "BENCH: The sprite benchmark couldn't get a buffer\r\n" );
+        return;
+    }
+
+    for( int f = 0; f < (int)( sizeof( formats ) / sizeof( formats[0] ) ); f++ )
+    {
+        const int bpp = SURFACE_BytesPerPixel( formats[f] );
+        const int pitch = SPRITE_BENCH_SIZE * bpp;
+        surface_t* dest = SURFACE_Create( 320, 240, formats[f] );
+        sprite_t* keyed;
+        sprite_t* alpha;
+
+        sprite_bench_ball( pixels, formats[f] );
+        keyed = SPRITE_Create( pixels, pitch, SPRITE_BENCH_SIZE, SPRITE_BENCH_SIZE, formats[f], 0,
+                               SPRITE_COLOUR_KEY );
+        alpha = SPRITE_Create( pixels, pitch, SPRITE_BENCH_SIZE, SPRITE_BENCH_SIZE, formats[f], 0,
+                               SPRITE_COLOUR_KEY | SPRITE_ALPHA );
+
+        if( ( dest == NULL ) || ( keyed == NULL ) || ( alpha == NULL ) )
+        {
+            printf( "BENCH: The sprite benchmark couldn't get a surface\r\n" );
+            SPRITE_Free( keyed );
+            SPRITE_Free( alpha );
+            SURFACE_Free( dest );
+            break;
+        }
+
+        for( int t = 0; t < (int)( sizeof( tests ) / sizeof( tests[0] ) ); t++ )
+        {
+            uint32_t start = RPI_GetSystemTimer()->counter_lo;
+            uint32_t us;
+
+            for( int i = 0; i < iterations; i++ )
+            {
+                int x = ( i * 7 ) % ( dest->width - SPRITE_BENCH_SIZE );
+                int y = ( i * 5 ) % ( dest->height - SPRITE_BENCH_SIZE );
+
+                switch( t )
+                {
+                    case 0:
+                        for( int row = 0; row < SPRITE_BENCH_SIZE; row++ )
+                            memcpy( SURFACE_PixelAddress( dest, x, y + row ), pixels + ( row * pitch ), pitch );
+                        break;
+
+                    case 1:
+                        for( int row = 0; row < SPRITE_BENCH_SIZE; row++ )
+                        {
+                            uint8_t* out = SURFACE_PixelAddress( dest, x, y + row );
+
+                            for( int column = 0; column < SPRITE_BENCH_SIZE; column++ )
+                            {
+                                if( bpp == 2 )
+                                {
+                                    uint16_t pixel = ( (uint16_t*)pixels )[( row * SPRITE_BENCH_SIZE ) + column];
+
+                                    if( pixel != 0 )
+                                        ( (uint16_t*)out )[column] = pixel;
+                                }
+                                else
+                                {
+                                    uint32_t pixel = ( (uint32_t*)pixels )[( row * SPRITE_BENCH_SIZE ) + column];
+
+                                    if( pixel != 0 )
+                                        ( (uint32_t*)out )[column] = pixel;
+                                }
+                            }
+                        }
+                        break;
+
+                    case 2:
+                        SPRITE_Draw( dest, x, y, keyed, SPRITE_OPAQUE );
+                        break;
+
+                    case 3:
+                        SPRITE_Draw( dest, x, y, alpha, SPRITE_OPAQUE );
+                        break;
+
+                    default:
+                        SPRITE_Draw( dest, x, y, keyed, SPRITE_OPAQUE / 2 );
+                        break;
+                }
+            }
+
+            us = RPI_GetSystemTimer()->counter_lo - start;
+
+            printf( "BENCH: Sprite %dbpp %-15s: %u ns per %dx%d sprite\r\n", bpp * 8, tests[t],
+                    (unsigned int)( ( us * 1000 ) / iterations ), SPRITE_BENCH_SIZE, SPRITE_BENCH_SIZE );
+        }
+
+        SPRITE_Free( keyed );
+        SPRITE_Free( alpha );
+        SURFACE_Free( dest );
+    }
+
+    free( pixels );
+}
+
+
+/**
+    @brief Compare drawing text with the font's opaque cells, with the sprites font_set_transparent()
+    makes from the font image, and with the packed sprites create-sprite.py made from it
+*/
+void BENCH_FontGlyphs( int iterations )
+{
+    static const char* tests[] = { "opaque cells", "image spans", "packed spans" };
+    surface_t* previous = RPI_GetDrawSurface();
+    image_t* image = image16_from_gimp( &font09 );
+    image_font_t* font = image ? font_from_image( 29, 35, image, 0 ) : NULL;
+    surface_t* surface = SURFACE_Create( 640, 64, SURFACE_FORMAT_RGB565 );
+
+    if( ( font == NULL ) || ( surface == NULL ) )
+    {
+        printf( "BENCH: The font benchmark couldn't get a font and a surface\r\n" );
+        SURFACE_Free( surface );
+        image_free( image );
+        return;
+    }
+
+    RPI_SetDrawSurface( surface );
+
+    for( int t = 0; t < (int)( sizeof( tests ) / sizeof( tests[0] ) ); t++ )
+    {
+        uint32_t start;
+        uint32_t us;
+
+        if( t == 1 )
+            font_set_transparent( font, 0 );
+        else if( t == 2 )
+            font_set_glyphs( font, font09_glyphs, FONT09_GLYPHS_COUNT, FONT09_GLYPHS_COLUMNS );
+
+        start = RPI_GetSystemTimer()->counter_lo;
+
+        for( int i = 0; i < iterations; i++ )
+            font_puts( 0, 0, "HELLO WORLD!", font, NULL );
+
+        us = RPI_GetSystemTimer()->counter_lo - start;
+
+        printf( "BENCH: Font %-13s: %uus per string\r\n", tests[t], (unsigned int)( us / iterations ) );
+    }
+
+    RPI_SetDrawSurface( previous );
+    SURFACE_Free( surface );
+    font_free( font );
+    image_free( image );
+}
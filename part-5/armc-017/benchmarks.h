@@ -0,0 +1,30 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+/* On-target benchmarks. These print their results to stdout (the UART) and are run from
+   kernel_main when the kernel is built with RUN_BENCHMARKS enabled */
+
+extern void BENCH_CoreMessagePingPong( int iterations );
+extern void BENCH_ContextSwitch( int iterations );
+extern void BENCH_HeapThroughput( int iterations );
+extern void BENCH_LockContention( int iterations );
+extern void BENCH_RingThroughput( int count );
+extern void BENCH_DmaFramebuffer( int iterations );
+extern void BENCH_TileRender( int iterations );
+extern void BENCH_FramebufferScale( int iterations );
+extern void BENCH_Scroll( int steps );
+extern void BENCH_BlitConvert( int iterations );
+extern void BENCH_Sprite( int iterations );
+extern void BENCH_FontGlyphs( int iterations );
+
+#endif
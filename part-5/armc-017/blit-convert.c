@@ -0,0 +1,317 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* Blitters that convert between pixel formats, so an image doesn't have to be the same depth as
+   the surface it's drawn on.
+
+   Palettised pixels are looked up in a table converted from the palette once per blit. RGB565 to
+   ARGB8888 uses a pair of tables indexed by each byte of the pixel, which together are 2KiB and
+   stay in the L1. The inner loops read and write a word at a time, and on the boards with NEON
+   the RGB565 <-> ARGB8888 conversions do eight pixels at a time with shifts and inserts. */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined( __ARM_NEON )
+#include <arm_neon.h>
+#endif
+
+#include "blit-convert.h"
+#include "rpi-framebuffer.h"
+
+/* RGB565 to ARGB8888, indexed by the low and high byte of the pixel and ORed together */
+static uint32_t rgb565_lo[256];
+static uint32_t rgb565_hi[256];
+static int rgb565_tables = 0;
+
+/* A 4x4 ordered dither matrix, 0 to 15 */
+static const uint8_t bayer[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 } };
+
+
+static void rgb565_tables_init( void )
+{
+    for( int i = 0; i < 256; i++ )
+    {
+        /* The low byte is gggbbbbb and the high byte rrrrrggg. Each channel is taken to the top of
+           its byte and its top bits repeated into the bottom, so full scale is 0xFF. The top two
+           bits of green, that fill the bottom of its byte, are in the high byte */
+        uint32_t b = i & 0x1F;
+        uint32_t r = i >> 3;
+        uint32_t g_lo = ( i >> 5 ) << 2;
+        uint32_t g_hi = ( ( i & 0x7 ) << 5 ) | ( ( i & 0x6 ) >> 1 );
+
+        rgb565_lo[i] = ( g_lo << 8 ) | ( b << 3 ) | ( b >> 2 );
+        rgb565_hi[i] = 0xFF000000 | ( ( ( r << 3 ) | ( r >> 2 ) ) << 16 ) | ( g_hi << 8 );
+    }
+
+    rgb565_tables = 1;
+}
+
+
+/**
+    @brief Convert a row of palette indices to RGB565 with a table made from the palette
+*/
+void BLIT_Pal8ToRgb565( uint16_t* dest, const uint8_t* src, int count, const uint16_t* lut )
+{
+    /* Four indices in, two words out */
+    if( ( ( (uint32_t)src & 3 ) == 0 ) && ( ( (uint32_t)dest & 3 ) == 0 ) )
+    {
+        for( ; count >= 4; count -= 4 )
+        {
+            uint32_t indices = *(const uint32_t*)src;
+
+            ( (uint32_t*)dest )[0] = lut[indices & 0xFF] | ( lut[( indices >> 8 ) & 0xFF] << 16 );
+            ( (uint32_t*)dest )[1] = lut[( indices >> 16 ) & 0xFF] | ( lut[indices >> 24] << 16 );
+            src += 4;
+            dest += 4;
+        }
+    }
+
+    while( count-- > 0 )
+        *dest++ = lut[*src++];
+}
+
+
+void BLIT_Pal8ToArgb8888( uint32_t* dest, const uint8_t* src, int count, const uint32_t* lut )
+{
+    if( ( (uint32_t)src & 3 ) == 0 )
+    {
+        for( ; count >= 4; count -= 4 )
+        {
+            uint32_t indices = *(const uint32_t*)src;
+
+            dest[0] = lut[indices & 0xFF];
+            dest[1] = lut[( indices >> 8 ) & 0xFF];
+            dest[2] = lut[( indices >> 16 ) & 0xFF];
+            dest[3] = lut[indices >> 24];
+            src += 4;
+            dest += 4;
+        }
+    }
+
+    while( count-- > 0 )
+        *dest++ = lut[*src++];
+}
+
+
+void BLIT_Rgb565ToArgb8888( uint32_t* dest, const uint16_t* src, int count )
+{
+    if( !rgb565_tables )
+        rgb565_tables_init();
+
+#if defined( __ARM_NEON )
+    for( ; count >= 8; count -= 8 )
+    {
+        uint16x8_t p = vld1q_u16( src );
+        uint8x8x4_t argb;
+
+        /* Take each channel to the top of a byte and repeat its top bits into the bottom */
+        argb.val[2] = vshrn_n_u16( p, 8 );
+        argb.val[2] = vsri_n_u8( argb.val[2], argb.val[2], 5 );
+        argb.val[1] = vshrn_n_u16( vshlq_n_u16( p, 5 ), 8 );
+        argb.val[1] = vsri_n_u8( argb.val[1], argb.val[1], 6 );
+        argb.val[0] = vshrn_n_u16( vshlq_n_u16( p, 11 ), 8 );
+        argb.val[0] = vsri_n_u8( argb.val[0], argb.val[0], 5 );
+        argb.val[3] = vdup_n_u8( 0xFF );
+
+        vst4_u8( (uint8_t*)dest, argb );
+        src += 8;
+        dest += 8;
+    }
+#else
+    /* Two pixels in, two words out */
+    if( ( (uint32_t)src & 3 ) == 0 )
+    {
+        for( ; count >= 2; count -= 2 )
+        {
+            uint32_t pixels = *(const uint32_t*)src;
+
+            dest[0] = rgb565_lo[pixels & 0xFF] | rgb565_hi[( pixels >> 8 ) & 0xFF];
+            dest[1] = rgb565_lo[( pixels >> 16 ) & 0xFF] | rgb565_hi[pixels >> 24];
+            src += 2;
+            dest += 2;
+        }
+    }
+#endif
+
+    while( count-- > 0 )
+    {
+        uint16_t pixel = *src++;
+
+        *dest++ = rgb565_lo[pixel & 0xFF] | rgb565_hi[pixel >> 8];
+    }
+}
+
+
+static inline uint16_t argb8888_to_rgb565( uint32_t pixel )
+{
+    return ( ( pixel >> 8 ) & 0xF800 ) | ( ( pixel >> 5 ) & 0x07E0 ) | ( ( pixel >> 3 ) & 0x001F );
+}
+
+
+void BLIT_Argb8888ToRgb565( uint16_t* dest, const uint32_t* src, int count )
+{
+#if defined( __ARM_NEON )
+    for( ; count >= 8; count -= 8 )
+    {
+        uint8x8x4_t argb = vld4_u8( (const uint8_t*)src );
+        uint16x8_t p;
+
+        /* Red at the top, then shift green and blue in under it */
+        p = vshll_n_u8( argb.val[2], 8 );
+        p = vsriq_n_u16( p, vshll_n_u8( argb.val[1], 8 ), 5 );
+        p = vsriq_n_u16( p, vshll_n_u8( argb.val[0], 8 ), 11 );
+
+        vst1q_u16( dest, p );
+        src += 8;
+        dest += 8;
+    }
+#else
+    /* Two pixels in, one word out */
+    if( ( (uint32_t)dest & 3 ) == 0 )
+    {
+        for( ; count >= 2; count -= 2 )
+        {
+            *(uint32_t*)dest = argb8888_to_rgb565( src[0] ) | ( argb8888_to_rgb565( src[1] ) << 16 );
+            src += 2;
+            dest += 2;
+        }
+    }
+#endif
+
+    while( count-- > 0 )
+        *dest++ = argb8888_to_rgb565( *src++ );
+}
+
+
+/**
+    @brief Convert a row of ARGB8888 to RGB565 with an ordered dither
+    @param x The position of the first pixel on the destination, which the dither pattern follows
+    so that it doesn't move with the image
+*/
+void BLIT_Argb8888ToRgb565Dither( uint16_t* dest, const uint32_t* src, int count, int x, int y )
+{
+    const uint8_t* row = bayer[y & 3];
+
+    for( int i = 0; i < count; i++ )
+    {
+        uint32_t pixel = src[i];
+        uint32_t d = row[( x + i ) & 3];
+        uint32_t r = ( ( pixel >> 16 ) & 0xFF ) + ( d >> 1 );
+        uint32_t g = ( ( pixel >> 8 ) & 0xFF ) + ( d >> 2 );
+        uint32_t b = ( pixel & 0xFF ) + ( d >> 1 );
+
+        /* Red and blue lose three bits so take a 0-7 threshold, green loses two and takes 0-3 */
+        if( r > 0xFF ) r = 0xFF;
+        if( g > 0xFF ) g = 0xFF;
+        if( b > 0xFF ) b = 0xFF;
+
+        dest[i] = ( ( r >> 3 ) << 11 ) | ( ( g >> 2 ) << 5 ) | ( b >> 3 );
+    }
+}
+
+
+/**
+    @brief Return non-zero if BLIT_Convert() can convert from one format to the other
+*/
+int BLIT_CanConvert( surface_format_t from, surface_format_t to )
+{
+    if( from == to )
+        return 1;
+
+    /* Nothing is converted to palette indices */
+    return ( to != SURFACE_FORMAT_PAL8 );
+}
+
+
+/**
+    @brief Copy a rectangle of pixels to a surface, converting them to the surface's format
+    @param palette The palette of SURFACE_FORMAT_PAL8 pixels, or NULL for the framebuffer's
+    @param flags BLIT_DITHER to dither ARGB8888 drawn on an RGB565 surface
+    @return 0 on success, -1 if the conversion isn't supported
+*/
+int BLIT_Convert( surface_t* dest, int x, int y, const void* src, int src_pitch,
+                  surface_format_t src_format, int width, int height,
+                  const palette_entry_t* palette, int flags )
+{
+    const uint8_t* in = src;
+    int src_bpp = SURFACE_BytesPerPixel( src_format );
+    uint16_t lut16[256];
+    uint32_t lut32[256];
+
+    if( !BLIT_CanConvert( src_format, dest->format ) )
+        return -1;
+
+    if( x < 0 )
+    {
+        in -= x * src_bpp;
+        width += x;
+        x = 0;
+    }
+
+    if( y < 0 )
+    {
+        in -= y * src_pitch;
+        height += y;
+        y = 0;
+    }
+
+    if( ( x + width ) > dest->width )
+        width = dest->width - x;
+
+    if( ( y + height ) > dest->height )
+        height = dest->height - y;
+
+    if( ( width <= 0 ) || ( height <= 0 ) )
+        return 0;
+
+    if( ( src_format == SURFACE_FORMAT_PAL8 ) && ( dest->format != SURFACE_FORMAT_PAL8 ) )
+    {
+        if( palette == NULL )
+            palette = RPI_GetPalette();
+
+        /* Palette entries have red in the low byte */
+        for( int i = 0; i < 256; i++ )
+        {
+            uint32_t r = palette[i] & 0xFF;
+            uint32_t g = ( palette[i] >> 8 ) & 0xFF;
+            uint32_t b = ( palette[i] >> 16 ) & 0xFF;
+
+            lut16[i] = ( ( r >> 3 ) << 11 ) | ( ( g >> 2 ) << 5 ) | ( b >> 3 );
+            lut32[i] = 0xFF000000 | ( r << 16 ) | ( g << 8 ) | b;
+        }
+    }
+
+    for( int row = 0; row < height; row++ )
+    {
+        void* out = SURFACE_PixelAddress( dest, x, y + row );
+
+        if( src_format == dest->format )
+            memcpy( out, in, width * src_bpp );
+        else if( src_format == SURFACE_FORMAT_PAL8 && dest->format == SURFACE_FORMAT_RGB565 )
+            BLIT_Pal8ToRgb565( out, in, width, lut16 );
+        else if( src_format == SURFACE_FORMAT_PAL8 )
+            BLIT_Pal8ToArgb8888( out, in, width, lut32 );
+        else if( src_format == SURFACE_FORMAT_RGB565 )
+            BLIT_Rgb565ToArgb8888( out, (const uint16_t*)in, width );
+        else if( flags & BLIT_DITHER )
+            BLIT_Argb8888ToRgb565Dither( out, (const uint32_t*)in, width, x, y + row );
+        else
+            BLIT_Argb8888ToRgb565( out, (const uint32_t*)in, width );
+
+        in += src_pitch;
+    }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef BLIT_CONVERT_H
+#define BLIT_CONVERT_H
+
+#include <stdint.h>
+
+#include "image.h"
+#include "surface.h"
+
+/** @brief Flags for BLIT_Convert() */
+#define BLIT_DITHER     ( 1 << 0 )      /**< Ordered dither when reducing 32bpp to 16bpp */
+
+extern void BLIT_Pal8ToRgb565( uint16_t* dest, const uint8_t* src, int count, const uint16_t* lut );
+extern void BLIT_Pal8ToArgb8888( uint32_t* dest, const uint8_t* src, int count, const uint32_t* lut );
+extern void BLIT_Rgb565ToArgb8888( uint32_t* dest, const uint16_t* src, int count );
+extern void BLIT_Argb8888ToRgb565( uint16_t* dest, const uint32_t* src, int count );
+extern void BLIT_Argb8888ToRgb565Dither( uint16_t* dest, const uint32_t* src, int count, int x, int y );
+
+extern int BLIT_Convert( surface_t* dest, int x, int y, const void* src, int src_pitch,
+                         surface_format_t src_format, int width, int height,
+                         const palette_entry_t* palette, int flags );
+extern int BLIT_CanConvert( surface_format_t from, surface_format_t to );
+
+#endif
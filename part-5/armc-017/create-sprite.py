@@ -0,0 +1,238 @@
+#!/usr/bin/python
+
+# Part of the Raspberry-Pi Bare Metal Tutorials
+# https://www.valvers.com/rpi/bare-metal/
+# Copyright (c) 2013-2020, Brian Sidebotham
+#
+# This software is licensed under the MIT License.
+# Please see the LICENSE file included with this software.
+
+# Convert an image into sprites (see sprite.h) that can be compiled straight into the kernel.
+#
+# Only the pixels that are drawn are kept, packed together, along with the runs of them on each row
+# (a span is a skip to its first pixel and a count of pixels). The sprites are const, so they stay
+# where they were linked, there's nothing to copy or create at startup, and SPRITE_Draw() reads
+# only the pixels it writes.
+#
+# The input is a GIMP C-source image dump like fonts/font09.c, or anything Pillow can read if it's
+# installed. With --cell the image is cut into a grid of sprites, one per cell, for fonts.
+
+import argparse
+import os
+import re
+import sys
+import textwrap
+
+parser = argparse.ArgumentParser(description='Convert an image into packed span sprites.')
+parser.add_argument('input', help='A GIMP C-source image dump, or any image Pillow can read')
+parser.add_argument('--output', action='store', help='The path of the .c and .h files to write, without the extension', required=True)
+parser.add_argument('--name', action='store', help='The C name of the sprite, or array of sprites')
+parser.add_argument('--depth', action='store', help='The depth of the sprite (from Pillow images, GIMP dumps keep theirs)', type=int, choices=[16, 32], default=16)
+parser.add_argument('--key', action='store', help='The transparent colour, in the format of the sprite', type=lambda v: int(v, 0))
+parser.add_argument('--alpha', action='store_true', help='Blend 32bpp pixels by their alpha')
+parser.add_argument('--cell', action='store', help='Cut the image into a grid of sprites each WIDTHxHEIGHT pixels')
+args = parser.parse_args()
+
+name = args.name or re.sub(r'\W', '_', os.path.basename(args.output))
+
+
+def c_string_bytes(literal):
+    """Decode the escapes of a C string literal"""
+    escapes = { 'n': 10, 't': 9, 'r': 13, '0': 0, '\\': 92, '"': 34, "'": 39, '?': 63 }
+    result = bytearray()
+    i = 0
+
+    while i < len(literal):
+        if literal[i] != '\\':
+            result.append(ord(literal[i]))
+            i += 1
+            continue
+
+        octal = re.match(r'[0-7]{1,3}', literal[i + 1:])
+
+        if octal:
+            result.append(int(octal.group(0), 8))
+            i += 1 + len(octal.group(0))
+        else:
+            result.append(escapes[literal[i + 1]])
+            i += 2
+
+    return bytes(result)
+
+
+def load_gimp(path):
+    """Returns width, height, bytes per pixel and the pixels as a list of rows of ints"""
+    with open(path) as rf:
+        source = rf.read()
+
+    header = re.search(r'=\s*\{\s*(\d+)\s*,\s*(\d+)\s*,\s*(\d+)\s*,', source)
+    width, height, bpp = (int(value) for value in header.groups())
+    data = c_string_bytes(''.join(re.findall(r'"((?:[^"\\]|\\.)*)"', source[header.end():])))
+
+    rows = []
+    for y in range(height):
+        row = data[y * width * bpp:(y + 1) * width * bpp]
+        rows.append([int.from_bytes(row[x * bpp:(x + 1) * bpp], 'little') for x in range(width)])
+
+    return width, height, bpp, rows
+
+
+def load_pillow(path, bpp):
+    from PIL import Image
+
+    image = Image.open(path).convert('RGBA')
+    width, height = image.size
+    rows = []
+
+    for y in range(height):
+        row = []
+        for x in range(width):
+            r, g, b, a = image.getpixel((x, y))
+            if bpp == 2:
+                row.append(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3))
+            else:
+                row.append((a << 24) | (r << 16) | (g << 8) | b)
+        rows.append(row)
+
+    return width, height, bpp, rows
+
+
+def classify(pixel, bpp):
+    """The same as sprite_classify() in sprite.c. None for a transparent pixel, otherwise whether
+    the pixel's blended"""
+    mask = 0xFFFF if bpp == 2 else 0x00FFFFFF
+
+    if args.key is not None and (pixel & mask) == (args.key & mask):
+        return None
+
+    if args.alpha and bpp == 4:
+        if (pixel >> 24) == 0:
+            return None
+        if (pixel >> 24) != 0xFF:
+            return True
+
+    return False
+
+
+def make_sprite(rows, left, top, width, height, bpp):
+    """Returns the sprite's row table, spans and packed pixels"""
+    table = []
+    spans = []
+    pixels = []
+
+    for y in range(top, top + height):
+        table.append(len(spans))
+        x = left
+
+        while x < left + width:
+            blend = classify(rows[y][x], bpp)
+            start = x
+            x += 1
+
+            if blend is None:
+                continue
+
+            while x < left + width and classify(rows[y][x], bpp) == blend:
+                x += 1
+
+            spans.append((start - left, x - start, 1 if blend else 0, len(pixels) * bpp))
+            pixels.extend(rows[y][start:x])
+
+    table.append(len(spans))
+
+    return table, spans, pixels
+
+
+if args.input.endswith('.c'):
+    width, height, bpp, rows = load_gimp(args.input)
+else:
+    width, height, bpp, rows = load_pillow(args.input, args.depth // 8)
+
+if args.cell:
+    cell_width, cell_height = (int(value) for value in args.cell.lower().split('x'))
+else:
+    cell_width, cell_height = width, height
+
+columns = width // cell_width
+cells = [(column * cell_width, row * cell_height) for row in range(height // cell_height) for column in range(columns)]
+sprites = [make_sprite(rows, left, top, cell_width, cell_height, bpp) for left, top in cells]
+
+pixel_type = 'uint16_t' if bpp == 2 else 'uint32_t'
+pixel_format = 'SURFACE_FORMAT_RGB565' if bpp == 2 else 'SURFACE_FORMAT_ARGB8888'
+guard = re.sub(r'\W', '_', os.path.basename(args.output)).upper() + '_H'
+total_pixels = sum(len(pixels) for table, spans, pixels in sprites)
+total_spans = sum(len(spans) for table, spans, pixels in sprites)
+
+with open(args.output + '.c', 'w') as wf:
+    wf.write( f"""
+/* This file is automatically generated by the tool create-sprite.py */
+/* Command: {sys.argv} */
+/* {width}x{height} pixels at {bpp * 8}bpp, {total_pixels} of them drawn in {total_spans} spans */
+#include "{os.path.basename(args.output)}.h"
+
+static const {pixel_type} {name}_pixels[] = {{
+""" )
+
+    for line in textwrap.wrap(' '.join(f'0x{pixel:0{bpp * 2}X},' for table, spans, pixels in sprites for pixel in pixels), 96):
+        wf.write(f'    {line}\n')
+
+    wf.write( f"""    }};
+
+static const sprite_span_t {name}_spans[] = {{
+""" )
+
+    for table, spans, pixels in sprites:
+        for x, length, blend, offset in spans:
+            wf.write(f'    {{ .x = {x}, .length = {length}, .blend = {blend}, .offset = {offset} }},\n')
+
+    wf.write( f"""    }};
+
+static const uint32_t {name}_rows[] = {{
+""" )
+
+    for table, spans, pixels in sprites:
+        for line in textwrap.wrap(' '.join(f'{index},' for index in table), 96):
+            wf.write(f'    {line}\n')
+
+    wf.write( "    };\n\n" )
+
+    if args.cell:
+        wf.write(f'const sprite_t {name}[{len(sprites)}] = {{\n')
+    else:
+        wf.write(f'const sprite_t {name} =\n')
+
+    pixel_base = 0
+    span_base = 0
+    for index, (table, spans, pixels) in enumerate(sprites):
+        wf.write( f"""    {{ .width = {cell_width}, .height = {cell_height}, .format = {pixel_format}, .bytes_per_pixel = {bpp},
+      .pixels = (const uint8_t*)&{name}_pixels[{pixel_base}], .rows = &{name}_rows[{index * (cell_height + 1)}],
+      .spans = &{name}_spans[{span_base}] }}{',' if args.cell else ';'}
+""" )
+        pixel_base += len(pixels)
+        span_base += len(spans)
+
+    if args.cell:
+        wf.write( "    };\n" )
+
+with open(args.output + '.h', 'w') as wf:
+    wf.write( f"""
+/* This file is automatically generated by the tool create-sprite.py */
+/* Command: {sys.argv} */
+
+#ifndef {guard}
+#define {guard}
+
+#include "sprite.h"
+
+""" )
+
+    if args.cell:
+        wf.write( f"""#define {name.upper()}_COLUMNS {columns}
+#define {name.upper()}_COUNT {len(sprites)}
+
+extern const sprite_t {name}[{name.upper()}_COUNT];
+""" )
+    else:
+        wf.write(f'extern const sprite_t {name};\n')
+
+    wf.write( "\n#endif\n" )
@@ -0,0 +1,81 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* Palette effects for 8bpp framebuffers. Everything here animates by changing the palette, so
+   nothing is drawn - an 8bpp image can look like it's moving without touching a single pixel */
+#include <stdlib.h>
+
+#include "pool.h"
+#include "effects.h"
+#include "rpi-framebuffer.h"
+
+POOL_DEFINE( palette_cycle_effect, palette_cycle_effect_t, 8 )
+
+palette_cycle_effect_t* FX_NewPaletteCycle( palette_cycle_settings_t settings )
+{
+    palette_cycle_effect_t* fx = palette_cycle_effect_pool_alloc();
+
+    if( fx == NULL )
+        return NULL;
+
+    fx->settings = settings;
+
+    if( fx->settings.period < 1 )
+        fx->settings.period = 1;
+
+    fx->countdown = fx->settings.period;
+
+    return fx;
+}
+
+void FX_FreePaletteCycle( palette_cycle_effect_t* fx )
+{
+    if( fx == NULL )
+        return;
+
+    palette_cycle_effect_pool_free( fx );
+}
+
+/**
+    @brief Call once a frame, the palette is rotated every period frames
+*/
+void FX_AnimatePaletteCycle( palette_cycle_effect_t* fx )
+{
+    if( fx == NULL )
+        return;
+
+    if( --fx->countdown > 0 )
+        return;
+
+    fx->countdown = fx->settings.period;
+    RPI_RotatePalette( fx->settings.first, fx->settings.count, fx->settings.step );
+}
+
+/**
+    @brief Fill count palette entries with an even ramp from one colour to another
+*/
+void FX_PaletteGradient( palette_entry_t* entries, int count, palette_entry_t from, palette_entry_t to )
+{
+    for( int i = 0; i < count; i++ )
+    {
+        int t = ( count > 1 ) ? ( i * 256 ) / ( count - 1 ) : 0;
+        palette_entry_t entry = 0;
+
+        for( int shift = 0; shift < 24; shift += 8 )
+        {
+            int a = ( from >> shift ) & 0xFF;
+            int b = ( to >> shift ) & 0xFF;
+
+            entry |= ( ( a + ( ( ( b - a ) * t ) >> 8 ) ) & 0xFF ) << shift;
+        }
+
+        entries[i] = entry;
+    }
+}
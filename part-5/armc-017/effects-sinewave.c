@@ -12,9 +12,12 @@
    and bootloader productions */
 #include <stdlib.h>
 
+#include "pool.h"
 #include "sinewave.h"
 #include "effects.h"
 
+POOL_DEFINE( sinewave_effect, sinewave_effect_t, 16 )
+
 static int sin_vertical_blit_y_processor(int x, sinewave_effect_t* fx)
 {
     return fx->sinewave->data[( x + fx->index ) % fx->sinewave->steps];
@@ -22,7 +25,11 @@ static int sin_vertical_blit_y_processor(int x, sinewave_effect_t* fx)
 
 sinewave_effect_t* FX_NewSine( sinewave_settings_t settings )
 {
-    sinewave_effect_t* fx = malloc( sizeof(sinewave_effect_t) );
+    sinewave_effect_t* fx = sinewave_effect_pool_alloc();
+
+    if( fx == NULL )
+        return NULL;
+
     fx->effect.effect_type = TEXT_EFFECT_SINEWAVE;
     fx->effect.vertical_blit_y_processor = sin_vertical_blit_y_processor;
     fx->index = 0;
@@ -36,6 +43,15 @@ sinewave_effect_t* FX_NewSine( sinewave_settings_t settings )
     return fx;
 }
 
+void FX_FreeSine( sinewave_effect_t* fx )
+{
+    if( fx == NULL )
+        return;
+
+    SIN_Free( fx->sinewave );
+    sinewave_effect_pool_free( fx );
+}
+
 void FX_AnimateSine( sinewave_effect_t* fx )
 {
     if( fx == NULL )
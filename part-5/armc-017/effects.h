@@ -45,6 +45,25 @@ typedef struct {
     } sinewave_effect_t;
 
 extern sinewave_effect_t* FX_NewSine( sinewave_settings_t settings );
+extern void FX_FreeSine( sinewave_effect_t* fx );
 extern void FX_AnimateSine( sinewave_effect_t* fx );
 
+typedef struct {
+    int first;          /**< The first palette entry to cycle */
+    int count;          /**< The number of entries to cycle */
+    int step;           /**< The entries to move each time, negative to cycle the other way */
+    int period;         /**< The number of frames between moves */
+    } palette_cycle_settings_t;
+
+typedef struct {
+    palette_cycle_settings_t settings;
+    int countdown;
+    } palette_cycle_effect_t;
+
+extern palette_cycle_effect_t* FX_NewPaletteCycle( palette_cycle_settings_t settings );
+extern void FX_FreePaletteCycle( palette_cycle_effect_t* fx );
+extern void FX_AnimatePaletteCycle( palette_cycle_effect_t* fx );
+extern void FX_PaletteGradient( palette_entry_t* entries, int count, palette_entry_t from,
+                                palette_entry_t to );
+
 #endif
@@ -0,0 +1,395 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A text console on the framebuffer, so there's somewhere to see the output on a board without a
+   serial cable.
+
+   Every character of the font is converted to the framebuffer's depth once, when the console
+   starts, into a cell that's copied a row at a time. The text is kept in a grid of characters and
+   writing only marks the cells that changed. They're drawn when the write is finished, one span per
+   line.
+
+   The console runs the framebuffer in vertical scrolling mode (see RPI_InitScrolling()), so a new
+   line scrolls the screen by moving the virtual offset and only the new line is drawn. The grid is
+   a ring of lines to match - line n of the output is always row n % rows of the grid. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fb-console.h"
+#include "rpi-framebuffer.h"
+#include "rpi-spinlock.h"
+#include "surface.h"
+
+typedef struct {
+    int columns;
+    int rows;
+    int cell_width;
+    int cell_height;
+    int bytes_per_pixel;
+    int glyph_row_bytes;
+    int glyph_bytes;
+
+    uint8_t* glyphs;            /**< A cell of pixels for each character */
+    char* text;                 /**< rows lines of columns characters */
+    int* dirty_start;           /**< The first column of each row to draw */
+    int* dirty_end;             /**< One past the last column of each row to draw, 0 when clean */
+
+    int top;                    /**< The output line at the top of the screen */
+    int cursor_x;
+    int cursor_y;               /**< The output line being written */
+
+    rpi_spinlock_t lock;
+    } console_t;
+
+static console_t console = { .lock = RPI_SPINLOCK_INIT };
+static int console_ready = 0;
+static int stdout_backends = CONSOLE_STDOUT_UART;
+
+
+/* Read a pixel of the font image and convert it to the framebuffer's depth */
+static uint32_t console_convert( const uint8_t* pixel, int from_bpp, int to_bpp )
+{
+    uint32_t r, g, b;
+
+    if( from_bpp == to_bpp )
+    {
+        if( from_bpp == 1 )
+            return *pixel;
+
+        return ( from_bpp == 2 ) ? *(const uint16_t*)pixel : *(const uint32_t*)pixel;
+    }
+
+    if( from_bpp == 2 )
+    {
+        uint16_t rgb = *(const uint16_t*)pixel;
+
+        r = ( ( rgb >> 11 ) & 0x1F ) << 3;
+        g = ( ( rgb >> 5 ) & 0x3F ) << 2;
+        b = ( rgb & 0x1F ) << 3;
+    }
+    else if( from_bpp == 4 )
+    {
+        uint32_t argb = *(const uint32_t*)pixel;
+
+        r = ( argb >> 16 ) & 0xFF;
+        g = ( argb >> 8 ) & 0xFF;
+        b = argb & 0xFF;
+    }
+    else
+    {
+        r = g = b = *pixel ? 0xFF : 0;
+    }
+
+    if( to_bpp == 4 )
+        return 0xFF000000 | ( r << 16 ) | ( g << 8 ) | b;
+
+    if( to_bpp == 2 )
+        return ( ( r >> 3 ) << 11 ) | ( ( g >> 2 ) << 5 ) | ( b >> 3 );
+
+    /* Anything lit is the brightest palette entry */
+    return ( r | g | b ) ? 0xFF : 0;
+}
+
+
+/* Convert every character of the font into a cell for the framebuffer */
+static void console_rasterise( image_font_t* font )
+{
+    const image_t* image = font->image;
+
+    for( int c = 0; c < 128; c++ )
+    {
+        uint8_t* cell = console.glyphs + ( c * console.glyph_bytes );
+
+        /* The font has no characters in control codes, and characters it doesn't have are left at
+           the first character of the image */
+        if( ( c < ' ' ) || ( ( font->character_offsets[c] == 0 ) && ( c != 'A' ) && ( c != 'a' ) ) )
+        {
+            memset( cell, 0, console.glyph_bytes );
+            continue;
+        }
+
+        for( int y = 0; y < console.cell_height; y++ )
+        {
+            const uint8_t* src = &image->pixel_data[font->character_offsets[c] + ( y * image->pitch )];
+            uint8_t* dest = cell + ( y * console.glyph_row_bytes );
+
+            for( int x = 0; x < console.cell_width; x++ )
+            {
+                uint32_t pixel = console_convert( src + ( x * image->bytes_per_pixel ),
+                                                  image->bytes_per_pixel, console.bytes_per_pixel );
+
+                if( console.bytes_per_pixel == 1 )
+                    dest[x] = pixel;
+                else if( console.bytes_per_pixel == 2 )
+                    ( (uint16_t*)dest )[x] = pixel;
+                else
+                    ( (uint32_t*)dest )[x] = pixel;
+            }
+        }
+    }
+}
+
+
+/* The scroll callback. Draws the part of the output at x, y into a region of the framebuffer,
+   which can start and end part way through cells */
+static void console_draw( surface_t* region, int x, int y, void* arg )
+{
+    const int bpp = console.bytes_per_pixel;
+
+    for( int py = 0; py < region->height; py++ )
+    {
+        uint8_t* dest = SURFACE_PixelAddress( region, 0, py );
+        int line = ( y + py ) / console.cell_height;
+        int glyph_y = ( y + py ) % console.cell_height;
+        const char* text = NULL;
+        int px = 0;
+
+        if( ( line >= console.top ) && ( line < ( console.top + console.rows ) ) )
+            text = &console.text[( line % console.rows ) * console.columns];
+
+        while( px < region->width )
+        {
+            int column = ( x + px ) / console.cell_width;
+            int glyph_x = ( x + px ) % console.cell_width;
+            int count = console.cell_width - glyph_x;
+
+            if( count > ( region->width - px ) )
+                count = region->width - px;
+
+            if( ( text == NULL ) || ( column >= console.columns ) )
+            {
+                memset( dest + ( px * bpp ), 0, count * bpp );
+            }
+            else
+            {
+                const uint8_t* glyph = console.glyphs + ( ( text[column] & 0x7F ) * console.glyph_bytes );
+
+                memcpy( dest + ( px * bpp ),
+                        glyph + ( glyph_y * console.glyph_row_bytes ) + ( glyph_x * bpp ),
+                        count * bpp );
+            }
+
+            px += count;
+        }
+    }
+}
+
+
+static void console_mark( int line, int column )
+{
+    int row = line % console.rows;
+
+    if( console.dirty_end[row] == 0 )
+    {
+        console.dirty_start[row] = column;
+        console.dirty_end[row] = column + 1;
+        return;
+    }
+
+    if( column < console.dirty_start[row] )
+        console.dirty_start[row] = column;
+
+    if( column >= console.dirty_end[row] )
+        console.dirty_end[row] = column + 1;
+}
+
+
+/* Move on to a new line, scrolling the screen when the cursor's on the bottom line */
+static void console_newline( void )
+{
+    int row;
+
+    console.cursor_x = 0;
+    console.cursor_y++;
+
+    if( console.cursor_y < ( console.top + console.rows ) )
+        return;
+
+    /* The new line takes the grid row of the line scrolling off the top. Clear it before scrolling
+       so it's drawn blank */
+    row = console.cursor_y % console.rows;
+
+    memset( &console.text[row * console.columns], ' ', console.columns );
+    console.dirty_end[row] = 0;
+    console.top++;
+
+    RPI_Scroll( 0, console.cell_height );
+}
+
+
+/* Draw the cells that have changed */
+static void console_flush( void )
+{
+    for( int line = console.top; line < ( console.top + console.rows ); line++ )
+    {
+        int row = line % console.rows;
+
+        if( console.dirty_end[row] == 0 )
+            continue;
+
+        RPI_ScrollInvalidate( console.dirty_start[row] * console.cell_width,
+                              line * console.cell_height,
+                              ( console.dirty_end[row] - console.dirty_start[row] ) * console.cell_width,
+                              console.cell_height );
+
+        console.dirty_end[row] = 0;
+    }
+}
+
+
+/**
+    @brief Start the console on the framebuffer
+    @param font The font, which must stay around while the console's running
+    @return 0 on success, -1 if there isn't the memory or a scrolling framebuffer
+
+    The framebuffer is switched to vertical scrolling, so nothing else should draw on it.
+*/
+int CONSOLE_Init( image_font_t* font )
+{
+    framebuffer_info_t* fb = RPI_GetFramebuffer();
+
+    if( ( font == NULL ) || ( fb->bytes_per_pixel == 0 ) )
+        return -1;
+
+    console_ready = 0;
+
+    console.cell_width = font->pixel_width;
+    console.cell_height = font->pixel_height;
+    console.bytes_per_pixel = fb->bytes_per_pixel;
+    console.columns = fb->physical_width / console.cell_width;
+    console.rows = fb->physical_height / console.cell_height;
+    console.glyph_row_bytes = console.cell_width * console.bytes_per_pixel;
+    console.glyph_bytes = console.glyph_row_bytes * console.cell_height;
+
+    if( ( console.columns == 0 ) || ( console.rows == 0 ) )
+        return -1;
+
+    free( console.glyphs );
+    free( console.text );
+    free( console.dirty_start );
+    free( console.dirty_end );
+
+    console.glyphs = malloc( 128 * console.glyph_bytes );
+    console.text = malloc( console.rows * console.columns );
+    console.dirty_start = calloc( console.rows, sizeof( int ) );
+    console.dirty_end = calloc( console.rows, sizeof( int ) );
+
+    if( !console.glyphs || !console.text || !console.dirty_start || !console.dirty_end )
+        return -1;
+
+    console_rasterise( font );
+
+    memset( console.text, ' ', console.rows * console.columns );
+    console.top = 0;
+    console.cursor_x = 0;
+    console.cursor_y = 0;
+
+    if( RPI_InitScrolling( RPI_SCROLL_VERTICAL, console_draw, NULL ) != 0 )
+        return -1;
+
+    console_ready = 1;
+
+    return 0;
+}
+
+
+/**
+    @brief Write characters to the console. Understands \n, \r, \t and \b
+*/
+void CONSOLE_Write( const char* str, int len )
+{
+    uint32_t cpsr;
+
+    if( !console_ready )
+        return;
+
+    cpsr = RPI_SpinLockIrqSave( &console.lock );
+
+    for( int i = 0; i < len; i++ )
+    {
+        char c = str[i];
+
+        switch( c )
+        {
+            case '\n':
+                console_newline();
+                break;
+
+            case '\r':
+                console.cursor_x = 0;
+                break;
+
+            case '\t':
+                console.cursor_x = ( console.cursor_x + CONSOLE_TAB_SIZE ) & ~( CONSOLE_TAB_SIZE - 1 );
+
+                if( console.cursor_x >= console.columns )
+                    console_newline();
+                break;
+
+            case '\b':
+                if( console.cursor_x > 0 )
+                    console.cursor_x--;
+                break;
+
+            default:
+                if( console.cursor_x >= console.columns )
+                    console_newline();
+
+                console.text[( ( console.cursor_y % console.rows ) * console.columns ) + console.cursor_x] = c;
+                console_mark( console.cursor_y, console.cursor_x );
+                console.cursor_x++;
+                break;
+        }
+    }
+
+    console_flush();
+
+    RPI_SpinUnlockIrqRestore( &console.lock, cpsr );
+}
+
+
+void CONSOLE_Clear( void )
+{
+    uint32_t cpsr;
+
+    if( !console_ready )
+        return;
+
+    cpsr = RPI_SpinLockIrqSave( &console.lock );
+
+    memset( console.text, ' ', console.rows * console.columns );
+
+    for( int row = 0; row < console.rows; row++ )
+        console.dirty_end[row] = 0;
+
+    console.cursor_x = 0;
+    console.cursor_y = console.top;
+    RPI_ScrollRedraw();
+
+    RPI_SpinUnlockIrqRestore( &console.lock, cpsr );
+}
+
+
+/**
+    @brief Choose where _write() sends stdout
+    @param backends CONSOLE_STDOUT_UART and/or CONSOLE_STDOUT_FRAMEBUFFER
+*/
+void CONSOLE_SetStdout( int backends )
+{
+    stdout_backends = backends;
+}
+
+
+int CONSOLE_GetStdout( void )
+{
+    return stdout_backends;
+}
@@ -0,0 +1,29 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef FB_CONSOLE_H
+#define FB_CONSOLE_H
+
+#include "image-font.h"
+
+/** @brief Where stdout (and everything else written with _write()) goes, see CONSOLE_SetStdout() */
+#define CONSOLE_STDOUT_UART         ( 1 << 0 )
+#define CONSOLE_STDOUT_FRAMEBUFFER  ( 1 << 1 )
+
+/** @brief Spaces per tab stop */
+#define CONSOLE_TAB_SIZE            4
+
+extern int CONSOLE_Init( image_font_t* font );
+extern void CONSOLE_Write( const char* str, int len );
+extern void CONSOLE_Clear( void );
+extern void CONSOLE_SetStdout( int backends );
+extern int CONSOLE_GetStdout( void );
+
+#endif
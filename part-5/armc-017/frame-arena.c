@@ -0,0 +1,135 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A per-frame arena for transient render data. Allocating is just bumping an offset, there's no
+   free - everything allocated is thrown away together when the frame is presented by
+   RPI_Present() or RPI_SwitchFramebuffer(). Allocations are rounded up to whole cache lines so
+   that scratch buffers never share a line with anything else.
+
+   Code that only needs scratch memory for the duration of a call can take a mark with
+   ARENA_Mark() and give everything allocated after it back with ARENA_Release().
+
+   Each core has its own arena so there's no locking. On a core the arena belongs to the render
+   loop, other tasks shouldn't use it. */
+
+#include <malloc.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "frame-arena.h"
+#include "rpi-base.h"
+#include "rpi-local-intc.h"
+#include "rpi-smp.h"
+
+typedef struct {
+    uint8_t* memory;
+    uint32_t size;
+    uint32_t offset;
+    uint32_t peak;
+    uint32_t failures;
+    } arena_t;
+
+static arena_t arenas[RPI_CORE_COUNT];
+
+
+/**
+    @brief Create the calling core's arena with size bytes
+    @return 0 on success, -1 if the memory couldn't be allocated
+*/
+int ARENA_Init( uint32_t size )
+{
+    arena_t* arena = &arenas[RPI_GetCoreId()];
+
+    size = ( size + ( RPI_CACHE_LINE_SIZE - 1 ) ) & ~( RPI_CACHE_LINE_SIZE - 1 );
+
+    free( arena->memory );
+    arena->memory = memalign( RPI_CACHE_LINE_SIZE, size );
+    arena->size = arena->memory ? size : 0;
+    arena->offset = 0;
+    arena->peak = 0;
+
+    return arena->memory ? 0 : -1;
+}
+
+
+/**
+    @brief Allocate size bytes from the calling core's arena. The memory is only valid until the
+    end of the frame
+    @return The cache line aligned memory, or NULL if the arena is full
+*/
+void* ARENA_Alloc( size_t size )
+{
+    arena_t* arena = &arenas[RPI_GetCoreId()];
+    void* ptr;
+
+    if( ( arena->memory == NULL ) && ( ARENA_Init( ARENA_DEFAULT_SIZE ) != 0 ) )
+        return NULL;
+
+    size = ( size + ( RPI_CACHE_LINE_SIZE - 1 ) ) & ~( RPI_CACHE_LINE_SIZE - 1 );
+
+    if( size > ( arena->size - arena->offset ) )
+    {
+        arena->failures++;
+        return NULL;
+    }
+
+    ptr = &arena->memory[arena->offset];
+    arena->offset += size;
+
+    if( arena->offset > arena->peak )
+        arena->peak = arena->offset;
+
+    return ptr;
+}
+
+
+/**
+    @brief Return the calling core's current arena position to pass to ARENA_Release()
+*/
+uint32_t ARENA_Mark( void )
+{
+    return arenas[RPI_GetCoreId()].offset;
+}
+
+
+/**
+    @brief Free everything allocated from the calling core's arena since mark was taken
+*/
+void ARENA_Release( uint32_t mark )
+{
+    arena_t* arena = &arenas[RPI_GetCoreId()];
+
+    if( mark < arena->offset )
+        arena->offset = mark;
+}
+
+
+/**
+    @brief Throw away everything allocated from every core's arena this frame. Called by
+    RPI_Present() and RPI_SwitchFramebuffer(), so all render work for the frame must be finished by
+    then
+*/
+void ARENA_EndFrame( void )
+{
+    for( int core = 0; core < RPI_CORE_COUNT; core++ )
+        arenas[core].offset = 0;
+}
+
+
+void ARENA_GetStats( arena_stats_t* stats )
+{
+    arena_t* arena = &arenas[RPI_GetCoreId()];
+
+    stats->size = arena->size;
+    stats->used = arena->offset;
+    stats->peak = arena->peak;
+    stats->failures = arena->failures;
+}
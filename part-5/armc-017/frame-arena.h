@@ -0,0 +1,35 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief The size of each core's arena if ARENA_Init() isn't called to set it */
+#define ARENA_DEFAULT_SIZE      ( 256 * 1024 )
+
+/** @brief Statistics for the calling core's arena */
+typedef struct {
+    uint32_t size;
+    uint32_t used;              /**< Bytes allocated so far this frame */
+    uint32_t peak;              /**< The most bytes allocated in any one frame */
+    uint32_t failures;          /**< Allocations that didn't fit */
+    } arena_stats_t;
+
+extern int ARENA_Init( uint32_t size );
+extern void* ARENA_Alloc( size_t size );
+extern uint32_t ARENA_Mark( void );
+extern void ARENA_Release( uint32_t mark );
+extern void ARENA_EndFrame( void );
+extern void ARENA_GetStats( arena_stats_t* stats );
+
+#endif
@@ -0,0 +1,453 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* The system heap. A single large block of cached memory is taken from the page allocator (see
+   page-alloc.c) and handed to a TLSF pool, and newlib's malloc family is replaced with functions
+   that allocate from it. That includes the re-entrant _r versions that the rest of newlib
+   (printf, etc.) uses, so newlib's own allocator is never linked in and malloc and free always
+   complete in bounded time.
+
+   The TLSF pool is the central heap and is shared by all of the cores behind a spinlock. In front
+   of it each core keeps a cache of free blocks for each of a handful of small size classes, so
+   most small allocations and frees never touch the lock. A core refills an empty class with
+   HEAP_CACHE_BATCH blocks at a time and returns HEAP_CACHE_BATCH blocks when a class grows past
+   HEAP_CACHE_LIMIT, so the lock is taken at most once per batch. A block freed on a different
+   core to the one that allocated it simply joins the freeing core's cache.
+
+   Cached blocks are still allocated as far as TLSF is concerned, there's no header of our own.
+   The class a block belongs to when it's freed comes from its TLSF block size, which is at least
+   the class size it was allocated for and never a whole class bigger.
+
+   Allocation is made safe against the scheduler and interrupt handlers by masking IRQs. TLSF's
+   operations are O(1) so this only holds interrupts off for a short, bounded time. */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "heap.h"
+#include "page-alloc.h"
+#include "rpi-base.h"
+#include "rpi-interrupts.h"
+#include "rpi-local-intc.h"
+#include "rpi-smp.h"
+#include "rpi-spinlock.h"
+#include "tlsf.h"
+
+struct _reent;
+
+/* The size class lookup tables are indexed in steps of HEAP_CACHE_GRANULE bytes */
+#define HEAP_CACHE_GRANULE_LOG2     4
+#define HEAP_CACHE_GRANULE          ( 1 << HEAP_CACHE_GRANULE_LOG2 )
+#define HEAP_CACHE_LOOKUP_COUNT     ( ( HEAP_CACHE_MAX_SIZE >> HEAP_CACHE_GRANULE_LOG2 ) + 1 )
+
+typedef struct cache_block_t cache_block_t;
+
+struct cache_block_t {
+    cache_block_t* next;
+    };
+
+/* Each core's cache is on its own cache lines */
+typedef struct {
+    cache_block_t* blocks[HEAP_CACHE_CLASS_COUNT];
+    uint32_t count[HEAP_CACHE_CLASS_COUNT];
+    heap_cache_stats_t stats;
+    } __attribute__((aligned(RPI_CACHE_LINE_SIZE))) heap_cache_t;
+
+static const uint16_t class_size[HEAP_CACHE_CLASS_COUNT] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+
+/* The class to allocate a request from, indexed by the size rounded up to a granule, and the
+   class a free block goes back to, indexed by the block size rounded down (-1 for none) */
+static uint8_t alloc_class[HEAP_CACHE_LOOKUP_COUNT];
+static int8_t free_class[HEAP_CACHE_LOOKUP_COUNT];
+
+static heap_cache_t caches[RPI_CORE_COUNT];
+
+static tlsf_t* heap = NULL;
+static tlsf_stats_t last_stats;
+
+/* The central heap lock. It's recursive so that newlib's __malloc_lock() can be held around
+   calls back into the allocator */
+static rpi_spinlock_t heap_spinlock = RPI_SPINLOCK_INIT;
+static volatile int lock_owner = -1;
+static uint32_t lock_depth;
+static uint32_t lock_cpsr;
+
+
+static void heap_lock( void )
+{
+    uint32_t cpsr = RPI_IrqSaveDisable();
+    int core = RPI_GetCoreId();
+
+    if( lock_owner == core )
+    {
+        lock_depth++;
+        return;
+    }
+
+    RPI_SpinLock( &heap_spinlock );
+    lock_owner = core;
+    lock_depth = 1;
+    lock_cpsr = cpsr;
+}
+
+
+static void heap_unlock( void )
+{
+    uint32_t cpsr = lock_cpsr;
+
+    if( --lock_depth )
+        return;
+
+    lock_owner = -1;
+    RPI_SpinUnlock( &heap_spinlock );
+    RPI_IrqRestore( cpsr );
+}
+
+
+/**
+    @brief Create the heap. Called from _cstartup after PAGE_Init() and before main, so nothing
+    can have allocated yet
+    @return 0 on success, -1 if the page allocator couldn't give the heap any memory
+*/
+int HEAP_Init( void )
+{
+    page_stats_t stats;
+    int order = PAGE_Order( HEAP_MAX_SIZE );
+    void* memory = NULL;
+    int c = 0;
+
+    /* Leave at least half of the cached memory to the page allocator */
+    PAGE_GetStats( PAGE_ZONE_CACHED, &stats );
+
+    while( ( order > 0 ) && ( ( PAGE_SIZE << order ) > ( ( stats.free_pages << PAGE_SHIFT ) / 2 ) ) )
+        order--;
+
+    while( ( memory == NULL ) && ( order >= 0 ) )
+        memory = PAGE_Alloc( PAGE_ZONE_CACHED, order-- );
+
+    if( memory == NULL )
+        return -1;
+
+    heap = TLSF_Create( memory, PAGE_SIZE << ( order + 1 ) );
+
+    for( int i = 0; i < HEAP_CACHE_LOOKUP_COUNT; i++ )
+    {
+        uint32_t size = i << HEAP_CACHE_GRANULE_LOG2;
+
+        while( class_size[c] < size )
+            c++;
+
+        alloc_class[i] = c;
+        free_class[i] = ( class_size[c] == size ) ? c : c - 1;
+    }
+
+    return 0;
+}
+
+
+/* Take a batch of blocks for a class from the central heap */
+static void cache_refill( heap_cache_t* cache, int c )
+{
+    heap_lock();
+
+    for( int i = 0; i < HEAP_CACHE_BATCH; i++ )
+    {
+        cache_block_t* block = TLSF_Malloc( heap, class_size[c] );
+
+        if( block == NULL )
+            break;
+
+        block->next = cache->blocks[c];
+        cache->blocks[c] = block;
+        cache->count[c]++;
+    }
+
+    heap_unlock();
+
+    cache->stats.refills++;
+}
+
+
+/* Give a batch of blocks for a class back to the central heap */
+static void cache_flush( heap_cache_t* cache, int c )
+{
+    heap_lock();
+
+    for( int i = 0; ( i < HEAP_CACHE_BATCH ) && cache->blocks[c]; i++ )
+    {
+        cache_block_t* block = cache->blocks[c];
+
+        cache->blocks[c] = block->next;
+        cache->count[c]--;
+        TLSF_Free( heap, block );
+    }
+
+    heap_unlock();
+
+    cache->stats.flushes++;
+}
+
+
+static void* cache_alloc( int c )
+{
+    uint32_t cpsr = RPI_IrqSaveDisable();
+    heap_cache_t* cache = &caches[RPI_GetCoreId()];
+    cache_block_t* block;
+
+    if( cache->blocks[c] == NULL )
+        cache_refill( cache, c );
+    else
+        cache->stats.hits++;
+
+    if( ( block = cache->blocks[c] ) )
+    {
+        cache->blocks[c] = block->next;
+        cache->count[c]--;
+    }
+
+    RPI_IrqRestore( cpsr );
+
+    return block;
+}
+
+
+static void cache_free( int c, void* ptr )
+{
+    uint32_t cpsr = RPI_IrqSaveDisable();
+    heap_cache_t* cache = &caches[RPI_GetCoreId()];
+    cache_block_t* block = ptr;
+
+    block->next = cache->blocks[c];
+    cache->blocks[c] = block;
+
+    if( ++cache->count[c] > HEAP_CACHE_LIMIT )
+        cache_flush( cache, c );
+
+    RPI_IrqRestore( cpsr );
+}
+
+
+/**
+    @brief Get the central heap's statistics. Blocks held in the cores' caches count as used
+*/
+void HEAP_GetStats( tlsf_stats_t* stats )
+{
+    heap_lock();
+    TLSF_GetStats( heap, stats );
+    heap_unlock();
+}
+
+
+/**
+    @brief Get the statistics of a core's small block cache
+*/
+void HEAP_GetCacheStats( int core, heap_cache_stats_t* stats )
+{
+    heap_cache_t* cache;
+
+    if( ( core < 0 ) || ( core >= RPI_CORE_COUNT ) )
+        return;
+
+    cache = &caches[core];
+    *stats = cache->stats;
+    stats->cached_bytes = 0;
+
+    for( int c = 0; c < HEAP_CACHE_CLASS_COUNT; c++ )
+        stats->cached_bytes += cache->count[c] * class_size[c];
+}
+
+
+/**
+    @brief Print the heap usage and fragmentation to stdout, with the number of allocations and
+    frees since the last dump
+*/
+void HEAP_Dump( void )
+{
+    tlsf_stats_t stats;
+
+    HEAP_GetStats( &stats );
+
+    printf( "Heap: %uKiB used (peak %uKiB) of %uKiB, %uKiB free in %u blocks, largest %uKiB (%u%% fragmented)\r\n",
+            (unsigned int)( stats.used >> 10 ),
+            (unsigned int)( stats.peak_used >> 10 ),
+            (unsigned int)( stats.pool_size >> 10 ),
+            (unsigned int)( stats.free >> 10 ),
+            (unsigned int)stats.free_blocks,
+            (unsigned int)( stats.largest_free >> 10 ),
+            (unsigned int)stats.fragmentation );
+
+    printf( "Heap: %u allocations (+%u) %u frees (+%u) %u failures\r\n",
+            (unsigned int)stats.allocations,
+            (unsigned int)( stats.allocations - last_stats.allocations ),
+            (unsigned int)stats.frees,
+            (unsigned int)( stats.frees - last_stats.frees ),
+            (unsigned int)stats.failures );
+
+    for( int core = 0; core < RPI_CORE_COUNT; core++ )
+    {
+        heap_cache_stats_t cache;
+
+        HEAP_GetCacheStats( core, &cache );
+
+        if( cache.hits || cache.refills )
+        {
+            printf( "Heap: core %d cache %u hits %u refills %u flushes, %uKiB cached\r\n",
+                    core,
+                    (unsigned int)cache.hits,
+                    (unsigned int)cache.refills,
+                    (unsigned int)cache.flushes,
+                    (unsigned int)( cache.cached_bytes >> 10 ) );
+        }
+    }
+
+    last_stats = stats;
+}
+
+
+void* _malloc_r( struct _reent* r, size_t size )
+{
+    void* ptr;
+
+    if( size <= HEAP_CACHE_MAX_SIZE )
+    {
+        ptr = cache_alloc( alloc_class[( size + HEAP_CACHE_GRANULE - 1 ) >> HEAP_CACHE_GRANULE_LOG2] );
+    }
+    else
+    {
+        heap_lock();
+        ptr = TLSF_Malloc( heap, size );
+        heap_unlock();
+    }
+
+    if( ptr == NULL )
+        errno = ENOMEM;
+
+    return ptr;
+}
+
+
+void _free_r( struct _reent* r, void* ptr )
+{
+    uint32_t lookup;
+
+    if( ptr == NULL )
+        return;
+
+    /* Only the owner of an allocated block changes its size, so this doesn't need the lock */
+    lookup = TLSF_BlockSize( ptr ) >> HEAP_CACHE_GRANULE_LOG2;
+
+    if( ( lookup < HEAP_CACHE_LOOKUP_COUNT ) && ( free_class[lookup] >= 0 ) )
+    {
+        cache_free( free_class[lookup], ptr );
+        return;
+    }
+
+    heap_lock();
+    TLSF_Free( heap, ptr );
+    heap_unlock();
+}
+
+
+void* _realloc_r( struct _reent* r, void* ptr, size_t size )
+{
+    heap_lock();
+    void* moved = TLSF_Realloc( heap, ptr, size );
+    heap_unlock();
+
+    if( ( moved == NULL ) && size )
+        errno = ENOMEM;
+
+    return moved;
+}
+
+
+void* _memalign_r( struct _reent* r, size_t align, size_t size )
+{
+    heap_lock();
+    void* ptr = TLSF_Memalign( heap, align, size );
+    heap_unlock();
+
+    if( ptr == NULL )
+        errno = ENOMEM;
+
+    return ptr;
+}
+
+
+void* _calloc_r( struct _reent* r, size_t count, size_t size )
+{
+    size_t bytes = count * size;
+    void* ptr;
+
+    if( size && ( ( bytes / size ) != count ) )
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ptr = _malloc_r( r, bytes );
+    if( ptr )
+        memset( ptr, 0, bytes );
+
+    return ptr;
+}
+
+
+size_t _malloc_usable_size_r( struct _reent* r, void* ptr )
+{
+    return TLSF_BlockSize( ptr );
+}
+
+
+void* malloc( size_t size )
+{
+    return _malloc_r( NULL, size );
+}
+
+
+void free( void* ptr )
+{
+    _free_r( NULL, ptr );
+}
+
+
+void* realloc( void* ptr, size_t size )
+{
+    return _realloc_r( NULL, ptr, size );
+}
+
+
+void* memalign( size_t align, size_t size )
+{
+    return _memalign_r( NULL, align, size );
+}
+
+
+void* calloc( size_t count, size_t size )
+{
+    return _calloc_r( NULL, count, size );
+}
+
+
+/* newlib takes these around its own use of the allocator's state. They take the central heap
+   lock, which is recursive, so the allocator can still be called while they're held */
+void __malloc_lock( struct _reent* r )
+{
+    heap_lock();
+}
+
+
+void __malloc_unlock( struct _reent* r )
+{
+    heap_unlock();
+}
@@ -0,0 +1,43 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "tlsf.h"
+
+/** @brief The largest heap to take from the page allocator. The heap never takes more than half
+    of the cached memory */
+#define HEAP_MAX_SIZE       ( 64 * 1024 * 1024 )
+
+/** @brief Allocations up to HEAP_CACHE_MAX_SIZE bytes are served from a per-core cache of
+    blocks in HEAP_CACHE_CLASS_COUNT size classes */
+#define HEAP_CACHE_MAX_SIZE     256
+#define HEAP_CACHE_CLASS_COUNT  8
+
+/** @brief The number of blocks moved between a core's cache and the central heap at a time */
+#define HEAP_CACHE_BATCH        16
+
+/** @brief The most free blocks a core caches in one class before returning a batch */
+#define HEAP_CACHE_LIMIT        ( 4 * HEAP_CACHE_BATCH )
+
+typedef struct {
+    uint32_t hits;          /**< Allocations served straight from the cache */
+    uint32_t refills;       /**< Batches taken from the central heap */
+    uint32_t flushes;       /**< Batches returned to the central heap */
+    uint32_t cached_bytes;  /**< The bytes held free in the cache */
+    } heap_cache_stats_t;
+
+extern int HEAP_Init( void );
+extern void HEAP_GetStats( tlsf_stats_t* stats );
+extern void HEAP_GetCacheStats( int core, heap_cache_stats_t* stats );
+extern void HEAP_Dump( void );
+
+#endif
@@ -13,9 +13,13 @@
 #include <string.h>
 #include <math.h>
 
+#include "pool.h"
 #include "rpi-framebuffer.h"
 #include "image.h"
 #include "image-font.h"
+#include "tile-render.h"
+
+POOL_DEFINE( image_font, image_font_t, 4 )
 
 image_font_t* font_from_image( int width, int height, image_t* image, char unknown )
 {
@@ -25,7 +29,15 @@ image_font_t* font_from_image( int width, int height, image_t* image, char unkno
     if( image == NULL )
         return NULL;
 
-    font = malloc( sizeof( image_font_t ) );
+    font = image_font_pool_alloc();
+    if( font == NULL )
+        return NULL;
+
+    /* Characters the font doesn't have are left at the first character */
+    memset( font->character_offsets, 0, sizeof( font->character_offsets ) );
+    memset( font->glyphs, 0, sizeof( font->glyphs ) );
+    font->glyphs_owned = 0;
+
     font->pixel_width = width;
     font->pixel_height = height;
     font->image = image;
@@ -94,11 +106,149 @@ image_font_t* font_from_image( int width, int height, image_t* image, char unkno
 }
 
 
+/* Forget the glyph sprites, and free them if the font made them. Each of them can be shared by
+   several characters */
+static void font_free_glyphs( image_font_t* font )
+{
+    if( !font->glyphs_owned )
+    {
+        memset( font->glyphs, 0, sizeof( font->glyphs ) );
+        return;
+    }
+
+    for( int c = 0; c < 128; c++ )
+    {
+        const sprite_t* sprite = font->glyphs[c];
+
+        if( sprite == NULL )
+            continue;
+
+        for( int other = c; other < 128; other++ )
+        {
+            if( font->glyphs[other] == sprite )
+                font->glyphs[other] = NULL;
+        }
+
+        SPRITE_Free( (sprite_t*)sprite );
+    }
+
+    font->glyphs_owned = 0;
+}
+
+
+/**
+    @brief Make the pixels of a font that are the key colour transparent, so text no longer
+    covers what's behind it with the background of each character
+    @param key The transparent colour, in the format of the font's image
+    @return 0 on success, -1 if there isn't the memory (the font is left opaque)
+*/
+int font_set_transparent( image_font_t* font, uint32_t key )
+{
+    surface_format_t format = SURFACE_FormatFromDepth( font->image->bytes_per_pixel * 8 );
+
+    font_free_glyphs( font );
+    font->glyphs_owned = 1;
+
+    for( int c = 0; c < 128; c++ )
+    {
+        /* Characters the font doesn't have are all the first character of the image */
+        for( int other = 0; other < c; other++ )
+        {
+            if( font->character_offsets[other] == font->character_offsets[c] )
+            {
+                font->glyphs[c] = font->glyphs[other];
+                break;
+            }
+        }
+
+        if( font->glyphs[c] )
+            continue;
+
+        font->glyphs[c] = SPRITE_Create( &font->image->pixel_data[font->character_offsets[c]],
+                                         font->image->pitch, font->pixel_width, font->pixel_height,
+                                         format, key, SPRITE_COLOUR_KEY );
+
+        if( font->glyphs[c] == NULL )
+        {
+            font_free_glyphs( font );
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+    @brief Use a grid of sprites, cut from the font's image by create-sprite.py --cell, as the
+    font's transparent glyphs
+    @param count The number of cells
+    @param columns The number of cells across the image
+    @return 0 on success, -1 if the cells aren't the size of the font's characters or there aren't
+    enough of them. The font's glyphs are left as they were
+
+    The sprites are only the pixels that are drawn, and they're const, so nothing is created or
+    copied - compare font_set_transparent(). The image is still needed to find each character.
+*/
+int font_set_glyphs( image_font_t* font, const sprite_t* cells, int count, int columns )
+{
+    const int cell_bytes = font->pixel_width * font->image->bytes_per_pixel;
+    const int cell_rows = font->image->pitch * font->pixel_height;
+    const sprite_t* glyphs[128];
+
+    if( ( count <= 0 ) || ( columns <= 0 ) || ( cells[0].width != font->pixel_width ) ||
+        ( cells[0].height != font->pixel_height ) ||
+        ( cells[0].bytes_per_pixel != font->image->bytes_per_pixel ) )
+        return -1;
+
+    for( int c = 0; c < 128; c++ )
+    {
+        int offset = font->character_offsets[c];
+        int index = ( ( offset / cell_rows ) * columns ) +
+                    ( ( offset % font->image->pitch ) / cell_bytes );
+
+        if( index >= count )
+            return -1;
+
+        glyphs[c] = &cells[index];
+    }
+
+    font_free_glyphs( font );
+    memcpy( font->glyphs, glyphs, sizeof( glyphs ) );
+
+    return 0;
+}
+
+
+/**
+    @brief Free a font created by font_from_image. The image belongs to the caller
+*/
+void font_free( image_font_t* font )
+{
+    font_free_glyphs( font );
+    image_font_pool_free( font );
+}
+
+
 void _font_putc( int x, int y, char c, image_font_t* font, effect_info_t* effect )
 {
     int blit_addr = font->character_offsets[(int)c];
+    const sprite_t* sprite = font->glyphs[(int)c & 0x7F];
 
-    if( effect == NULL )
+    if( sprite && ( effect == NULL ) )
+    {
+        /* Only the pixels of the character itself are drawn */
+        SPRITE_Draw( RPI_GetDrawSurface(), x, y, sprite, SPRITE_OPAQUE );
+    }
+    else if( sprite )
+    {
+        for( int px = 0; px < font->pixel_width; px++ )
+        {
+            int py = effect->vertical_blit_y_processor ? effect->vertical_blit_y_processor(x + px, effect) : 0;
+            SPRITE_DrawColumns( RPI_GetDrawSurface(), x, y + py, sprite, px, 1, SPRITE_OPAQUE );
+        }
+    }
+    else if( effect == NULL )
     {
         for( int py = 0; py < font->pixel_height; py++ )
         {
@@ -125,6 +275,13 @@ void font_puts( int x, int y, const char* str, image_font_t* font, effect_info_t
     if( ( str == NULL ) || ( font == NULL ) )
         return;
 
+    /* Record the whole string as one glyph run rather than a blit per row of every character */
+    if( RPI_GetDrawList() )
+    {
+        TILE_GlyphRun( RPI_GetDrawList(), x, y, str, font, effect );
+        return;
+    }
+
     while( *str != '\0' )
     {
         _font_putc( x, y, *str, font, effect );
@@ -13,6 +13,7 @@
 
 #include "effects.h"
 #include "image.h"
+#include "sprite.h"
 
 /** @brief Define an image based font */
 typedef struct {
@@ -32,6 +33,14 @@ typedef struct {
     /** @brief The image data for the font */
     image_t* image;
 
+    /** @brief A sprite for each character when the font is transparent, see
+        font_set_transparent() and font_set_glyphs(). Characters that share an image share a
+        sprite */
+    const sprite_t* glyphs[128];
+
+    /** @brief The glyphs were created by font_set_transparent(), and are freed with the font */
+    int glyphs_owned;
+
     } image_font_t;
 
 /**
@@ -40,6 +49,9 @@ typedef struct {
 
 extern int sinewave_process(int x, int y, int index, int amplitude );
 extern image_font_t* font_from_image( int width, int height, image_t* image, char unknown );
+extern void font_free( image_font_t* font );
+extern int font_set_transparent( image_font_t* font, uint32_t key );
+extern int font_set_glyphs( image_font_t* font, const sprite_t* cells, int count, int columns );
 extern void font_puts( int x, int y, const char* str, image_font_t* font, effect_info_t* effect );
 
 #endif
@@ -14,6 +14,7 @@
 
 #include "gimp-image.h"
 #include "image.h"
+#include "pool.h"
 
 #define LE32(x) ( (x)[0] | ( (x)[1] << 8 ) | ( (x)[2] << 16 ) | ( (x)[3] << 24 ) )
 #define BE32(x) ( (x)[3] | ( (x)[2] << 8 ) | ( (x)[1] << 16 ) | ( (x)[0] << 24 ) )
@@ -23,6 +24,8 @@
 
 #define BGR0(x) ( ( (x)[0] << 16 ) | ( (x)[1] << 8 ) | ( (x)[2] ) | ( 0xA0 << 24 ) )
 
+POOL_DEFINE( image, image_t, 16 )
+
 image_t* image8_from_bitmap( const uint8_t* bitmap )
 {
     image_t* result;
@@ -58,7 +61,12 @@ image_t* image8_from_bitmap( const uint8_t* bitmap )
     }
 
     /* The total bitmap data size */
-    result = malloc( sizeof( image_t ) );
+    result = image_pool_alloc();
+    if( result == NULL )
+        return NULL;
+
+    result->pixel_data = NULL;
+    result->owned = 1;
 
     /* Get the image size */
     result->width = LE32( &bitmap[18] );
@@ -73,6 +81,7 @@ image_t* image8_from_bitmap( const uint8_t* bitmap )
     if( LE32( &bitmap[30] ) != 0 )
     {
         printf( "Unsupported compression of BMP image!\r\n" );
+        image_free( result );
         return NULL;
     }
 
@@ -88,6 +97,7 @@ image_t* image8_from_bitmap( const uint8_t* bitmap )
     if( ( palette_size == 0 ) || ( bpp != 4 ) )
     {
         printf( "No palette in image, or unsupported bpp in image!\r\n" );
+        image_free( result );
         return NULL;
     }
 
@@ -128,28 +138,51 @@ image_t* image8_from_bitmap( const uint8_t* bitmap )
     else
     {
         printf( "Unsupported bitmap input format!\r\n" );
+        image_free( result );
     }
 
     return NULL;
 }
 
+/**
+    @brief Make an image of a GIMP C-source dump. The pixels are used where they are, so the dump
+    has to stay around as long as the image
+*/
 image_t* image16_from_gimp( gimp_image_t* gimage )
 {
     image_t* result;
 
-    /* We only support data copy at the moment! */
     if( gimage->bytes_per_pixel != 2 )
         return NULL;
 
-    result = malloc( sizeof( image_t ) );
+    result = image_pool_alloc();
+    if( result == NULL )
+        return NULL;
+
     result->width = gimage->width;
     result->height = gimage->height;
     result->bytes_per_pixel = 2;
     result->pitch = result->bytes_per_pixel * result->width;
     result->palette = NULL;
-    result->pixel_data = malloc( result->width * result->height * result->bytes_per_pixel );
-
-    memcpy( result->pixel_data, gimage->pixel_data, result->width * result->height * result->bytes_per_pixel );
+    result->pixel_data = gimage->pixel_data;
+    result->owned = 0;
 
     return result;
 }
+
+
+/**
+    @brief Free an image and its palette, and its pixel data if it isn't borrowed
+*/
+void image_free( image_t* image )
+{
+    if( image == NULL )
+        return;
+
+    free( image->palette );
+
+    if( image->owned )
+        free( image->pixel_data );
+
+    image_pool_free( image );
+}
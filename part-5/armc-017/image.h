@@ -24,9 +24,11 @@ typedef struct {
     palette_entry_t* palette;   /**< Only valid for bytes_per_pixel < 2 */
     uint8_t* pixel_data;
     uint32_t pitch;             /**< The pitch (in bytes) per scan line of the image */
+    int owned;                  /**< pixel_data was allocated for the image, rather than borrowed */
     } image_t;
 
 extern image_t* image8_from_bitmap( const uint8_t* bitmap );
 extern image_t* image16_from_gimp( gimp_image_t* gimage );
+extern void image_free( image_t* image );
 
 #endif
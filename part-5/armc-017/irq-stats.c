@@ -0,0 +1,162 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* Per-source interrupt statistics. The IRQ handler times each source it services with the PMU
+   cycle counter and, for sources where we know when the interrupt was raised (the system timer
+   compare), the entry latency. Each core keeps its own statistics so no locking is needed in the
+   handler. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "irq-stats.h"
+#include "rpi-interrupts.h"
+#include "rpi-local-intc.h"
+#include "rpi-smp.h"
+
+typedef struct {
+    irqstat_t sources[IRQSTAT_SOURCE_COUNT];
+    uint32_t last_dump_count[IRQSTAT_SOURCE_COUNT];
+    } irqstat_core_t;
+
+static irqstat_core_t irq_stats[RPI_CORE_COUNT] __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
+
+static const char* source_names[IRQSTAT_SOURCE_COUNT] = {
+    "ARM Timer",
+    "System Timer",
+    "Local Timer",
+    "Core Message",
+    "DMA",
+    "Unhandled",
+    };
+
+
+/**
+    @brief Record the handling of an interrupt source. Called from the IRQ handler
+    @param source The interrupt source that was serviced
+    @param start_cycles The value returned by IRQSTAT_Start() before the source was serviced
+    @param latency_us The entry latency, or -1 if it's not known for this source
+*/
+void IRQSTAT_Record( irqstat_source_t source, uint32_t start_cycles, int32_t latency_us )
+{
+    irqstat_t* stat = &irq_stats[RPI_GetCoreId()].sources[source];
+    uint32_t cycles = RPI_PmuGetCycles() - start_cycles;
+    int bucket = 0;
+
+    stat->count++;
+    stat->total_cycles += cycles;
+    if( cycles > stat->max_cycles )
+        stat->max_cycles = cycles;
+
+    if( cycles >> IRQSTAT_CYCLE_BUCKET_SHIFT )
+        bucket = 31 - __builtin_clz( cycles >> IRQSTAT_CYCLE_BUCKET_SHIFT );
+    if( bucket >= IRQSTAT_CYCLE_BUCKETS )
+        bucket = IRQSTAT_CYCLE_BUCKETS - 1;
+    stat->cycle_histogram[bucket]++;
+
+    if( latency_us >= 0 )
+    {
+        stat->latency_count++;
+        stat->total_latency_us += latency_us;
+        if( (uint32_t)latency_us > stat->max_latency_us )
+            stat->max_latency_us = latency_us;
+
+        if( latency_us >= IRQSTAT_LATENCY_BUCKETS )
+            latency_us = IRQSTAT_LATENCY_BUCKETS - 1;
+        stat->latency_histogram[latency_us]++;
+    }
+}
+
+
+/**
+    @brief Take a consistent copy of the statistics for a source
+*/
+void IRQSTAT_Get( int core, irqstat_source_t source, irqstat_t* stat )
+{
+    uint32_t cpsr;
+
+    if( ( core < 0 ) || ( core >= RPI_CORE_COUNT ) || ( source >= IRQSTAT_SOURCE_COUNT ) )
+    {
+        memset( stat, 0, sizeof( irqstat_t ) );
+        return;
+    }
+
+    /* Masking our own interrupts makes the copy consistent for the calling core. Another core's
+       statistics may still be updated part way through the copy */
+    cpsr = RPI_IrqSaveDisable();
+    *stat = irq_stats[core].sources[source];
+    RPI_IrqRestore( cpsr );
+}
+
+
+/**
+    @brief Reset the statistics of the calling core
+*/
+void IRQSTAT_Reset( void )
+{
+    uint32_t cpsr = RPI_IrqSaveDisable();
+    memset( &irq_stats[RPI_GetCoreId()], 0, sizeof( irqstat_core_t ) );
+    RPI_IrqRestore( cpsr );
+}
+
+
+/**
+    @brief Print the statistics of every core and source that has seen an interrupt to stdout
+
+    The number of interrupts since the last dump is included so that an interrupt storm stands out
+*/
+void IRQSTAT_Dump( void )
+{
+    irqstat_t stat;
+
+    printf( "IRQ Stats: core source          count    +delta   avg cyc   max cyc  avg lat  max lat\r\n" );
+
+    for( int core = 0; core < RPI_CORE_COUNT; core++ )
+    {
+        for( int source = 0; source < IRQSTAT_SOURCE_COUNT; source++ )
+        {
+            IRQSTAT_Get( core, source, &stat );
+
+            if( stat.count == 0 )
+                continue;
+
+            printf( "IRQ Stats: %4d %-12s %10u %9u %9u %9u",
+                    core, source_names[source],
+                    (unsigned int)stat.count,
+                    (unsigned int)( stat.count - irq_stats[core].last_dump_count[source] ),
+                    (unsigned int)( stat.total_cycles / stat.count ),
+                    (unsigned int)stat.max_cycles );
+
+            if( stat.latency_count )
+            {
+                printf( " %6uus %6uus",
+                        (unsigned int)( stat.total_latency_us / stat.latency_count ),
+                        (unsigned int)stat.max_latency_us );
+            }
+
+            printf( "\r\n" );
+            irq_stats[core].last_dump_count[source] = stat.count;
+
+            printf( "IRQ Stats:      cycles (2^%d..):", IRQSTAT_CYCLE_BUCKET_SHIFT );
+            for( int b = 0; b < IRQSTAT_CYCLE_BUCKETS; b++ )
+                printf( " %u", (unsigned int)stat.cycle_histogram[b] );
+            printf( "\r\n" );
+
+            if( stat.latency_count )
+            {
+                printf( "IRQ Stats:      latency (us):" );
+                for( int b = 0; b < IRQSTAT_LATENCY_BUCKETS; b++ )
+                    printf( " %u", (unsigned int)stat.latency_histogram[b] );
+                printf( "\r\n" );
+            }
+        }
+    }
+}
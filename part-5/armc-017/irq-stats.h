@@ -0,0 +1,63 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef IRQ_STATS_H
+#define IRQ_STATS_H
+
+#include <stdint.h>
+
+#include "rpi-pmu.h"
+
+/** @brief Handler cycle histogram buckets. Bucket n counts handlers that took between
+    2^(n + IRQSTAT_CYCLE_BUCKET_SHIFT) and 2^(n + IRQSTAT_CYCLE_BUCKET_SHIFT + 1) cycles, the first
+    and last buckets also count everything below and above them */
+#define IRQSTAT_CYCLE_BUCKETS       16
+#define IRQSTAT_CYCLE_BUCKET_SHIFT  6
+
+/** @brief Entry latency histogram buckets, one per microsecond. The last bucket counts everything
+    at or above it */
+#define IRQSTAT_LATENCY_BUCKETS     16
+
+/** @brief The interrupt sources we keep statistics for */
+typedef enum {
+    IRQSTAT_ARM_TIMER = 0,
+    IRQSTAT_SYSTEM_TIMER,
+    IRQSTAT_LOCAL_TIMER,
+    IRQSTAT_CORE_MESSAGE,
+    IRQSTAT_DMA,
+    IRQSTAT_UNHANDLED,
+    IRQSTAT_SOURCE_COUNT,
+    } irqstat_source_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t total_cycles;
+    uint32_t max_cycles;
+    uint32_t latency_count;     /**< Only sources with a known trigger time measure latency */
+    uint64_t total_latency_us;
+    uint32_t max_latency_us;
+    uint32_t cycle_histogram[IRQSTAT_CYCLE_BUCKETS];
+    uint32_t latency_histogram[IRQSTAT_LATENCY_BUCKETS];
+    } irqstat_t;
+
+/**
+    @brief Take the cycle count at the start of handling an interrupt source
+*/
+static inline uint32_t IRQSTAT_Start( void )
+{
+    return RPI_PmuGetCycles();
+}
+
+extern void IRQSTAT_Record( irqstat_source_t source, uint32_t start_cycles, int32_t latency_us );
+extern void IRQSTAT_Get( int core, irqstat_source_t source, irqstat_t* stat );
+extern void IRQSTAT_Reset( void );
+extern void IRQSTAT_Dump( void );
+
+#endif
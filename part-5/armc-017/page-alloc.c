@@ -0,0 +1,375 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A binary buddy page allocator for the memory after the kernel image. It owns all of the ARM's
+   memory; the heap (see heap.c) is one large block taken from it at start-up.
+
+   The memory is split into two zones. The cached zone is normal write-back cached memory. The
+   coherent zone is the top PAGE_COHERENT_SIZE bytes of the ARM's memory which the MMU maps
+   uncached, so buffers from it can be shared with the VideoCore and the DMA engines without any
+   cache maintenance.
+
+   Each zone keeps a byte of state per page at the start of its memory. The first page of a block
+   records the block's order and whether it is free, every other page of a block is a tail page.
+   Free blocks are kept on a doubly linked list per order, the links living in the free pages
+   themselves. The buddy of a block is found by flipping the bit of its page index that
+   corresponds to its size, so the page indices are counted from a base address aligned to the
+   largest block size. Pages between that base and the zone's start are marked reserved so they
+   are never merged with.
+
+   Any core can allocate and free pages, so each zone has a spinlock. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "page-alloc.h"
+#include "rpi-mailbox-interface.h"
+#include "rpi-mmu.h"
+#include "rpi-spinlock.h"
+
+#define PAGE_STATE_FREE         0x80
+#define PAGE_STATE_TAIL         0x40
+#define PAGE_STATE_RESERVED     0xFF
+
+#define PAGE_BLOCK_SIZE( order )    ( (uint32_t)PAGE_SIZE << ( order ) )
+
+typedef struct page_block_t page_block_t;
+
+struct page_block_t {
+    page_block_t* next;
+    page_block_t* prev;
+    };
+
+typedef struct {
+    uint32_t base;
+    uint8_t* state;
+    page_block_t* free_lists[PAGE_ORDER_COUNT];
+    page_stats_t stats;
+    rpi_spinlock_t lock;
+    } zone_t;
+
+static zone_t zones[PAGE_ZONE_COUNT];
+
+
+static inline uint32_t page_index( zone_t* zone, uint32_t address )
+{
+    return ( address - zone->base ) >> PAGE_SHIFT;
+}
+
+
+static void free_list_insert( zone_t* zone, uint32_t address, int order )
+{
+    page_block_t* block = (page_block_t*)address;
+
+    block->prev = NULL;
+    block->next = zone->free_lists[order];
+
+    if( block->next )
+        block->next->prev = block;
+
+    zone->free_lists[order] = block;
+    zone->state[page_index( zone, address )] = PAGE_STATE_FREE | order;
+    zone->stats.free_blocks[order]++;
+}
+
+
+static void free_list_remove( zone_t* zone, uint32_t address, int order )
+{
+    page_block_t* block = (page_block_t*)address;
+
+    if( block->prev )
+        block->prev->next = block->next;
+    else
+        zone->free_lists[order] = block->next;
+
+    if( block->next )
+        block->next->prev = block->prev;
+
+    zone->stats.free_blocks[order]--;
+}
+
+
+/**
+    @brief Hand the page aligned range [start, end) to a zone
+*/
+static void zone_init( zone_t* zone, uint32_t start, uint32_t end )
+{
+    uint32_t state_bytes;
+    uint32_t address;
+    uint32_t page;
+
+    zone->base = start & ~( PAGE_BLOCK_SIZE( PAGE_MAX_ORDER ) - 1 );
+    zone->state = (uint8_t*)start;
+
+    /* The state array lives in the zone's first pages */
+    state_bytes = ( page_index( zone, end ) + PAGE_SIZE - 1 ) & ~( PAGE_SIZE - 1 );
+    start += state_bytes;
+
+    if( start >= end )
+    {
+        zone->stats.start = zone->stats.end = end;
+        return;
+    }
+
+    zone->stats.start = start;
+    zone->stats.end = end;
+    zone->stats.total_pages = ( end - start ) >> PAGE_SHIFT;
+    zone->stats.free_pages = zone->stats.total_pages;
+
+    for( page = 0; page < page_index( zone, start ); page++ )
+        zone->state[page] = PAGE_STATE_RESERVED;
+
+    memset( &zone->state[page], PAGE_STATE_TAIL, page_index( zone, end ) - page );
+
+    /* Free the range as the largest naturally aligned blocks that fit */
+    for( address = start; address < end; )
+    {
+        int order = PAGE_MAX_ORDER;
+
+        while( ( order > 0 ) &&
+               ( ( ( address - zone->base ) & ( PAGE_BLOCK_SIZE( order ) - 1 ) ) ||
+                 ( ( end - address ) < PAGE_BLOCK_SIZE( order ) ) ) )
+            order--;
+
+        free_list_insert( zone, address, order );
+        address += PAGE_BLOCK_SIZE( order );
+    }
+}
+
+
+static zone_t* zone_from_address( uint32_t address )
+{
+    for( int z = 0; z < PAGE_ZONE_COUNT; z++ )
+    {
+        if( ( address >= zones[z].stats.start ) && ( address < zones[z].stats.end ) )
+            return &zones[z];
+    }
+
+    return NULL;
+}
+
+
+/**
+    @brief Find out how much memory the ARM has, map it with the MMU and hand everything after the
+    kernel image to the page allocator. Called from _cstartup before anything allocates
+*/
+void PAGE_Init( void )
+{
+    extern char _end;
+    rpi_mailbox_property_t* mp;
+    uint32_t start = ( (uint32_t)&_end + PAGE_SIZE - 1 ) & ~( PAGE_SIZE - 1 );
+    uint32_t end = start + PAGE_DEFAULT_MEMORY_SIZE;
+    uint32_t coherent;
+
+    RPI_PropertyInit();
+    RPI_PropertyAddTag( TAG_GET_ARM_MEMORY );
+    RPI_PropertyProcess();
+
+    if( ( mp = RPI_PropertyGet( TAG_GET_ARM_MEMORY ) ) )
+    {
+        /* The base address and size of the ARM's memory */
+        uint32_t arm_end = (uint32_t)mp->data.buffer_32[0] + (uint32_t)mp->data.buffer_32[1];
+
+        if( arm_end > start )
+            end = arm_end & ~( PAGE_SIZE - 1 );
+    }
+
+    /* The coherent zone is the top of memory, in whole MMU sections */
+    coherent = ( end - PAGE_COHERENT_SIZE ) & ~( RPI_MMU_SECTION_SIZE - 1 );
+
+    if( coherent < start )
+        coherent = end;
+
+    RPI_MmuInit( end, coherent, end );
+
+    zone_init( &zones[PAGE_ZONE_CACHED], start, coherent );
+    zone_init( &zones[PAGE_ZONE_COHERENT], coherent, end );
+}
+
+
+/**
+    @brief Get the smallest order of block that holds bytes
+    @return The order, or -1 if bytes is more than the largest block
+*/
+int PAGE_Order( uint32_t bytes )
+{
+    int order = 0;
+
+    while( PAGE_BLOCK_SIZE( order ) < bytes )
+    {
+        if( ++order > PAGE_MAX_ORDER )
+            return -1;
+    }
+
+    return order;
+}
+
+
+/**
+    @brief Allocate 2^order pages from a zone
+    @return The first page of the block (aligned to the size of the block) or NULL
+*/
+void* PAGE_Alloc( page_zone_t zone, int order )
+{
+    zone_t* z;
+    uint32_t address;
+    int o;
+
+    if( ( zone >= PAGE_ZONE_COUNT ) || ( order < 0 ) || ( order > PAGE_MAX_ORDER ) )
+        return NULL;
+
+    z = &zones[zone];
+
+    uint32_t cpsr = RPI_SpinLockIrqSave( &z->lock );
+
+    for( o = order; ( o <= PAGE_MAX_ORDER ) && ( z->free_lists[o] == NULL ); o++ )
+    {
+        /* Find the smallest free block that's big enough */
+    }
+
+    if( o > PAGE_MAX_ORDER )
+    {
+        z->stats.failures++;
+        RPI_SpinUnlockIrqRestore( &z->lock, cpsr );
+        return NULL;
+    }
+
+    address = (uint32_t)z->free_lists[o];
+    free_list_remove( z, address, o );
+
+    /* Split it down to size, freeing the upper halves */
+    while( o > order )
+    {
+        o--;
+        free_list_insert( z, address + PAGE_BLOCK_SIZE( o ), o );
+    }
+
+    z->state[page_index( z, address )] = order;
+    z->stats.free_pages -= 1 << order;
+    z->stats.allocations++;
+
+    RPI_SpinUnlockIrqRestore( &z->lock, cpsr );
+
+    return (void*)address;
+}
+
+
+/**
+    @brief Allocate a buffer that can be shared with the VideoCore or the DMA engines without any
+    cache maintenance. Use RPI_PhysToBus() to get the address to give them
+*/
+void* PAGE_AllocCoherent( uint32_t bytes )
+{
+    return PAGE_Alloc( PAGE_ZONE_COHERENT, PAGE_Order( bytes ) );
+}
+
+
+/**
+    @brief Return a block from PAGE_Alloc() or PAGE_AllocCoherent(), merging it with its free
+    buddies
+*/
+void PAGE_Free( void* pages )
+{
+    uint32_t address = (uint32_t)pages;
+    zone_t* z = zone_from_address( address );
+    uint8_t state;
+    int order;
+
+    if( ( z == NULL ) || ( address & ( PAGE_SIZE - 1 ) ) )
+        return;
+
+    uint32_t cpsr = RPI_SpinLockIrqSave( &z->lock );
+
+    state = z->state[page_index( z, address )];
+
+    /* Not the start of an allocated block */
+    if( state & ( PAGE_STATE_FREE | PAGE_STATE_TAIL ) )
+    {
+        RPI_SpinUnlockIrqRestore( &z->lock, cpsr );
+        return;
+    }
+
+    order = state;
+    z->stats.free_pages += 1 << order;
+    z->stats.frees++;
+
+    while( order < PAGE_MAX_ORDER )
+    {
+        uint32_t buddy = z->base + ( ( address - z->base ) ^ PAGE_BLOCK_SIZE( order ) );
+
+        if( ( buddy >= z->stats.end ) || ( z->state[page_index( z, buddy )] != ( PAGE_STATE_FREE | order ) ) )
+            break;
+
+        free_list_remove( z, buddy, order );
+
+        /* The upper of the two becomes a tail page of the merged block */
+        if( buddy < address )
+        {
+            z->state[page_index( z, address )] = PAGE_STATE_TAIL;
+            address = buddy;
+        }
+        else
+        {
+            z->state[page_index( z, buddy )] = PAGE_STATE_TAIL;
+        }
+
+        order++;
+    }
+
+    free_list_insert( z, address, order );
+
+    RPI_SpinUnlockIrqRestore( &z->lock, cpsr );
+}
+
+
+void PAGE_GetStats( page_zone_t zone, page_stats_t* stats )
+{
+    if( zone >= PAGE_ZONE_COUNT )
+        return;
+
+    uint32_t cpsr = RPI_SpinLockIrqSave( &zones[zone].lock );
+    *stats = zones[zone].stats;
+    RPI_SpinUnlockIrqRestore( &zones[zone].lock, cpsr );
+}
+
+
+/**
+    @brief Print the free memory in each zone and the largest block that can be allocated
+*/
+void PAGE_Dump( void )
+{
+    static const char* names[PAGE_ZONE_COUNT] = { "cached", "coherent" };
+    page_stats_t stats;
+
+    for( int z = 0; z < PAGE_ZONE_COUNT; z++ )
+    {
+        int largest = -1;
+
+        PAGE_GetStats( z, &stats );
+
+        for( int order = 0; order < PAGE_ORDER_COUNT; order++ )
+        {
+            if( stats.free_blocks[order] )
+                largest = order;
+        }
+
+        printf( "Pages (%s): 0x%8.8X-0x%8.8X %uKiB free of %uKiB, largest block %uKiB, %u allocations %u frees %u failures\r\n",
+                names[z],
+                (unsigned int)stats.start,
+                (unsigned int)stats.end,
+                (unsigned int)( stats.free_pages << ( PAGE_SHIFT - 10 ) ),
+                (unsigned int)( stats.total_pages << ( PAGE_SHIFT - 10 ) ),
+                ( largest < 0 ) ? 0 : (unsigned int)( PAGE_BLOCK_SIZE( largest ) >> 10 ),
+                (unsigned int)stats.allocations,
+                (unsigned int)stats.frees,
+                (unsigned int)stats.failures );
+    }
+}
@@ -0,0 +1,59 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef PAGE_ALLOC_H
+#define PAGE_ALLOC_H
+
+#include <stdint.h>
+
+/** @brief The allocation granule. Every allocation is a power of two number of pages and is
+    aligned to its own size */
+#define PAGE_SHIFT                  12
+#define PAGE_SIZE                   ( 1 << PAGE_SHIFT )
+
+/** @brief The largest block is 2^PAGE_MAX_ORDER pages (64MiB) */
+#define PAGE_MAX_ORDER              14
+#define PAGE_ORDER_COUNT            ( PAGE_MAX_ORDER + 1 )
+
+/** @brief The amount of memory at the top of the ARM's memory that is mapped uncached for
+    coherent buffers. Must be a multiple of the 1MiB MMU section size */
+#define PAGE_COHERENT_SIZE          ( 4 * 1024 * 1024 )
+
+/** @brief The amount of memory after the kernel image to use if the firmware can't tell us how
+    much ARM memory there is */
+#define PAGE_DEFAULT_MEMORY_SIZE    ( 32 * 1024 * 1024 )
+
+typedef enum {
+    PAGE_ZONE_CACHED = 0,       /**< Normal cached memory, shared with the VideoCore and DMA by
+                                     using the RPI_Cache* maintenance functions */
+    PAGE_ZONE_COHERENT,         /**< Uncached memory that needs no cache maintenance */
+    PAGE_ZONE_COUNT
+    } page_zone_t;
+
+typedef struct {
+    uint32_t start;             /**< The first page handed out by the zone */
+    uint32_t end;
+    uint32_t total_pages;
+    uint32_t free_pages;
+    uint32_t free_blocks[PAGE_ORDER_COUNT];
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;
+    } page_stats_t;
+
+extern void PAGE_Init( void );
+extern int PAGE_Order( uint32_t bytes );
+extern void* PAGE_Alloc( page_zone_t zone, int order );
+extern void* PAGE_AllocCoherent( uint32_t bytes );
+extern void PAGE_Free( void* pages );
+extern void PAGE_GetStats( page_zone_t zone, page_stats_t* stats );
+extern void PAGE_Dump( void );
+
+#endif
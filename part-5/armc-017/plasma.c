@@ -0,0 +1,66 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* The old-school 8bpp plasma. The plasma is drawn once as a field of palette indices and its
+   palette is a smooth loop of colours, so cycling the palette (see FX_NewPaletteCycle()) makes it
+   flow without drawing it again */
+
+#include <math.h>
+#include <stdint.h>
+
+#include "plasma.h"
+#include "rpi-framebuffer.h"
+
+/**
+    @brief Draw the plasma into an 8bpp surface
+*/
+void PLASMA_Draw( surface_t* surface )
+{
+    if( surface->format != SURFACE_FORMAT_PAL8 )
+        return;
+
+    for( int y = 0; y < surface->height; y++ )
+    {
+        uint8_t* row = SURFACE_PixelAddress( surface, 0, y );
+        float fy = (float)y / surface->height;
+
+        for( int x = 0; x < surface->width; x++ )
+        {
+            float fx = (float)x / surface->width;
+            float v = sinf( fx * 10.0f ) +
+                      sinf( ( fy * 8.0f ) + ( fx * 3.0f ) ) +
+                      sinf( sqrtf( ( ( fx - 0.5f ) * ( fx - 0.5f ) ) + ( ( fy - 0.5f ) * ( fy - 0.5f ) ) ) * 20.0f );
+
+            /* v is -3 to 3 */
+            row[x] = (uint8_t)( ( ( v + 3.0f ) / 6.0f ) * ( PLASMA_COLOURS - 1 ) );
+        }
+    }
+}
+
+
+/**
+    @brief Set the plasma's palette entries, a loop of colours that can be cycled seamlessly
+*/
+void PLASMA_SetPalette( void )
+{
+    palette_entry_t entries[PLASMA_COLOURS];
+
+    for( int i = 0; i < PLASMA_COLOURS; i++ )
+    {
+        float a = ( 2.0f * (float)M_PI * i ) / PLASMA_COLOURS;
+        int r = 128 + (int)( 127.0f * sinf( a ) );
+        int g = 128 + (int)( 127.0f * sinf( a + ( 2.0f * (float)M_PI / 3.0f ) ) );
+        int b = 128 + (int)( 127.0f * sinf( a + ( 4.0f * (float)M_PI / 3.0f ) ) );
+
+        entries[i] = RPI_PALETTE_RGB( r, g, b );
+    }
+
+    RPI_SetPalette( 0, PLASMA_COLOURS, entries );
+}
@@ -0,0 +1,23 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef PLASMA_H
+#define PLASMA_H
+
+#include "surface.h"
+
+/** @brief The plasma uses palette entries 0 to PLASMA_COLOURS - 1, the rest are free for other
+    things (like the starfield) */
+#define PLASMA_COLOURS      192
+
+extern void PLASMA_Draw( surface_t* surface );
+extern void PLASMA_SetPalette( void );
+
+#endif
@@ -0,0 +1,195 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A slab allocator for fixed size objects. Each pool hands out objects of one size from slabs
+   that are allocated from the heap, cache line aligned, as the pool grows. Freed objects go on a
+   free list and are handed out again first, so allocating and freeing are both O(1). A new slab
+   isn't split up into a free list when it's allocated, objects are carved off it as they're
+   needed so that growing the pool is O(1) too.
+
+   Like the heap, the pools are made safe against the scheduler and interrupt handlers by masking
+   IRQs for the few instructions each operation takes, and against the other cores by a spinlock
+   per pool. */
+
+#include <malloc.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "rpi-base.h"
+#include "rpi-spinlock.h"
+
+/* The start of each slab holds the link to the next slab. It's a whole cache line so that the
+   objects are cache line aligned */
+#define SLAB_HEADER_SIZE    RPI_CACHE_LINE_SIZE
+
+static pool_t* pools = NULL;
+static rpi_spinlock_t pools_lock = RPI_SPINLOCK_INIT;
+
+
+/* Add a new slab to the pool. Called with the pool locked */
+static int pool_grow( pool_t* pool )
+{
+    uint32_t size = SLAB_HEADER_SIZE + ( pool->object_size * pool->objects_per_slab );
+    uint8_t* slab;
+
+    size = ( size + ( RPI_CACHE_LINE_SIZE - 1 ) ) & ~( RPI_CACHE_LINE_SIZE - 1 );
+    slab = memalign( RPI_CACHE_LINE_SIZE, size );
+
+    if( slab == NULL )
+        return -1;
+
+    if( pool->slabs == NULL )
+    {
+        RPI_SpinLock( &pools_lock );
+        pool->next = pools;
+        pools = pool;
+        RPI_SpinUnlock( &pools_lock );
+
+        pool->stats.object_size = pool->object_size;
+    }
+
+    *(void**)slab = pool->slabs;
+    pool->slabs = slab;
+
+    /* Only POOL_Reserve() grows the pool while there are still objects left to carve from the
+       newest slab. Put them on the free list so that they're not lost */
+    while( pool->carve_remaining )
+    {
+        *(void**)pool->carve = pool->free_list;
+        pool->free_list = pool->carve;
+        pool->carve += pool->object_size;
+        pool->carve_remaining--;
+    }
+
+    pool->carve = slab + SLAB_HEADER_SIZE;
+    pool->carve_remaining = pool->objects_per_slab;
+
+    pool->stats.slabs++;
+    pool->stats.capacity += pool->objects_per_slab;
+
+    return 0;
+}
+
+
+/**
+    @brief Allocate an object from the pool
+    @return The object, or NULL if the pool needed another slab and there isn't enough memory
+*/
+void* POOL_Alloc( pool_t* pool )
+{
+    uint32_t cpsr = RPI_SpinLockIrqSave( &pool->lock );
+    void* object = pool->free_list;
+
+    if( object )
+    {
+        pool->free_list = *(void**)object;
+    }
+    else if( pool->carve_remaining || ( pool_grow( pool ) == 0 ) )
+    {
+        object = pool->carve;
+        pool->carve += pool->object_size;
+        pool->carve_remaining--;
+    }
+
+    if( object )
+    {
+        pool->stats.allocations++;
+        pool->stats.in_use++;
+
+        if( pool->stats.in_use > pool->stats.peak )
+            pool->stats.peak = pool->stats.in_use;
+    }
+    else
+    {
+        pool->stats.failures++;
+    }
+
+    RPI_SpinUnlockIrqRestore( &pool->lock, cpsr );
+
+    return object;
+}
+
+
+/**
+    @brief Return an object to the pool it was allocated from
+*/
+void POOL_Free( pool_t* pool, void* object )
+{
+    uint32_t cpsr;
+
+    if( object == NULL )
+        return;
+
+    cpsr = RPI_SpinLockIrqSave( &pool->lock );
+
+    *(void**)object = pool->free_list;
+    pool->free_list = object;
+
+    pool->stats.frees++;
+    pool->stats.in_use--;
+
+    RPI_SpinUnlockIrqRestore( &pool->lock, cpsr );
+}
+
+
+/**
+    @brief Make sure the pool can hold at least objects without having to grow
+    @return 0 on success, -1 if there isn't enough memory
+*/
+int POOL_Reserve( pool_t* pool, uint32_t objects )
+{
+    int result = 0;
+    uint32_t cpsr = RPI_SpinLockIrqSave( &pool->lock );
+
+    while( ( result == 0 ) && ( pool->stats.capacity < objects ) )
+        result = pool_grow( pool );
+
+    RPI_SpinUnlockIrqRestore( &pool->lock, cpsr );
+
+    return result;
+}
+
+
+void POOL_GetStats( pool_t* pool, pool_stats_t* stats )
+{
+    uint32_t cpsr = RPI_SpinLockIrqSave( &pool->lock );
+    *stats = pool->stats;
+    RPI_SpinUnlockIrqRestore( &pool->lock, cpsr );
+}
+
+
+/**
+    @brief Print the statistics of every pool that's in use to stdout
+*/
+void POOL_Dump( void )
+{
+    printf( "Pool             Size   Slabs  In use/Capacity       Peak     Allocs      Frees   Fail\r\n" );
+
+    for( pool_t* pool = pools; pool; pool = pool->next )
+    {
+        pool_stats_t stats;
+
+        POOL_GetStats( pool, &stats );
+
+        printf( "%-16s %4u %7u %7u/%-8u %10u %10u %10u %6u\r\n",
+                pool->name,
+                (unsigned int)stats.object_size,
+                (unsigned int)stats.slabs,
+                (unsigned int)stats.in_use,
+                (unsigned int)stats.capacity,
+                (unsigned int)stats.peak,
+                (unsigned int)stats.allocations,
+                (unsigned int)stats.frees,
+                (unsigned int)stats.failures );
+    }
+}
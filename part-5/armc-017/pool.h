@@ -0,0 +1,82 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+#include "rpi-spinlock.h"
+
+/** @brief Objects are a multiple of, and aligned to, POOL_ALIGN bytes */
+#define POOL_ALIGN          8
+
+/** @brief The size of the objects of type in a pool */
+#define POOL_OBJECT_SIZE( type )    ( ( sizeof( type ) + ( POOL_ALIGN - 1 ) ) & ~( POOL_ALIGN - 1 ) )
+
+/** @brief Statistics for a single pool */
+typedef struct {
+    uint32_t object_size;
+    uint32_t slabs;
+    uint32_t capacity;          /**< The number of objects the slabs can hold */
+    uint32_t in_use;
+    uint32_t peak;
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;          /**< Allocations that failed because a new slab couldn't be allocated */
+    } pool_stats_t;
+
+typedef struct pool_t pool_t;
+
+struct pool_t {
+    const char* name;
+    uint32_t object_size;
+    uint32_t objects_per_slab;
+
+    /** Objects that have been freed, linked through their first word */
+    void* free_list;
+
+    /** The objects of the newest slab that have never been handed out */
+    uint8_t* carve;
+    uint32_t carve_remaining;
+
+    /** The slabs, linked through their first word */
+    void* slabs;
+
+    /** The next pool in the list of every pool that has a slab */
+    pool_t* next;
+
+    pool_stats_t stats;
+    rpi_spinlock_t lock;
+    };
+
+/**
+    @brief Define a pool of objects of type in a C file, along with type-safe functions to use it:
+
+    type* name_pool_alloc( void )
+    void name_pool_free( type* object )
+
+    The object size is fixed at compile time. Slabs of objects_per_slab objects are allocated from
+    the heap as the pool grows and are never given back, so objects can be created and destroyed
+    at any rate without fragmenting the heap. Any core can use the pool
+*/
+#define POOL_DEFINE( name, type, objects_per_slab ) \
+    static pool_t name##_pool = { #name, POOL_OBJECT_SIZE( type ), ( objects_per_slab ), \
+                                  .lock = RPI_SPINLOCK_INIT }; \
+    static inline type* name##_pool_alloc( void ) { return (type*)POOL_Alloc( &name##_pool ); } \
+    static inline void name##_pool_free( type* object ) { POOL_Free( &name##_pool, object ); }
+
+extern void* POOL_Alloc( pool_t* pool );
+extern void POOL_Free( pool_t* pool, void* object );
+extern int POOL_Reserve( pool_t* pool, uint32_t objects );
+extern void POOL_GetStats( pool_t* pool, pool_stats_t* stats );
+extern void POOL_Dump( void );
+
+#endif
@@ -0,0 +1,164 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A host (PC) throughput benchmark and stress test for the ring buffers in ring-buffer.h. It runs
+   the same ring code as the kernel with the atomics and barriers mapped to the compiler builtins
+   and a thread standing in for each core. Build and run it on the host with:
+
+       gcc -O2 -DHOST -pthread -I. ring-buffer-host-bench.c -o ring-buffer-host-bench
+       ./ring-buffer-host-bench
+
+   Every element carries its producer and a per-producer sequence number which the consumer checks,
+   so any lost, duplicated or reordered element fails the run. */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ring-buffer.h"
+
+#define BENCH_ELEMENTS      10000000
+#define BENCH_PRODUCERS     3
+#define BENCH_CAPACITY      1024
+
+typedef struct {
+    uint32_t producer;
+    uint32_t sequence;
+    } element_t;
+
+RING_SPSC_TYPE( spsc_ring_t, element_t, BENCH_CAPACITY );
+RING_MPSC_TYPE( mpsc_ring_t, element_t, BENCH_CAPACITY );
+
+static spsc_ring_t spsc_ring;
+static mpsc_ring_t mpsc_ring;
+
+static uint32_t batch_size;
+static uint32_t per_producer;
+
+
+static double now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void* spsc_producer( void* arg )
+{
+    element_t batch[64];
+    uint32_t sent = 0;
+
+    while( sent < per_producer )
+    {
+        uint32_t count = ( per_producer - sent < batch_size ) ? per_producer - sent : batch_size;
+
+        for( uint32_t i = 0; i < count; i++ )
+        {
+            batch[i].producer = 0;
+            batch[i].sequence = sent + i;
+        }
+
+        for( uint32_t done = 0; done < count; )
+            done += RING_SpscPushBatch( &spsc_ring, &batch[done], count - done );
+
+        sent += count;
+    }
+
+    return NULL;
+}
+
+
+static void* mpsc_producer( void* arg )
+{
+    element_t batch[64];
+    uint32_t producer = (uint32_t)(uintptr_t)arg;
+    uint32_t sent = 0;
+
+    while( sent < per_producer )
+    {
+        uint32_t count = ( per_producer - sent < batch_size ) ? per_producer - sent : batch_size;
+
+        for( uint32_t i = 0; i < count; i++ )
+        {
+            batch[i].producer = producer;
+            batch[i].sequence = sent + i;
+        }
+
+        for( uint32_t done = 0; done < count; )
+            done += RING_MpscPushBatch( &mpsc_ring, &batch[done], count - done );
+
+        sent += count;
+    }
+
+    return NULL;
+}
+
+
+static int run( int mpsc, int producers, uint32_t batch )
+{
+    pthread_t threads[BENCH_PRODUCERS];
+    uint32_t expected[BENCH_PRODUCERS] = { 0 };
+    uint32_t total = 0;
+    element_t elements[64];
+    double start;
+    int errors = 0;
+
+    batch_size = batch;
+    per_producer = BENCH_ELEMENTS / producers;
+
+    start = now();
+
+    for( int p = 0; p < producers; p++ )
+        pthread_create( &threads[p], NULL, mpsc ? mpsc_producer : spsc_producer, (void*)(uintptr_t)p );
+
+    while( total < per_producer * producers )
+    {
+        uint32_t count = mpsc ? RING_MpscPopBatch( &mpsc_ring, elements, batch ) :
+                                RING_SpscPopBatch( &spsc_ring, elements, batch );
+
+        for( uint32_t i = 0; i < count; i++ )
+        {
+            if( ( elements[i].producer >= (uint32_t)producers ) ||
+                ( elements[i].sequence != expected[elements[i].producer]++ ) )
+                errors++;
+        }
+
+        total += count;
+    }
+
+    for( int p = 0; p < producers; p++ )
+        pthread_join( threads[p], NULL );
+
+    printf( "%s %d producer(s), batch %2u: %6.1fM elements/s%s\n",
+            mpsc ? "MPSC" : "SPSC",
+            producers,
+            batch,
+            total / ( now() - start ) / 1e6,
+            errors ? " FAILED" : "" );
+
+    return errors;
+}
+
+
+int main( int argc, char* argv[] )
+{
+    int errors = 0;
+
+    errors += run( 0, 1, 1 );
+    errors += run( 0, 1, 16 );
+    errors += run( 1, 1, 1 );
+    errors += run( 1, BENCH_PRODUCERS, 1 );
+    errors += run( 1, BENCH_PRODUCERS, 16 );
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "rpi-atomic.h"
+#include "rpi-barrier.h"
+#include "rpi-base.h"
+
+/* Lock-free bounded ring buffers for passing fixed size elements between a producer and a
+   consumer, which can be on different cores or in different contexts (IRQ handler and thread) on
+   the same core.
+
+   A ring type is declared for an element type and a power of two capacity with RING_SPSC_TYPE()
+   or RING_MPSC_TYPE(). A zero initialised ring is empty and ready to use, so rings can be static
+   (or arrays of them) without any initialisation call.
+
+   SPSC rings have a single producer and a single consumer. The producer only writes the head and
+   the consumer only writes the tail, so both ends are wait-free. Each end also keeps a cached copy
+   of the other end's index and only reads the other core's cache line again when the cached copy
+   says the ring is full (or empty).
+
+   MPSC rings allow any number of producers. A producer reserves slots by moving the head with a
+   compare-and-swap and then publishes each slot by writing its position + 1 to the slot's sequence
+   number. The consumer stops at the first slot that hasn't been published, so a producer that is
+   interrupted (or preempted) between reserving and publishing never blocks the other producers -
+   an IRQ handler can push to a ring that the code it interrupted is also pushing to.
+
+   The head and tail indices are free running 32-bit counters on separate cache lines. The batch
+   operations move as many elements as fit (or are available) with a single index update.
+
+   All of the operations are inline so that the element copies are fixed size memcpy()s the
+   compiler can inline */
+
+/** @brief The producer and consumer indices. Each end's index is on its own cache line along with
+    its cached copy of the other end's index */
+typedef struct {
+    rpi_atomic_t head __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
+    uint32_t tail_cache;
+
+    rpi_atomic_t tail __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
+    uint32_t head_cache;
+    } ring_index_t;
+
+#define RING_SPSC_TYPE( name, element_type, capacity )                                          \
+    typedef struct {                                                                            \
+        ring_index_t index;                                                                     \
+        element_type slots[capacity] __attribute__((aligned(RPI_CACHE_LINE_SIZE)));             \
+        _Static_assert( ( (capacity) & ( (capacity) - 1 ) ) == 0,                               \
+                        "capacity must be a power of two" );                                    \
+        } name
+
+#define RING_MPSC_TYPE( name, element_type, capacity )                                          \
+    typedef struct {                                                                            \
+        ring_index_t index;                                                                     \
+        volatile uint32_t sequence[capacity] __attribute__((aligned(RPI_CACHE_LINE_SIZE)));     \
+        element_type slots[capacity] __attribute__((aligned(RPI_CACHE_LINE_SIZE)));             \
+        _Static_assert( ( (capacity) & ( (capacity) - 1 ) ) == 0,                               \
+                        "capacity must be a power of two" );                                    \
+        } name
+
+#define RING_CAPACITY( ring )       ( sizeof( (ring)->slots ) / sizeof( (ring)->slots[0] ) )
+
+/** @brief The number of elements in the ring. Only exact when called by the consumer */
+#define RING_Count( ring )                                                                      \
+    ( RPI_AtomicLoad( &(ring)->index.head ) - RPI_AtomicLoad( &(ring)->index.tail ) )
+
+#define RING_SpscPushBatch( ring, elements, count )                                             \
+    ring_spsc_push( &(ring)->index, (ring)->slots, sizeof( (ring)->slots[0] ),                  \
+                    RING_CAPACITY( ring ), (elements), (count) )
+
+#define RING_SpscPopBatch( ring, elements, max )                                                \
+    ring_spsc_pop( &(ring)->index, (ring)->slots, sizeof( (ring)->slots[0] ),                   \
+                   RING_CAPACITY( ring ), (elements), (max) )
+
+#define RING_MpscPushBatch( ring, elements, count )                                             \
+    ring_mpsc_push( &(ring)->index, (ring)->sequence, (ring)->slots,                            \
+                    sizeof( (ring)->slots[0] ), RING_CAPACITY( ring ), (elements), (count) )
+
+#define RING_MpscPopBatch( ring, elements, max )                                                \
+    ring_mpsc_pop( &(ring)->index, (ring)->sequence, (ring)->slots,                             \
+                   sizeof( (ring)->slots[0] ), RING_CAPACITY( ring ), (elements), (max) )
+
+/** @brief Single element operations. They return 0 on success and -1 if the ring is full (push)
+    or empty (pop) */
+#define RING_SpscPush( ring, element )  ( ( RING_SpscPushBatch( ring, element, 1 ) == 1 ) ? 0 : -1 )
+#define RING_SpscPop( ring, element )   ( ( RING_SpscPopBatch( ring, element, 1 ) == 1 ) ? 0 : -1 )
+#define RING_MpscPush( ring, element )  ( ( RING_MpscPushBatch( ring, element, 1 ) == 1 ) ? 0 : -1 )
+#define RING_MpscPop( ring, element )   ( ( RING_MpscPopBatch( ring, element, 1 ) == 1 ) ? 0 : -1 )
+
+
+/* Copy count elements into the ring starting at position, wrapping at the end of the slots */
+static inline void ring_copy_in( void* slots, uint32_t size, uint32_t capacity, uint32_t position,
+                                 const void* elements, uint32_t count )
+{
+    uint32_t first = capacity - ( position & ( capacity - 1 ) );
+
+    if( first > count )
+        first = count;
+
+    memcpy( (uint8_t*)slots + ( position & ( capacity - 1 ) ) * size, elements, first * size );
+
+    if( count > first )
+        memcpy( slots, (const uint8_t*)elements + first * size, ( count - first ) * size );
+}
+
+
+static inline void ring_copy_out( const void* slots, uint32_t size, uint32_t capacity,
+                                  uint32_t position, void* elements, uint32_t count )
+{
+    uint32_t first = capacity - ( position & ( capacity - 1 ) );
+
+    if( first > count )
+        first = count;
+
+    memcpy( elements, (const uint8_t*)slots + ( position & ( capacity - 1 ) ) * size,
+            first * size );
+
+    if( count > first )
+        memcpy( (uint8_t*)elements + first * size, slots, ( count - first ) * size );
+}
+
+
+/** @return The number of elements pushed, less than count if the ring filled up */
+static inline uint32_t ring_spsc_push( ring_index_t* index, void* slots, uint32_t size,
+                                       uint32_t capacity, const void* elements, uint32_t count )
+{
+    uint32_t head = RPI_AtomicLoad( &index->head );
+
+    if( ( capacity - ( head - index->tail_cache ) ) < count )
+    {
+        /* The consumer must have finished reading the slots before we reuse them */
+        index->tail_cache = RPI_AtomicLoadAcquire( &index->tail );
+
+        if( ( capacity - ( head - index->tail_cache ) ) < count )
+            count = capacity - ( head - index->tail_cache );
+    }
+
+    if( count == 0 )
+        return 0;
+
+    ring_copy_in( slots, size, capacity, head, elements, count );
+
+    /* The elements must be visible before the consumer can see the new head */
+    RPI_AtomicStoreRelease( &index->head, head + count );
+
+    return count;
+}
+
+
+/** @return The number of elements popped, up to max */
+static inline uint32_t ring_spsc_pop( ring_index_t* index, const void* slots, uint32_t size,
+                                      uint32_t capacity, void* elements, uint32_t max )
+{
+    uint32_t tail = RPI_AtomicLoad( &index->tail );
+    uint32_t count = index->head_cache - tail;
+
+    if( count < max )
+    {
+        index->head_cache = RPI_AtomicLoadAcquire( &index->head );
+        count = index->head_cache - tail;
+    }
+
+    if( count > max )
+        count = max;
+
+    if( count == 0 )
+        return 0;
+
+    ring_copy_out( slots, size, capacity, tail, elements, count );
+
+    /* Finish reading the slots before handing them back to the producer */
+    RPI_AtomicStoreRelease( &index->tail, tail + count );
+
+    return count;
+}
+
+
+/** @return The number of elements pushed, less than count if the ring filled up */
+static inline uint32_t ring_mpsc_push( ring_index_t* index, volatile uint32_t* sequence,
+                                       void* slots, uint32_t size, uint32_t capacity,
+                                       const void* elements, uint32_t count )
+{
+    uint32_t head, space;
+
+    /* Reserve the slots */
+    while( 1 )
+    {
+        head = RPI_AtomicLoad( &index->head );
+        space = capacity - ( head - RPI_AtomicLoadAcquire( &index->tail ) );
+
+        /* The consumer has already caught up with a head newer than ours, try again */
+        if( space > capacity )
+            continue;
+
+        if( count > space )
+            count = space;
+
+        if( count == 0 )
+            return 0;
+
+        if( RPI_AtomicCompareExchangeRelaxed( &index->head, head, head + count ) == head )
+            break;
+    }
+
+    ring_copy_in( slots, size, capacity, head, elements, count );
+
+    /* Publish them */
+    RPI_SmpMemoryBarrier();
+
+    for( uint32_t i = 0; i < count; i++ )
+        sequence[( head + i ) & ( capacity - 1 )] = head + i + 1;
+
+    return count;
+}
+
+
+/** @return The number of elements popped, up to max */
+static inline uint32_t ring_mpsc_pop( ring_index_t* index, volatile uint32_t* sequence,
+                                      const void* slots, uint32_t size, uint32_t capacity,
+                                      void* elements, uint32_t max )
+{
+    uint32_t tail = RPI_AtomicLoad( &index->tail );
+    uint32_t count;
+
+    /* Stop at the first slot that's been reserved but not yet published */
+    for( count = 0; count < max; count++ )
+    {
+        if( sequence[( tail + count ) & ( capacity - 1 )] != ( tail + count + 1 ) )
+            break;
+    }
+
+    if( count == 0 )
+        return 0;
+
+    /* Don't read the elements until we've seen them published */
+    RPI_SmpMemoryBarrier();
+
+    ring_copy_out( slots, size, capacity, tail, elements, count );
+
+    RPI_AtomicStoreRelease( &index->tail, tail + count );
+
+    return count;
+}
+
+#endif
@@ -0,0 +1,266 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_ATOMIC_H
+#define RPI_ATOMIC_H
+
+#include <stdint.h>
+
+#include "rpi-barrier.h"
+
+/* Atomic operations on a 32-bit word using the LDREX/STREX exclusive access instructions, which
+   the ARM1176 (ARMv6K) and the later cores all have. The read-modify-write operations retry until
+   their STREX succeeds, so they're atomic against the other cores and against interrupt handlers
+   (armc-start.S clears the exclusive monitor on the way out of every interrupt).
+
+   The plain operations are full barriers - no memory access moves across them in either
+   direction. The _Relaxed operations are atomic but don't order any other accesses. Loads and
+   stores of an aligned word are always atomic, the _Acquire load and _Release store add the
+   ordering needed to hand data from one core to another.
+
+   The barriers come from RPI_SmpMemoryBarrier() so they're only compiler barriers on the single
+   core models. An atomic must live in normal cached memory, the exclusive monitors don't work on
+   uncached memory. */
+
+typedef struct {
+    volatile uint32_t value;
+    } rpi_atomic_t;
+
+#define RPI_ATOMIC_INIT( value )    { ( value ) }
+
+
+static inline uint32_t RPI_AtomicLoad( const rpi_atomic_t* atomic )
+{
+    return atomic->value;
+}
+
+
+/** @brief Load that no later memory access can move before */
+static inline uint32_t RPI_AtomicLoadAcquire( const rpi_atomic_t* atomic )
+{
+    uint32_t value = atomic->value;
+    RPI_SmpMemoryBarrier();
+    return value;
+}
+
+
+static inline void RPI_AtomicStore( rpi_atomic_t* atomic, uint32_t value )
+{
+    atomic->value = value;
+}
+
+
+/** @brief Store that no earlier memory access can move after */
+static inline void RPI_AtomicStoreRelease( rpi_atomic_t* atomic, uint32_t value )
+{
+    RPI_SmpMemoryBarrier();
+    atomic->value = value;
+}
+
+
+/* The relaxed read-modify-write primitives. A host build (for benchmarking the portable code on a
+   PC) uses the compiler's builtins instead of the ARM exclusive access instructions */
+
+#if defined( HOST )
+
+static inline uint32_t RPI_AtomicFetchAddRelaxed( rpi_atomic_t* atomic, uint32_t value )
+{
+    return __atomic_fetch_add( &atomic->value, value, __ATOMIC_RELAXED );
+}
+
+static inline uint32_t RPI_AtomicFetchOrRelaxed( rpi_atomic_t* atomic, uint32_t bits )
+{
+    return __atomic_fetch_or( &atomic->value, bits, __ATOMIC_RELAXED );
+}
+
+static inline uint32_t RPI_AtomicFetchAndRelaxed( rpi_atomic_t* atomic, uint32_t mask )
+{
+    return __atomic_fetch_and( &atomic->value, mask, __ATOMIC_RELAXED );
+}
+
+static inline uint32_t RPI_AtomicExchangeRelaxed( rpi_atomic_t* atomic, uint32_t value )
+{
+    return __atomic_exchange_n( &atomic->value, value, __ATOMIC_RELAXED );
+}
+
+static inline uint32_t RPI_AtomicCompareExchangeRelaxed( rpi_atomic_t* atomic, uint32_t expected, uint32_t desired )
+{
+    __atomic_compare_exchange_n( &atomic->value, &expected, desired, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED );
+    return expected;
+}
+
+#else
+
+/** @return The value before value was added */
+static inline uint32_t RPI_AtomicFetchAddRelaxed( rpi_atomic_t* atomic, uint32_t value )
+{
+    uint32_t old, result, status;
+
+    __asm__ volatile(
+        "1: ldrex   %0, [%3]        \n"
+        "   add     %1, %0, %4      \n"
+        "   strex   %2, %1, [%3]    \n"
+        "   teq     %2, #0          \n"
+        "   bne     1b              \n"
+        : "=&r" (old), "=&r" (result), "=&r" (status)
+        : "r" (&atomic->value), "r" (value)
+        : "cc", "memory" );
+
+    return old;
+}
+
+
+/** @return The value before the bits were set */
+static inline uint32_t RPI_AtomicFetchOrRelaxed( rpi_atomic_t* atomic, uint32_t bits )
+{
+    uint32_t old, result, status;
+
+    __asm__ volatile(
+        "1: ldrex   %0, [%3]        \n"
+        "   orr     %1, %0, %4      \n"
+        "   strex   %2, %1, [%3]    \n"
+        "   teq     %2, #0          \n"
+        "   bne     1b              \n"
+        : "=&r" (old), "=&r" (result), "=&r" (status)
+        : "r" (&atomic->value), "r" (bits)
+        : "cc", "memory" );
+
+    return old;
+}
+
+
+/** @return The value before the bits not in mask were cleared */
+static inline uint32_t RPI_AtomicFetchAndRelaxed( rpi_atomic_t* atomic, uint32_t mask )
+{
+    uint32_t old, result, status;
+
+    __asm__ volatile(
+        "1: ldrex   %0, [%3]        \n"
+        "   and     %1, %0, %4      \n"
+        "   strex   %2, %1, [%3]    \n"
+        "   teq     %2, #0          \n"
+        "   bne     1b              \n"
+        : "=&r" (old), "=&r" (result), "=&r" (status)
+        : "r" (&atomic->value), "r" (mask)
+        : "cc", "memory" );
+
+    return old;
+}
+
+
+/** @return The value that was replaced */
+static inline uint32_t RPI_AtomicExchangeRelaxed( rpi_atomic_t* atomic, uint32_t value )
+{
+    uint32_t old, status;
+
+    __asm__ volatile(
+        "1: ldrex   %0, [%2]        \n"
+        "   strex   %1, %3, [%2]    \n"
+        "   teq     %1, #0          \n"
+        "   bne     1b              \n"
+        : "=&r" (old), "=&r" (status)
+        : "r" (&atomic->value), "r" (value)
+        : "cc", "memory" );
+
+    return old;
+}
+
+
+/**
+    @brief Replace the value with desired only if it is currently expected
+    @return The value before the operation. The exchange happened if it equals expected
+*/
+static inline uint32_t RPI_AtomicCompareExchangeRelaxed( rpi_atomic_t* atomic, uint32_t expected, uint32_t desired )
+{
+    uint32_t old, status;
+
+    __asm__ volatile(
+        "1: ldrex   %0, [%2]        \n"
+        "   mov     %1, #0          \n"
+        "   teq     %0, %3          \n"
+        "   strexeq %1, %4, [%2]    \n"
+        "   teq     %1, #0          \n"
+        "   bne     1b              \n"
+        : "=&r" (old), "=&r" (status)
+        : "r" (&atomic->value), "r" (expected), "r" (desired)
+        : "cc", "memory" );
+
+    return old;
+}
+
+#endif
+
+
+static inline uint32_t RPI_AtomicFetchAdd( rpi_atomic_t* atomic, uint32_t value )
+{
+    uint32_t old;
+
+    RPI_SmpMemoryBarrier();
+    old = RPI_AtomicFetchAddRelaxed( atomic, value );
+    RPI_SmpMemoryBarrier();
+
+    return old;
+}
+
+
+static inline uint32_t RPI_AtomicFetchSub( rpi_atomic_t* atomic, uint32_t value )
+{
+    return RPI_AtomicFetchAdd( atomic, -value );
+}
+
+
+static inline uint32_t RPI_AtomicFetchOr( rpi_atomic_t* atomic, uint32_t bits )
+{
+    uint32_t old;
+
+    RPI_SmpMemoryBarrier();
+    old = RPI_AtomicFetchOrRelaxed( atomic, bits );
+    RPI_SmpMemoryBarrier();
+
+    return old;
+}
+
+
+static inline uint32_t RPI_AtomicFetchAnd( rpi_atomic_t* atomic, uint32_t mask )
+{
+    uint32_t old;
+
+    RPI_SmpMemoryBarrier();
+    old = RPI_AtomicFetchAndRelaxed( atomic, mask );
+    RPI_SmpMemoryBarrier();
+
+    return old;
+}
+
+
+static inline uint32_t RPI_AtomicExchange( rpi_atomic_t* atomic, uint32_t value )
+{
+    uint32_t old;
+
+    RPI_SmpMemoryBarrier();
+    old = RPI_AtomicExchangeRelaxed( atomic, value );
+    RPI_SmpMemoryBarrier();
+
+    return old;
+}
+
+
+static inline uint32_t RPI_AtomicCompareExchange( rpi_atomic_t* atomic, uint32_t expected, uint32_t desired )
+{
+    uint32_t old;
+
+    RPI_SmpMemoryBarrier();
+    old = RPI_AtomicCompareExchangeRelaxed( atomic, expected, desired );
+    RPI_SmpMemoryBarrier();
+
+    return old;
+}
+
+#endif
@@ -0,0 +1,159 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_BARRIER_H
+#define RPI_BARRIER_H
+
+#include "rpi-base.h"
+
+/* The ARMv6 (ARM1176) doesn't have the dmb, dsb and isb instructions. Instead the same operations
+   are CP15 c7 operations. See the ARM1176JZF-S TRM section 3.2.22. ARMv7 and ARMv8 (in AArch32)
+   have the native instructions which are preferred */
+
+#if defined( HOST )
+
+static inline void RPI_DataMemoryBarrier( void )
+{
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+static inline void RPI_DataSyncBarrier( void )
+{
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+static inline void RPI_InstructionSyncBarrier( void )
+{
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+#elif defined( RPI0 ) || defined( RPI1 )
+
+static inline void RPI_DataMemoryBarrier( void )
+{
+    __asm__ volatile( "mcr p15, 0, %0, c7, c10, 5" : : "r" (0) : "memory" );
+}
+
+static inline void RPI_DataSyncBarrier( void )
+{
+    __asm__ volatile( "mcr p15, 0, %0, c7, c10, 4" : : "r" (0) : "memory" );
+}
+
+static inline void RPI_InstructionSyncBarrier( void )
+{
+    __asm__ volatile( "mcr p15, 0, %0, c7, c5, 4" : : "r" (0) : "memory" );
+}
+
+#else
+
+static inline void RPI_DataMemoryBarrier( void )
+{
+    __asm__ volatile( "dmb" : : : "memory" );
+}
+
+static inline void RPI_DataSyncBarrier( void )
+{
+    __asm__ volatile( "dsb" : : : "memory" );
+}
+
+static inline void RPI_InstructionSyncBarrier( void )
+{
+    __asm__ volatile( "isb" : : : "memory" );
+}
+
+#endif
+
+/** @brief Stop the compiler moving memory accesses across this point. The CPU may still reorder
+    them */
+static inline void RPI_CompilerBarrier( void )
+{
+    __asm__ volatile( "" : : : "memory" );
+}
+
+/* Barriers that only have to order memory accesses as seen by the other cores, for data that is
+   never read by a peripheral. The single core ARM1176 only needs the compiler not to reorder
+   accesses. The multi-core models only need to order accesses in the inner shareable domain the
+   cores share, which is cheaper than a full system barrier. The _Store variant only orders stores
+   against later stores */
+
+#if defined( HOST )
+
+static inline void RPI_SmpMemoryBarrier( void )
+{
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+static inline void RPI_SmpStoreBarrier( void )
+{
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+#elif defined( RPI0 ) || defined( RPI1 )
+
+static inline void RPI_SmpMemoryBarrier( void )
+{
+    RPI_CompilerBarrier();
+}
+
+static inline void RPI_SmpStoreBarrier( void )
+{
+    RPI_CompilerBarrier();
+}
+
+#else
+
+static inline void RPI_SmpMemoryBarrier( void )
+{
+    __asm__ volatile( "dmb ish" : : : "memory" );
+}
+
+static inline void RPI_SmpStoreBarrier( void )
+{
+    __asm__ volatile( "dmb ishst" : : : "memory" );
+}
+
+#endif
+
+#if defined( HOST )
+
+/* A host thread waiting for an event just spins */
+static inline void RPI_SendEvent( void )
+{
+    RPI_CompilerBarrier();
+}
+
+static inline void RPI_WaitForEvent( void )
+{
+    RPI_CompilerBarrier();
+}
+
+#else
+
+/** @brief Signal an event to all cores, waking any that are waiting in RPI_WaitForEvent() */
+static inline void RPI_SendEvent( void )
+{
+    __asm__ volatile( "sev" : : : "memory" );
+}
+
+/** @brief Sleep the core until an event (or interrupt) is signalled */
+static inline void RPI_WaitForEvent( void )
+{
+    __asm__ volatile( "wfe" : : : "memory" );
+}
+
+/** @brief Sleep the core until an interrupt is pending (even if interrupts are masked) */
+static inline void RPI_WaitForInterrupt( void )
+{
+    __asm__ volatile( "wfi" : : : "memory" );
+}
+
+#endif
+
+#endif
@@ -21,10 +21,19 @@
 #elif defined( RPI4 )
     #define PERIPHERAL_BASE       (0xFE000000UL)
     #define GIC400_BASE           (0xFF840000UL)
+#elif defined( HOST )
+    /* A host build of the portable code (such as the ring buffer benchmark). No peripherals */
 #else
     #error Unknown RPI Model!
 #endif
 
+/* The BCM2836 and BCM2837 have an additional block of ARM-local peripherals (per-core timers,
+   mailboxes and interrupt routing) which sits outside of the normal peripheral address space.
+   See the "BCM2836 ARM-local peripherals" document (QA7_rev3.4.pdf) */
+#if defined( RPI2 ) || defined( RPI3 )
+    #define RPI_LOCAL_BASE        (0x40000000UL)
+#endif
+
 /* System Frequencies From:
    https://www.raspberrypi.org/documentation/configuration/config-txt/overclocking.md
 
@@ -38,10 +47,41 @@
 #define SYSFREQ (250000000UL)
 #elif defined( RPI4 )
 #define SYSFREQ (200000000UL)
+#elif defined( HOST )
 #else
     #error Unknown RPI Model!
 #endif
 
+/* The L1 data cache line size. Data shared between cores is separated by at least this much to
+   stop the cores fighting over the same cache line */
+#if defined( RPI0 ) || defined( RPI1 )
+#define RPI_CACHE_LINE_SIZE     32
+#else
+#define RPI_CACHE_LINE_SIZE     64
+#endif
+
+/* The VideoCore (and therefore the DMA engines, the framebuffer and the mailbox) sees memory on
+   its own bus. ARM physical memory appears there through an alias in the top two address bits:
+   0x40000000 is the L2 cached alias the BCM2835 ARM also goes through, the later models disable
+   the L2 for the ARM and use the uncached 0xC0000000 alias. Addresses handed to the VideoCore
+   must be bus addresses and addresses it hands back must be translated before the ARM uses them */
+#if defined( RPI0 ) || defined( RPI1 )
+#define RPI_BUS_ALIAS           (0x40000000UL)
+#else
+#define RPI_BUS_ALIAS           (0xC0000000UL)
+#endif
+
+#define RPI_BUS_ALIAS_MASK      (0xC0000000UL)
+
+#define RPI_PhysToBus( addr )   ( ( (uint32_t)(addr) & ~RPI_BUS_ALIAS_MASK ) | RPI_BUS_ALIAS )
+#define RPI_BusToPhys( addr )   ( (uint32_t)(addr) & ~RPI_BUS_ALIAS_MASK )
+
+/* The peripherals appear at 0x7E000000 on the VideoCore's bus wherever the ARM sees them, the DMA
+   engines need this address for a peripheral's FIFO */
+#define RPI_PERIPHERAL_BUS_BASE     (0x7E000000UL)
+
+#define RPI_PeripheralToBus( addr ) ( (uint32_t)(addr) - PERIPHERAL_BASE + RPI_PERIPHERAL_BUS_BASE )
+
 typedef volatile uint32_t rpi_reg_rw_t;
 typedef volatile const uint32_t rpi_reg_ro_t;
 typedef volatile uint32_t rpi_reg_wo_t;
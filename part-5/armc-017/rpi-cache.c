@@ -0,0 +1,106 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* Data cache maintenance by virtual address. The ARM1176 (ARMv6) and the Cortex-A7/A53/A72
+   (ARMv7/ARMv8 in AArch32) all use the same CP15 c7 encodings for the by-MVA line operations. On
+   the multi-core models the operations are broadcast to the other cores by the SCU so a range only
+   has to be maintained by one core. See the ARM1176JZF-S TRM section 3.2.22 and the ARMv7-A ARM
+   section B4.2.1 */
+
+#include <stdint.h>
+
+#include "rpi-barrier.h"
+#include "rpi-base.h"
+#include "rpi-cache.h"
+
+static inline void clean_line( uint32_t mva )
+{
+    __asm__ volatile( "mcr p15, 0, %0, c7, c10, 1" : : "r" (mva) : "memory" );
+}
+
+static inline void invalidate_line( uint32_t mva )
+{
+    __asm__ volatile( "mcr p15, 0, %0, c7, c6, 1" : : "r" (mva) : "memory" );
+}
+
+static inline void clean_invalidate_line( uint32_t mva )
+{
+    __asm__ volatile( "mcr p15, 0, %0, c7, c14, 1" : : "r" (mva) : "memory" );
+}
+
+
+/**
+    @brief Write any dirty cache lines covering the range back to memory
+*/
+void RPI_CacheCleanRange( const void* start, uint32_t bytes )
+{
+    uint32_t mva = (uint32_t)start & ~RPI_CACHE_LINE_MASK;
+    uint32_t end = (uint32_t)start + bytes;
+
+    /* Make sure the writes we're about to clean have been issued */
+    RPI_DataSyncBarrier();
+
+    for( ; mva < end; mva += RPI_CACHE_LINE_SIZE )
+        clean_line( mva );
+
+    RPI_DataSyncBarrier();
+}
+
+
+/**
+    @brief Discard any cache lines covering the range so the next read comes from memory
+
+    A partial line at either end of the range is cleaned as well as invalidated so the data
+    sharing the line with the buffer isn't lost. Buffers that will be invalidated are best kept
+    cache line aligned (RPI_CacheLineAlign) so that never happens
+*/
+void RPI_CacheInvalidateRange( void* start, uint32_t bytes )
+{
+    uint32_t mva = (uint32_t)start;
+    uint32_t end = (uint32_t)start + bytes;
+
+    RPI_DataSyncBarrier();
+
+    if( mva & RPI_CACHE_LINE_MASK )
+    {
+        mva &= ~RPI_CACHE_LINE_MASK;
+        clean_invalidate_line( mva );
+        mva += RPI_CACHE_LINE_SIZE;
+    }
+
+    if( ( end & RPI_CACHE_LINE_MASK ) && ( end > mva ) )
+    {
+        end &= ~RPI_CACHE_LINE_MASK;
+        clean_invalidate_line( end );
+    }
+
+    for( ; mva < end; mva += RPI_CACHE_LINE_SIZE )
+        invalidate_line( mva );
+
+    RPI_DataSyncBarrier();
+}
+
+
+/**
+    @brief Write back and then discard the cache lines covering the range. Used for buffers a
+    peripheral both reads and writes
+*/
+void RPI_CacheCleanInvalidateRange( void* start, uint32_t bytes )
+{
+    uint32_t mva = (uint32_t)start & ~RPI_CACHE_LINE_MASK;
+    uint32_t end = (uint32_t)start + bytes;
+
+    RPI_DataSyncBarrier();
+
+    for( ; mva < end; mva += RPI_CACHE_LINE_SIZE )
+        clean_invalidate_line( mva );
+
+    RPI_DataSyncBarrier();
+}
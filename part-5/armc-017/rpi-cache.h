@@ -0,0 +1,33 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_CACHE_H
+#define RPI_CACHE_H
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+
+/* Data cache maintenance for memory shared with the VideoCore, the DMA engines and (on the
+   single core models) anything else that doesn't snoop the ARM's L1 data cache.
+
+   Before a peripheral reads a buffer the CPU has written, clean it so the data reaches memory.
+   Before the CPU reads a buffer a peripheral has written, invalidate it so stale lines aren't
+   used. Buffers from PAGE_AllocCoherent() are mapped non-cacheable and need neither */
+
+/** @brief Round an address down and a size up to whole cache lines */
+#define RPI_CACHE_LINE_MASK         ( RPI_CACHE_LINE_SIZE - 1 )
+#define RPI_CacheLineAlign( x )     ( ( (uint32_t)(x) + RPI_CACHE_LINE_MASK ) & ~RPI_CACHE_LINE_MASK )
+
+extern void RPI_CacheCleanRange( const void* start, uint32_t bytes );
+extern void RPI_CacheInvalidateRange( void* start, uint32_t bytes );
+extern void RPI_CacheCleanInvalidateRange( void* start, uint32_t bytes );
+
+#endif
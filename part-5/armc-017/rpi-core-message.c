@@ -0,0 +1,235 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* Inter-core messaging using the BCM2836 ARM-local mailboxes as doorbells.
+
+   The mailboxes are write-set / read-clear registers, so several cores writing a value to the same
+   mailbox would OR their values together. Instead the message payloads travel through a ring for
+   each (sender, receiver) pair of cores. Each ring only has a single producer and a single consumer
+   so it's an SPSC ring (see ring-buffer.h) and needs no locking. The sender then sets its own bit
+   in the receiver's doorbell mailbox and signals an event, waking the receiver from either WFE or
+   (with the mailbox interrupt enabled) WFI. Posting several messages before notifying batches
+   them behind a single doorbell */
+
+#include <stdint.h>
+
+#include "ring-buffer.h"
+#include "rpi-barrier.h"
+#include "rpi-base.h"
+#include "rpi-core-message.h"
+#include "rpi-interrupts.h"
+#include "rpi-local-intc.h"
+#include "rpi-smp.h"
+
+#if defined( RPI_LOCAL_BASE )
+
+/* A single producer, single consumer ring from one core to another */
+RING_SPSC_TYPE( core_message_ring_t, rpi_core_message_t, RPI_CORE_MESSAGE_SLOTS );
+
+/* The inbox of each core is a ring from every core (including itself) */
+static core_message_ring_t inbox[RPI_CORE_COUNT][RPI_CORE_COUNT];
+
+/* The sender each core's inbox will be checked from first, so that no sender is starved */
+static int inbox_next[RPI_CORE_COUNT];
+
+
+/**
+    @brief Queue a message for a core without notifying it
+    @return 0 on success, -1 if the core's inbox from this core is full
+*/
+int RPI_CoreMessagePost( int core, const rpi_core_message_t* message )
+{
+    if( ( core < 0 ) || ( core >= RPI_CORE_COUNT ) )
+        return -1;
+
+    return RING_SpscPush( &inbox[core][RPI_GetCoreId()], message );
+}
+
+
+/**
+    @brief Ring the doorbell of a core to tell it there are messages waiting
+*/
+void RPI_CoreMessageNotify( int core )
+{
+    if( ( core < 0 ) || ( core >= RPI_CORE_COUNT ) )
+        return;
+
+    RPI_DataSyncBarrier();
+    RPI_GetLocal()->core_mailbox_write_set[core][RPI_CORE_MESSAGE_MAILBOX] =
+        ( 1 << RPI_GetCoreId() );
+    RPI_DataSyncBarrier();
+    RPI_SendEvent();
+}
+
+
+/**
+    @brief Send a single message to a core
+    @return 0 on success, -1 if the core's inbox is full
+*/
+int RPI_CoreMessageSend( int core, const rpi_core_message_t* message )
+{
+    if( RPI_CoreMessagePost( core, message ) != 0 )
+        return -1;
+
+    RPI_CoreMessageNotify( core );
+    return 0;
+}
+
+
+/**
+    @brief Send a batch of messages to a core behind a single doorbell
+    @return The number of messages queued, which is less than count if the inbox filled up
+*/
+int RPI_CoreMessageSendBatch( int core, const rpi_core_message_t* messages, int count )
+{
+    int sent;
+
+    if( ( core < 0 ) || ( core >= RPI_CORE_COUNT ) || ( count <= 0 ) )
+        return 0;
+
+    sent = RING_SpscPushBatch( &inbox[core][RPI_GetCoreId()], messages, count );
+
+    if( sent )
+        RPI_CoreMessageNotify( core );
+
+    return sent;
+}
+
+
+/**
+    @brief Take the next message from the calling core's inbox without waiting
+    @return 1 if a message was received, 0 if the inbox is empty
+*/
+int RPI_CoreMessageReceive( rpi_core_message_t* message )
+{
+    int core = RPI_GetCoreId();
+    rpi_local_t* local = RPI_GetLocal();
+    uint32_t doorbell;
+
+    /* Acknowledge the doorbell before looking at the rings. A sender that posts after we've looked
+       will ring the doorbell again */
+    doorbell = local->core_mailbox_read_clear[core][RPI_CORE_MESSAGE_MAILBOX];
+    if( doorbell )
+        local->core_mailbox_read_clear[core][RPI_CORE_MESSAGE_MAILBOX] = doorbell;
+
+    for( int i = 0; i < RPI_CORE_COUNT; i++ )
+    {
+        int from = ( inbox_next[core] + i ) % RPI_CORE_COUNT;
+
+        if( RING_SpscPop( &inbox[core][from], message ) != 0 )
+            continue;
+
+        inbox_next[core] = ( from + 1 ) % RPI_CORE_COUNT;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+    @brief Sleep the calling core until a message arrives in its inbox
+*/
+void RPI_CoreMessageWait( rpi_core_message_t* message, rpi_core_wait_t wait )
+{
+    uint32_t cpsr;
+
+    if( wait == RPI_CORE_WAIT_WFI )
+    {
+        while( 1 )
+        {
+            /* Check and sleep with IRQs masked so the mailbox interrupt can't be taken (and the
+               doorbell cleared) between the check and the WFI. A pending interrupt still wakes the
+               core from WFI when it's masked */
+            cpsr = RPI_IrqSaveDisable();
+            if( RPI_CoreMessageReceive( message ) )
+            {
+                RPI_IrqRestore( cpsr );
+                return;
+            }
+
+            RPI_WaitForInterrupt();
+            RPI_IrqRestore( cpsr );
+        }
+    }
+
+    /* If the sender's event arrives between the check and the WFE the event register is already
+       set and the WFE returns immediately */
+    while( !RPI_CoreMessageReceive( message ) )
+        RPI_WaitForEvent();
+}
+
+
+/**
+    @brief Enable the doorbell interrupt on the calling core so it can wait for messages with WFI
+*/
+void RPI_CoreMessageEnableInterrupt( void )
+{
+    RPI_GetLocal()->core_mailbox_interrupt_control[RPI_GetCoreId()] |=
+        ( 1 << RPI_CORE_MESSAGE_MAILBOX );
+}
+
+
+/**
+    @brief Called from the IRQ handler when the doorbell mailbox interrupt is pending
+
+    The messages themselves are left in the inbox to be received in thread context. Clearing the
+    doorbell de-asserts the interrupt.
+*/
+void RPI_CoreMessageInterruptHandler( void )
+{
+    int core = RPI_GetCoreId();
+    rpi_local_t* local = RPI_GetLocal();
+
+    local->core_mailbox_read_clear[core][RPI_CORE_MESSAGE_MAILBOX] =
+            local->core_mailbox_read_clear[core][RPI_CORE_MESSAGE_MAILBOX];
+}
+
+#else
+
+int RPI_CoreMessagePost( int core, const rpi_core_message_t* message )
+{
+    return -1;
+}
+
+void RPI_CoreMessageNotify( int core )
+{
+}
+
+int RPI_CoreMessageSend( int core, const rpi_core_message_t* message )
+{
+    return -1;
+}
+
+int RPI_CoreMessageSendBatch( int core, const rpi_core_message_t* messages, int count )
+{
+    return 0;
+}
+
+int RPI_CoreMessageReceive( rpi_core_message_t* message )
+{
+    return 0;
+}
+
+void RPI_CoreMessageWait( rpi_core_message_t* message, rpi_core_wait_t wait )
+{
+    /* There's no other core to send us a message */
+    while( 1 ) { }
+}
+
+void RPI_CoreMessageEnableInterrupt( void )
+{
+}
+
+void RPI_CoreMessageInterruptHandler( void )
+{
+}
+
+#endif
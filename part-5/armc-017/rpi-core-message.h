@@ -0,0 +1,49 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_CORE_MESSAGE_H
+#define RPI_CORE_MESSAGE_H
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+#include "rpi-smp.h"
+
+/** @brief The local mailbox each core uses as its message doorbell. Bit n is set by core n when
+    it has posted messages to this core's inbox */
+#define RPI_CORE_MESSAGE_MAILBOX    0
+
+/** @brief The number of messages that can be queued between each pair of cores. Must be a power
+    of two */
+#define RPI_CORE_MESSAGE_SLOTS      64
+
+/** @brief A message between cores. The type is free for the application to define */
+typedef struct {
+    uint32_t type;
+    uint32_t data[3];
+    } rpi_core_message_t;
+
+/** @brief How a core sleeps while waiting for a message */
+typedef enum {
+    RPI_CORE_WAIT_WFE = 0,      /**< Wait for the event the sender signals (no interrupt needed) */
+    RPI_CORE_WAIT_WFI,          /**< Wait for the mailbox interrupt, see
+                                     RPI_CoreMessageEnableInterrupt() */
+    } rpi_core_wait_t;
+
+extern int RPI_CoreMessagePost( int core, const rpi_core_message_t* message );
+extern void RPI_CoreMessageNotify( int core );
+extern int RPI_CoreMessageSend( int core, const rpi_core_message_t* message );
+extern int RPI_CoreMessageSendBatch( int core, const rpi_core_message_t* messages, int count );
+extern int RPI_CoreMessageReceive( rpi_core_message_t* message );
+extern void RPI_CoreMessageWait( rpi_core_message_t* message, rpi_core_wait_t wait );
+extern void RPI_CoreMessageEnableInterrupt( void );
+extern void RPI_CoreMessageInterruptHandler( void );
+
+#endif
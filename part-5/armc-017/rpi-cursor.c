@@ -0,0 +1,161 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* The firmware's hardware cursor. The VideoCore composites a small ARGB image over the display
+   itself, so the cursor is never drawn into the framebuffer - moving it is one mailbox call and
+   costs no framebuffer bandwidth at all, and nothing has to be redrawn where it was.
+
+   The image is given to the firmware by address, so it's kept in coherent memory where the
+   VideoCore can read it without any cache maintenance. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "page-alloc.h"
+#include "rpi-base.h"
+#include "rpi-cursor.h"
+#include "rpi-mailbox-interface.h"
+
+/** @brief Position the cursor in framebuffer coordinates, rather than display coordinates, so it
+    follows the framebuffer when it's scaled */
+#define CURSOR_FLAG_FRAMEBUFFER_COORDS  ( 1 << 0 )
+
+typedef struct {
+    uint32_t* image;
+    int visible;
+    int x;
+    int y;
+    } cursor_t;
+
+static cursor_t cursor = { .image = NULL, .visible = 0, .x = 0, .y = 0 };
+
+/* The default arrow, o is the outline and x the fill */
+static const char* arrow[] = {
+    "o",
+    "oo",
+    "oxo",
+    "oxxo",
+    "oxxxo",
+    "oxxxxo",
+    "oxxxxxo",
+    "oxxxxxxo",
+    "oxxxxxxxo",
+    "oxxxxxxxxo",
+    "oxxxxxoooo",
+    "oxxoxxo",
+    "oxo oxxo",
+    "oo  oxxo",
+    "o    oxxo",
+    "     oxxo",
+    "      oo",
+};
+
+#define ARROW_WIDTH     10
+#define ARROW_HEIGHT    ( sizeof( arrow ) / sizeof( arrow[0] ) )
+
+
+/* Send the cursor state. The firmware answers 0 when it's valid */
+static int cursor_update( void )
+{
+    rpi_mailbox_property_t* mp;
+
+    RPI_PropertyInit();
+    RPI_PropertyAddTag( TAG_SET_CURSOR_STATE, cursor.visible, cursor.x, cursor.y,
+                        CURSOR_FLAG_FRAMEBUFFER_COORDS );
+    RPI_PropertyProcess();
+
+    if( ( mp = RPI_PropertyGet( TAG_SET_CURSOR_STATE ) ) == NULL )
+        return -1;
+
+    return ( mp->data.buffer_32[0] == 0 ) ? 0 : -1;
+}
+
+
+/**
+    @brief Give the firmware a new cursor image
+    @param argb width x height pixels, packed. Copied, so it can be freed afterwards
+    @param hotspot_x The pixel of the image that's at the cursor position
+    @return 0 on success, -1 if the image is too big, there's no memory or the firmware refused it
+
+    This is the only time the pixels are copied, so changing the image is the expensive part. Keep
+    one image and move it.
+*/
+int RPI_CursorSetImage( const uint32_t* argb, int width, int height, int hotspot_x, int hotspot_y )
+{
+    rpi_mailbox_property_t* mp;
+
+    if( ( width <= 0 ) || ( height <= 0 ) ||
+        ( width > RPI_CURSOR_MAX_SIZE ) || ( height > RPI_CURSOR_MAX_SIZE ) )
+        return -1;
+
+    if( cursor.image == NULL )
+        cursor.image = PAGE_AllocCoherent( RPI_CURSOR_MAX_SIZE * RPI_CURSOR_MAX_SIZE * 4 );
+
+    if( cursor.image == NULL )
+        return -1;
+
+    memcpy( cursor.image, argb, width * height * 4 );
+
+    RPI_PropertyInit();
+    RPI_PropertyAddTag( TAG_SET_CURSOR_INFO, width, height, RPI_PhysToBus( cursor.image ),
+                        hotspot_x, hotspot_y );
+    RPI_PropertyProcess();
+
+    if( ( mp = RPI_PropertyGet( TAG_SET_CURSOR_INFO ) ) == NULL )
+        return -1;
+
+    return ( mp->data.buffer_32[0] == 0 ) ? 0 : -1;
+}
+
+
+/**
+    @brief Use the built in arrow as the cursor image
+*/
+int RPI_CursorSetArrow( uint32_t fill, uint32_t outline )
+{
+    uint32_t pixels[ARROW_WIDTH * ARROW_HEIGHT];
+
+    for( int y = 0; y < (int)ARROW_HEIGHT; y++ )
+    {
+        int length = strlen( arrow[y] );
+
+        for( int x = 0; x < ARROW_WIDTH; x++ )
+        {
+            char c = ( x < length ) ? arrow[y][x] : ' ';
+
+            pixels[( y * ARROW_WIDTH ) + x] = ( c == 'x' ) ? fill : ( c == 'o' ) ? outline : 0;
+        }
+    }
+
+    return RPI_CursorSetImage( pixels, ARROW_WIDTH, ARROW_HEIGHT, 0, 0 );
+}
+
+
+/**
+    @brief Move the cursor to x, y in framebuffer coordinates. Nothing is drawn
+*/
+int RPI_CursorMove( int x, int y )
+{
+    if( ( x == cursor.x ) && ( y == cursor.y ) )
+        return 0;
+
+    cursor.x = x;
+    cursor.y = y;
+
+    return cursor_update();
+}
+
+
+int RPI_CursorShow( int visible )
+{
+    cursor.visible = visible ? 1 : 0;
+
+    return cursor_update();
+}
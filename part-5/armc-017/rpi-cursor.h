@@ -0,0 +1,25 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_CURSOR_H
+#define RPI_CURSOR_H
+
+#include <stdint.h>
+
+/** @brief The largest cursor image the firmware will show */
+#define RPI_CURSOR_MAX_SIZE     64
+
+extern int RPI_CursorSetImage( const uint32_t* argb, int width, int height, int hotspot_x,
+                               int hotspot_y );
+extern int RPI_CursorSetArrow( uint32_t fill, uint32_t outline );
+extern int RPI_CursorMove( int x, int y );
+extern int RPI_CursorShow( int visible );
+
+#endif
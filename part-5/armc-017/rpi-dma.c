@@ -0,0 +1,582 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A driver for the BCM283x DMA controller. See Section 4 of the BCM2835 ARM Peripherals
+   documentation.
+
+   The VideoCore uses some of the channels itself, the firmware tells us which ones we may use
+   (TAG_GET_DMA_CHANNELS) and they're handed out by RPI_DmaAllocChannel(). Lite channels have half
+   the bandwidth, no 2D mode and 16-bit lengths, so callers that need more ask for a full channel.
+
+   A transfer is described by a chain of control blocks in memory, allocated from a pool in
+   coherent memory (see page-alloc.c) so the CPU and the DMA engine always agree on them. The data
+   itself may be anywhere. The caller cleans a cached source with RPI_CacheCleanRange() before
+   starting a transfer and invalidates a cached destination with RPI_CacheInvalidateRange() after
+   it's finished - the framebuffer and coherent memory are uncached and need neither.
+
+   A transfer can be waited for by polling, or started with a callback which is then run from the
+   DMA interrupt when the last control block completes. The callback runs in IRQ context, anything
+   more than a few instructions should be deferred with WQ_Post() */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "page-alloc.h"
+#include "rpi-atomic.h"
+#include "rpi-barrier.h"
+#include "rpi-base.h"
+#include "rpi-dma.h"
+#include "rpi-interrupts.h"
+#include "rpi-mailbox-interface.h"
+#include "rpi-spinlock.h"
+
+/** @brief The transfer information for memory to memory copies. 128-bit reads and writes in
+    bursts, which gets the most out of the bus */
+#define DMA_MEMCPY_TI       ( RPI_DMA_TI_SRC_INC | RPI_DMA_TI_DEST_INC | \
+                              RPI_DMA_TI_SRC_WIDTH | RPI_DMA_TI_DEST_WIDTH | \
+                              RPI_DMA_TI_BURST_LENGTH( 4 ) )
+
+/** @brief The transfer information for fills. The source doesn't move, only the writes are wide */
+#define DMA_FILL_TI         ( RPI_DMA_TI_DEST_INC | RPI_DMA_TI_DEST_WIDTH | \
+                              RPI_DMA_TI_BURST_LENGTH( 4 ) )
+
+/** @brief A channel is started at a middling priority, raised when the AXI bus is in panic */
+#define DMA_START_CS        ( RPI_DMA_CS_ACTIVE | \
+                              RPI_DMA_CS_PRIORITY( 8 ) | \
+                              RPI_DMA_CS_PANIC_PRIORITY( 15 ) | \
+                              RPI_DMA_CS_WAIT_FOR_OUTSTANDING_WRITES )
+
+#define DMA_DEBUG_ERRORS    ( RPI_DMA_DEBUG_READ_LAST_NOT_SET_ERROR | \
+                              RPI_DMA_DEBUG_FIFO_ERROR | \
+                              RPI_DMA_DEBUG_READ_ERROR )
+
+/** @brief How long to wait for a channel to drain its outstanding writes when it's aborted */
+#define DMA_ABORT_TIMEOUT   100000
+
+typedef struct {
+    rpi_dma_callback_t callback;
+    void* arg;
+    } dma_channel_t;
+
+static rpi_reg_ro_t* dma_int_status = (rpi_reg_ro_t*)RPI_DMA_INT_STATUS;
+static rpi_reg_rw_t* dma_enable = (rpi_reg_rw_t*)RPI_DMA_ENABLE;
+
+static dma_channel_t channels[RPI_DMA_CHANNEL_COUNT];
+
+/* The channels the firmware lets us use, the lite ones amongst them, and the ones handed out */
+static uint32_t usable_channels;
+static uint32_t lite_channels;
+static uint32_t allocated_channels;
+static rpi_spinlock_t channel_lock = RPI_SPINLOCK_INIT;
+
+/* The channels that have a callback waiting on their completion interrupt */
+static rpi_atomic_t irq_channels = RPI_ATOMIC_INIT( 0 );
+
+
+static rpi_dma_channel_t* dma_channel( int channel )
+{
+    return (rpi_dma_channel_t*)( RPI_DMA_BASE + ( channel * 0x100 ) );
+}
+
+
+static rpi_dma_cb_t* cb_from_bus( uint32_t bus_address )
+{
+    return (rpi_dma_cb_t*)RPI_BusToPhys( bus_address );
+}
+
+
+/**
+    @brief Find out which channels we can use from the firmware, then reset them and route their
+    interrupts to the ARM
+*/
+void RPI_DmaInit( void )
+{
+    rpi_mailbox_property_t* mp;
+
+    RPI_PropertyInit();
+    RPI_PropertyAddTag( TAG_GET_DMA_CHANNELS );
+    RPI_PropertyProcess();
+
+    if( ( mp = RPI_PropertyGet( TAG_GET_DMA_CHANNELS ) ) )
+        usable_channels = mp->data.buffer_32[0];
+
+    usable_channels &= ( 1 << RPI_DMA_CHANNEL_COUNT ) - 1;
+
+    for( int channel = 0; channel < RPI_DMA_CHANNEL_COUNT; channel++ )
+    {
+        if( ( usable_channels & ( 1 << channel ) ) == 0 )
+            continue;
+
+        *dma_enable |= 1 << channel;
+
+        dma_channel( channel )->cs = RPI_DMA_CS_RESET;
+        dma_channel( channel )->debug = DMA_DEBUG_ERRORS;
+
+        if( dma_channel( channel )->debug & RPI_DMA_DEBUG_LITE )
+            lite_channels |= 1 << channel;
+    }
+
+    RPI_EnableDmaInterrupts( usable_channels );
+
+    printf( "DMA Channels: 0x%4.4X (lite: 0x%4.4X)\r\n",
+            (unsigned int)usable_channels,
+            (unsigned int)lite_channels );
+}
+
+
+/**
+    @brief Return the mask of channels the firmware has left for the ARM to use
+*/
+uint32_t RPI_DmaGetChannelMask( void )
+{
+    return usable_channels;
+}
+
+
+/**
+    @brief Allocate a channel
+    @param flags RPI_DMA_CHANNEL_FULL for a channel that can do 2D and long transfers
+    @return The channel number, or -1 if there are none left
+
+    When any channel will do a lite channel is handed out first to leave the full channels for the
+    transfers that need them.
+*/
+int RPI_DmaAllocChannel( int flags )
+{
+    uint32_t cpsr = RPI_SpinLockIrqSave( &channel_lock );
+    uint32_t available = usable_channels & ~allocated_channels;
+    int channel = -1;
+
+    if( flags & RPI_DMA_CHANNEL_FULL )
+        available &= ~lite_channels;
+    else if( available & lite_channels )
+        available &= lite_channels;
+
+    if( available )
+    {
+        channel = __builtin_ctz( available );
+        allocated_channels |= 1 << channel;
+    }
+
+    RPI_SpinUnlockIrqRestore( &channel_lock, cpsr );
+
+    return channel;
+}
+
+
+/**
+    @brief Return a channel from RPI_DmaAllocChannel(), aborting anything it's still doing
+*/
+void RPI_DmaFreeChannel( int channel )
+{
+    uint32_t cpsr;
+
+    if( ( channel < 0 ) || ( channel >= RPI_DMA_CHANNEL_COUNT ) )
+        return;
+
+    RPI_DmaAbort( channel );
+
+    cpsr = RPI_SpinLockIrqSave( &channel_lock );
+    allocated_channels &= ~( 1 << channel );
+    RPI_SpinUnlockIrqRestore( &channel_lock, cpsr );
+}
+
+
+int RPI_DmaIsLite( int channel )
+{
+    return ( lite_channels >> channel ) & 1;
+}
+
+
+/**
+    @brief Create a pool of count control blocks
+    @return 0 on success, -1 if there isn't enough coherent memory
+*/
+int RPI_DmaCbPoolInit( rpi_dma_cb_pool_t* pool, int count )
+{
+    pool->blocks = PAGE_AllocCoherent( count * sizeof( rpi_dma_cb_t ) );
+
+    if( pool->blocks == NULL )
+        return -1;
+
+    pool->free = NULL;
+    pool->count = count;
+    pool->available = count;
+    RPI_SpinLockInit( &pool->lock );
+
+    for( int i = count - 1; i >= 0; i-- )
+    {
+        pool->blocks[i].next_free = pool->free;
+        pool->free = &pool->blocks[i];
+    }
+
+    return 0;
+}
+
+
+/**
+    @brief Release a pool's memory. None of its control blocks may still be in use
+*/
+void RPI_DmaCbPoolFree( rpi_dma_cb_pool_t* pool )
+{
+    PAGE_Free( pool->blocks );
+
+    pool->blocks = NULL;
+    pool->free = NULL;
+    pool->count = 0;
+    pool->available = 0;
+}
+
+
+/**
+    @brief Take a control block from a pool
+    @return The control block, cleared and unchained, or NULL if the pool is empty
+*/
+rpi_dma_cb_t* RPI_DmaCbAlloc( rpi_dma_cb_pool_t* pool )
+{
+    uint32_t cpsr = RPI_SpinLockIrqSave( &pool->lock );
+    rpi_dma_cb_t* cb = pool->free;
+
+    if( cb )
+    {
+        pool->free = cb->next_free;
+        pool->available--;
+    }
+
+    RPI_SpinUnlockIrqRestore( &pool->lock, cpsr );
+
+    if( cb )
+    {
+        cb->ti = 0;
+        cb->stride = 0;
+        cb->nextconbk = 0;
+        cb->next_free = NULL;
+    }
+
+    return cb;
+}
+
+
+void RPI_DmaCbFree( rpi_dma_cb_pool_t* pool, rpi_dma_cb_t* cb )
+{
+    uint32_t cpsr = RPI_SpinLockIrqSave( &pool->lock );
+
+    cb->next_free = pool->free;
+    pool->free = cb;
+    pool->available++;
+
+    RPI_SpinUnlockIrqRestore( &pool->lock, cpsr );
+}
+
+
+/**
+    @brief Return every control block in a chain to the pool
+*/
+void RPI_DmaCbFreeChain( rpi_dma_cb_pool_t* pool, rpi_dma_cb_t* cb )
+{
+    while( cb )
+    {
+        rpi_dma_cb_t* next = cb->nextconbk ? cb_from_bus( cb->nextconbk ) : NULL;
+        RPI_DmaCbFree( pool, cb );
+        cb = next;
+    }
+}
+
+
+/**
+    @brief Describe a memory to memory copy. Lite channels can copy at most
+    RPI_DMA_LITE_MAX_LENGTH bytes with one control block
+*/
+void RPI_DmaCbMemcpy( rpi_dma_cb_t* cb, void* dest, const void* src, uint32_t bytes )
+{
+    cb->ti = DMA_MEMCPY_TI;
+    cb->source_ad = RPI_PhysToBus( src );
+    cb->dest_ad = RPI_PhysToBus( dest );
+    cb->txfr_len = bytes;
+    cb->stride = 0;
+}
+
+
+/**
+    @brief Describe filling memory with a repeated word
+
+    The source is the control block's own fill word, which is in coherent memory with it. The
+    source address doesn't increment so the engine reads the same word over and over and packs it
+    into wide writes.
+*/
+void RPI_DmaCbFill( rpi_dma_cb_t* cb, void* dest, uint32_t value, uint32_t bytes )
+{
+    cb->ti = DMA_FILL_TI;
+    cb->source_ad = RPI_PhysToBus( &cb->fill );
+    cb->dest_ad = RPI_PhysToBus( dest );
+    cb->txfr_len = bytes;
+    cb->stride = 0;
+    cb->fill = value;
+}
+
+
+/**
+    @brief Describe filling a rectangle of height rows of width_bytes with a repeated word. Needs a
+    full channel
+*/
+void RPI_DmaCbFill2D( rpi_dma_cb_t* cb, void* dest, int dest_pitch, uint32_t value,
+                      uint32_t width_bytes, uint32_t height )
+{
+    int16_t dest_stride = dest_pitch - (int)width_bytes;
+
+    cb->ti = DMA_FILL_TI | RPI_DMA_TI_TDMODE;
+    cb->source_ad = RPI_PhysToBus( &cb->fill );
+    cb->dest_ad = RPI_PhysToBus( dest );
+    cb->txfr_len = ( ( height - 1 ) << 16 ) | ( width_bytes & 0xFFFF );
+    cb->stride = (uint16_t)dest_stride << 16;
+    cb->fill = value;
+}
+
+
+/**
+    @brief Describe a rectangular copy of height rows of width_bytes between two surfaces with
+    their own pitches. Needs a full channel
+
+    The strides are what's added to the addresses after each row, so they're the pitch minus the
+    row length and may be negative to flip the copy vertically.
+*/
+void RPI_DmaCb2D( rpi_dma_cb_t* cb, void* dest, int dest_pitch, const void* src, int src_pitch,
+                  uint32_t width_bytes, uint32_t height )
+{
+    int16_t dest_stride = dest_pitch - (int)width_bytes;
+    int16_t src_stride = src_pitch - (int)width_bytes;
+
+    cb->ti = DMA_MEMCPY_TI | RPI_DMA_TI_TDMODE;
+    cb->source_ad = RPI_PhysToBus( src );
+    cb->dest_ad = RPI_PhysToBus( dest );
+
+    /* The engine does YLENGTH + 1 rows */
+    cb->txfr_len = ( ( height - 1 ) << 16 ) | ( width_bytes & 0xFFFF );
+    cb->stride = ( (uint16_t)dest_stride << 16 ) | (uint16_t)src_stride;
+}
+
+
+/**
+    @brief Describe writing to a peripheral's FIFO, paced by the peripheral's DREQ so the FIFO
+    never overflows
+*/
+void RPI_DmaCbToPeripheral( rpi_dma_cb_t* cb, volatile void* fifo, const void* src, uint32_t bytes,
+                            rpi_dma_dreq_t dreq )
+{
+    cb->ti = RPI_DMA_TI_SRC_INC | RPI_DMA_TI_DEST_DREQ | RPI_DMA_TI_WAIT_RESP |
+             RPI_DMA_TI_PERMAP( dreq );
+    cb->source_ad = RPI_PhysToBus( src );
+    cb->dest_ad = RPI_PeripheralToBus( fifo );
+    cb->txfr_len = bytes;
+    cb->stride = 0;
+}
+
+
+/**
+    @brief Describe reading from a peripheral's FIFO, paced by the peripheral's DREQ so the FIFO
+    is only read when it has data
+*/
+void RPI_DmaCbFromPeripheral( rpi_dma_cb_t* cb, void* dest, volatile void* fifo, uint32_t bytes,
+                              rpi_dma_dreq_t dreq )
+{
+    cb->ti = RPI_DMA_TI_DEST_INC | RPI_DMA_TI_SRC_DREQ | RPI_DMA_TI_WAIT_RESP |
+             RPI_DMA_TI_PERMAP( dreq );
+    cb->source_ad = RPI_PeripheralToBus( fifo );
+    cb->dest_ad = RPI_PhysToBus( dest );
+    cb->txfr_len = bytes;
+    cb->stride = 0;
+}
+
+
+/**
+    @brief Have the engine load next when it's finished with cb. NULL ends the chain
+*/
+void RPI_DmaCbChain( rpi_dma_cb_t* cb, rpi_dma_cb_t* next )
+{
+    cb->nextconbk = next ? RPI_PhysToBus( next ) : 0;
+}
+
+
+/**
+    @brief Start a chain of control blocks on a channel
+    @param callback If not NULL, called from the DMA interrupt when the chain has completed
+
+    The channel must be idle.
+*/
+void RPI_DmaStart( int channel, rpi_dma_cb_t* cb, rpi_dma_callback_t callback, void* arg )
+{
+    rpi_dma_channel_t* dma = dma_channel( channel );
+    rpi_dma_cb_t* last = cb;
+
+    channels[channel].callback = callback;
+    channels[channel].arg = arg;
+
+    while( last->nextconbk )
+        last = cb_from_bus( last->nextconbk );
+
+    /* The chain may have been started with a callback before, so make sure a polled chain doesn't
+       raise an interrupt nobody will acknowledge */
+    if( callback )
+    {
+        last->ti |= RPI_DMA_TI_INTEN;
+        RPI_AtomicFetchOr( &irq_channels, 1 << channel );
+    }
+    else
+    {
+        last->ti &= ~RPI_DMA_TI_INTEN;
+    }
+
+    /* The control blocks are uncached but may still be sitting in the write buffer */
+    RPI_DataSyncBarrier();
+
+    dma->cs = RPI_DMA_CS_END | RPI_DMA_CS_INT;
+    dma->debug = DMA_DEBUG_ERRORS;
+    dma->conblk_ad = RPI_PhysToBus( cb );
+    dma->cs = DMA_START_CS;
+}
+
+
+int RPI_DmaBusy( int channel )
+{
+    return ( dma_channel( channel )->cs & RPI_DMA_CS_ACTIVE ) != 0;
+}
+
+
+/**
+    @brief Wait for a channel to finish its chain
+    @return 0 on success, -1 if the engine reported an error
+*/
+int RPI_DmaWait( int channel )
+{
+    rpi_dma_channel_t* dma = dma_channel( channel );
+
+    while( dma->cs & RPI_DMA_CS_ACTIVE )
+    {
+        if( dma->cs & RPI_DMA_CS_ERROR )
+            break;
+    }
+
+    /* Make sure the CPU doesn't read the destination before the engine has written it */
+    RPI_DataMemoryBarrier();
+
+    return ( ( dma->cs & RPI_DMA_CS_ERROR ) || ( dma->debug & DMA_DEBUG_ERRORS ) ) ? -1 : 0;
+}
+
+
+/**
+    @brief Stop a channel part way through a transfer and reset it
+*/
+void RPI_DmaAbort( int channel )
+{
+    rpi_dma_channel_t* dma = dma_channel( channel );
+    int timeout = DMA_ABORT_TIMEOUT;
+
+    RPI_AtomicFetchAnd( &irq_channels, ~( 1 << channel ) );
+    channels[channel].callback = NULL;
+
+    if( dma->cs & RPI_DMA_CS_ACTIVE )
+    {
+        /* Pause the channel and let the writes it has in flight complete before resetting it */
+        dma->cs = 0;
+
+        while( ( dma->cs & RPI_DMA_CS_WAITING_FOR_OUTSTANDING_WRITES ) && --timeout ) { }
+    }
+
+    dma->cs = RPI_DMA_CS_RESET;
+    dma->debug = DMA_DEBUG_ERRORS;
+}
+
+
+/* A chain is finished when the channel goes idle, or when it stops with an error */
+static inline int dma_finished( uint32_t cs )
+{
+    return ( ( cs & RPI_DMA_CS_ACTIVE ) == 0 ) || ( cs & RPI_DMA_CS_ERROR );
+}
+
+
+/* Acknowledge a channel's interrupt and, if its chain has finished, run its callback. Called with
+   IRQs disabled */
+static void dma_service( int channel )
+{
+    rpi_dma_channel_t* dma = dma_channel( channel );
+    uint32_t cs = dma->cs;
+
+    /* Clear the interrupt without touching the active bit */
+    dma->cs = ( cs & ~RPI_DMA_CS_END ) | RPI_DMA_CS_INT;
+
+    /* A channel that has stopped on an error can still be active, and never will finish */
+    if( dma_finished( cs ) )
+    {
+        rpi_dma_callback_t callback = channels[channel].callback;
+        int error = ( ( cs & RPI_DMA_CS_ERROR ) || ( dma->debug & DMA_DEBUG_ERRORS ) );
+
+        if( cs & RPI_DMA_CS_ACTIVE )
+        {
+            RPI_DmaAbort( channel );
+        }
+        else
+        {
+            RPI_AtomicFetchAnd( &irq_channels, ~( 1 << channel ) );
+            channels[channel].callback = NULL;
+        }
+
+        RPI_DataMemoryBarrier();
+
+        if( callback )
+            callback( channel, error ? -1 : 0, channels[channel].arg );
+    }
+}
+
+
+/**
+    @brief Service the DMA completion interrupts
+    @return The number of channels serviced, 0 if none of our channels had interrupted
+
+    Called from the IRQ handler. Channels the VideoCore owns also show up in the interrupt status,
+    so only channels with a callback waiting are looked at.
+*/
+int RPI_DmaInterruptHandler( void )
+{
+    uint32_t pending = *dma_int_status & RPI_AtomicLoad( &irq_channels );
+    int serviced = 0;
+
+    while( pending )
+    {
+        dma_service( __builtin_ctz( pending ) );
+        pending &= pending - 1;
+        serviced++;
+    }
+
+    return serviced;
+}
+
+
+/**
+    @brief Run a finished channel's callback now rather than waiting for its interrupt
+    @return 1 if the channel had finished and its callback has been run, 0 otherwise
+
+    For code that has to wait for a transfer in a context where the interrupt may not be taken.
+*/
+int RPI_DmaPoll( int channel )
+{
+    uint32_t cpsr = RPI_IrqSaveDisable();
+    int finished = 0;
+
+    if( ( RPI_AtomicLoad( &irq_channels ) & ( 1 << channel ) ) &&
+        dma_finished( dma_channel( channel )->cs ) )
+    {
+        dma_service( channel );
+        finished = 1;
+    }
+
+    RPI_IrqRestore( cpsr );
+
+    return finished;
+}
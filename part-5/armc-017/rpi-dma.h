@@ -0,0 +1,173 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_DMA_H
+#define RPI_DMA_H
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+#include "rpi-spinlock.h"
+
+/** @brief See Section 4 of the BCM2835 ARM Peripherals documentation. Channels 0 to 14 are at
+    0x100 byte intervals from the base. Channel 15 is elsewhere and isn't used */
+#define RPI_DMA_BASE                ( PERIPHERAL_BASE + 0x7000 )
+#define RPI_DMA_INT_STATUS          ( RPI_DMA_BASE + 0xFE0 )
+#define RPI_DMA_ENABLE              ( RPI_DMA_BASE + 0xFF0 )
+
+/** @brief The channels this driver can drive. The BCM2711's channels 11 to 14 are DMA4 engines
+    with a different control block layout */
+#if defined( RPI4 )
+#define RPI_DMA_CHANNEL_COUNT       11
+#else
+#define RPI_DMA_CHANNEL_COUNT       15
+#endif
+
+/** @brief Control/status register bits */
+#define RPI_DMA_CS_ACTIVE           ( 1 << 0 )
+#define RPI_DMA_CS_END              ( 1 << 1 )      /**< Write 1 to clear */
+#define RPI_DMA_CS_INT              ( 1 << 2 )      /**< Write 1 to clear */
+#define RPI_DMA_CS_DREQ             ( 1 << 3 )
+#define RPI_DMA_CS_PAUSED           ( 1 << 4 )
+#define RPI_DMA_CS_WAITING_FOR_OUTSTANDING_WRITES ( 1 << 6 )   /**< Status, see below for control */
+#define RPI_DMA_CS_ERROR            ( 1 << 8 )
+#define RPI_DMA_CS_PRIORITY( x )    ( ( ( x ) & 0xF ) << 16 )
+#define RPI_DMA_CS_PANIC_PRIORITY( x ) ( ( ( x ) & 0xF ) << 20 )
+#define RPI_DMA_CS_WAIT_FOR_OUTSTANDING_WRITES ( 1 << 28 )      /**< Control, for starting */
+#define RPI_DMA_CS_DISDEBUG         ( 1 << 29 )
+#define RPI_DMA_CS_ABORT            ( 1 << 30 )
+#define RPI_DMA_CS_RESET            ( 1 << 31 )
+
+/** @brief Transfer information bits of a control block */
+#define RPI_DMA_TI_INTEN            ( 1 << 0 )
+#define RPI_DMA_TI_TDMODE           ( 1 << 1 )      /**< 2D mode, not available on lite channels */
+#define RPI_DMA_TI_WAIT_RESP        ( 1 << 3 )
+#define RPI_DMA_TI_DEST_INC         ( 1 << 4 )
+#define RPI_DMA_TI_DEST_WIDTH       ( 1 << 5 )      /**< 128-bit writes */
+#define RPI_DMA_TI_DEST_DREQ        ( 1 << 6 )
+#define RPI_DMA_TI_DEST_IGNORE      ( 1 << 7 )
+#define RPI_DMA_TI_SRC_INC          ( 1 << 8 )
+#define RPI_DMA_TI_SRC_WIDTH        ( 1 << 9 )      /**< 128-bit reads */
+#define RPI_DMA_TI_SRC_DREQ         ( 1 << 10 )
+#define RPI_DMA_TI_SRC_IGNORE       ( 1 << 11 )
+#define RPI_DMA_TI_BURST_LENGTH( x ) ( ( ( x ) & 0xF ) << 12 )
+#define RPI_DMA_TI_PERMAP( x )      ( ( ( x ) & 0x1F ) << 16 )
+#define RPI_DMA_TI_WAITS( x )       ( ( ( x ) & 0x1F ) << 21 )
+#define RPI_DMA_TI_NO_WIDE_BURSTS   ( 1 << 26 )
+
+/** @brief Debug register bits */
+#define RPI_DMA_DEBUG_READ_LAST_NOT_SET_ERROR   ( 1 << 0 )
+#define RPI_DMA_DEBUG_FIFO_ERROR                ( 1 << 1 )
+#define RPI_DMA_DEBUG_READ_ERROR                ( 1 << 2 )
+#define RPI_DMA_DEBUG_LITE                      ( 1 << 28 )
+
+/** @brief The longest transfer a control block can describe. Lite channels and the X length of a
+    2D transfer only have 16 bits of length */
+#define RPI_DMA_MAX_LENGTH          ( 0x3FFFFFFF )
+#define RPI_DMA_LITE_MAX_LENGTH     ( 0xFFFF )
+#define RPI_DMA_MAX_2D_HEIGHT       ( 0x4000 )
+
+/** @brief The peripheral DREQ signals that can pace a transfer, see the PERMAP field */
+typedef enum {
+    RPI_DMA_DREQ_NONE = 0,
+    RPI_DMA_DREQ_DSI = 1,
+    RPI_DMA_DREQ_PCM_TX = 2,
+    RPI_DMA_DREQ_PCM_RX = 3,
+    RPI_DMA_DREQ_SMI = 4,
+    RPI_DMA_DREQ_PWM = 5,
+    RPI_DMA_DREQ_SPI_TX = 6,
+    RPI_DMA_DREQ_SPI_RX = 7,
+    RPI_DMA_DREQ_BSC_SPI_TX = 8,
+    RPI_DMA_DREQ_BSC_SPI_RX = 9,
+    RPI_DMA_DREQ_EMMC = 11,
+    RPI_DMA_DREQ_UART_TX = 12,
+    RPI_DMA_DREQ_SD_HOST = 13,
+    RPI_DMA_DREQ_UART_RX = 14,
+    RPI_DMA_DREQ_DSI2 = 15,
+    RPI_DMA_DREQ_SLIMBUS_MCTX = 16,
+    RPI_DMA_DREQ_HDMI = 17,
+    RPI_DMA_DREQ_SLIMBUS_MCRX = 18,
+    } rpi_dma_dreq_t;
+
+/** @brief Flags for RPI_DmaAllocChannel() */
+#define RPI_DMA_CHANNEL_ANY         0
+#define RPI_DMA_CHANNEL_FULL        ( 1 << 0 )      /**< Not a lite channel, so 2D capable */
+
+/** @brief A channel's register set */
+typedef struct {
+    rpi_reg_rw_t cs;
+    rpi_reg_rw_t conblk_ad;
+    rpi_reg_ro_t ti;
+    rpi_reg_ro_t source_ad;
+    rpi_reg_ro_t dest_ad;
+    rpi_reg_ro_t txfr_len;
+    rpi_reg_ro_t stride;
+    rpi_reg_ro_t nextconbk;
+    rpi_reg_rw_t debug;
+    } rpi_dma_channel_t;
+
+/** @brief A control block. The DMA engine reads these from memory, so they must be 32 byte aligned
+    and every address in them is a bus address. The last two words are ignored by the hardware, the
+    pools use one to link free blocks and fills use the other as their source */
+typedef struct rpi_dma_cb_t {
+    uint32_t ti;
+    uint32_t source_ad;
+    uint32_t dest_ad;
+    uint32_t txfr_len;
+    uint32_t stride;
+    uint32_t nextconbk;
+    struct rpi_dma_cb_t* next_free;
+    uint32_t fill;
+    } rpi_dma_cb_t __attribute__((aligned(32)));
+
+/** @brief A pool of control blocks in coherent memory, so they need no cache maintenance */
+typedef struct {
+    rpi_dma_cb_t* blocks;
+    rpi_dma_cb_t* free;
+    int count;
+    int available;
+    rpi_spinlock_t lock;
+    } rpi_dma_cb_pool_t;
+
+/** @brief Called from the DMA interrupt handler when a transfer started with a callback ends */
+typedef void (*rpi_dma_callback_t)( int channel, int error, void* arg );
+
+extern void RPI_DmaInit( void );
+extern uint32_t RPI_DmaGetChannelMask( void );
+extern int RPI_DmaAllocChannel( int flags );
+extern void RPI_DmaFreeChannel( int channel );
+extern int RPI_DmaIsLite( int channel );
+
+extern int RPI_DmaCbPoolInit( rpi_dma_cb_pool_t* pool, int count );
+extern void RPI_DmaCbPoolFree( rpi_dma_cb_pool_t* pool );
+extern rpi_dma_cb_t* RPI_DmaCbAlloc( rpi_dma_cb_pool_t* pool );
+extern void RPI_DmaCbFree( rpi_dma_cb_pool_t* pool, rpi_dma_cb_t* cb );
+extern void RPI_DmaCbFreeChain( rpi_dma_cb_pool_t* pool, rpi_dma_cb_t* cb );
+
+extern void RPI_DmaCbMemcpy( rpi_dma_cb_t* cb, void* dest, const void* src, uint32_t bytes );
+extern void RPI_DmaCbFill( rpi_dma_cb_t* cb, void* dest, uint32_t value, uint32_t bytes );
+extern void RPI_DmaCbFill2D( rpi_dma_cb_t* cb, void* dest, int dest_pitch, uint32_t value,
+                             uint32_t width_bytes, uint32_t height );
+extern void RPI_DmaCb2D( rpi_dma_cb_t* cb, void* dest, int dest_pitch, const void* src,
+                         int src_pitch, uint32_t width_bytes, uint32_t height );
+extern void RPI_DmaCbToPeripheral( rpi_dma_cb_t* cb, volatile void* fifo, const void* src,
+                                   uint32_t bytes, rpi_dma_dreq_t dreq );
+extern void RPI_DmaCbFromPeripheral( rpi_dma_cb_t* cb, void* dest, volatile void* fifo,
+                                     uint32_t bytes, rpi_dma_dreq_t dreq );
+extern void RPI_DmaCbChain( rpi_dma_cb_t* cb, rpi_dma_cb_t* next );
+
+extern void RPI_DmaStart( int channel, rpi_dma_cb_t* cb, rpi_dma_callback_t callback, void* arg );
+extern int RPI_DmaBusy( int channel );
+extern int RPI_DmaWait( int channel );
+extern void RPI_DmaAbort( int channel );
+extern int RPI_DmaPoll( int channel );
+extern int RPI_DmaInterruptHandler( void );
+
+#endif
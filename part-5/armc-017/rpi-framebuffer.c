@@ -9,27 +9,190 @@
 */
 
 /* Implements functions that allow us to negotiate, and use a graphics
-   framebuffer provided by the VideoCore IV GPU using the mailbox interface. */
+   framebuffer provided by the VideoCore IV GPU using the mailbox interface.
+
+   The framebuffer is uncached, so filling and copying into it with the CPU is slow. The
+   RPI_Queue* functions hand clears and rectangle copies to a DMA channel instead and return
+   straight away, so the CPU can get on with something else. Queued operations run in order and
+   RPI_FramebufferFence() waits for them all to finish. The CPU mustn't draw over a region with a
+   queued operation, or change the source of a queued copy, until after the fence.
+   RPI_SwitchFramebuffer() fences before it flips. The queued operations always target the
+   framebuffer's back buffer.
+
+   RPI_Present() only queues the copy of a finished frame, and the frame is shown by the next
+   RPI_Present() or RPI_SwitchFramebuffer(). Rendering the next frame into a second surface while
+   the DMA copies the last one is where the time is saved.
+
+   The drawing functions draw into a surface (see surface.h), which is the back buffer unless
+   another has been set with RPI_SetDrawSurface(). Drawing into a cached surface and presenting it
+   with RPI_Present() is much faster than drawing into the framebuffer for anything that reads
+   what it has drawn, and writes the uncached memory once per frame in whole rows.
+
+   While a display list is set with RPI_SetDrawList() the drawing functions record into the list
+   instead of drawing (see tile-render.c). Anything a recorded blit points at has to stay put until
+   the list has been rendered.
+
+   RPI_InitScrolling() trades double buffering for hardware scrolling. The virtual framebuffer is
+   made twice the physical size in each scrolling direction and holds the world twice over, so
+   whatever the scroll position the visible window is a plain rectangle of the virtual framebuffer.
+   Scrolling only draws the newly exposed rows and columns, copies them to their mirror with the
+   DMA and moves the virtual offset - the rest of the screen isn't touched. */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "blit-convert.h"
+#include "frame-arena.h"
+#include "rpi-cache.h"
+#include "rpi-dma.h"
 #include "rpi-gpio.h"
+#include "rpi-interrupts.h"
 #include "rpi-mailbox-interface.h"
 #include "rpi-framebuffer.h"
 #include "image.h"
+#include "surface.h"
+#include "tile-render.h"
+
+/** @brief The number of control blocks for queued operations. When they've all been queued the next
+    operation waits for the queue to finish */
+#define FB_DMA_CB_COUNT     256
+
+/* The DMA queue. Queued operations are chained together until the channel is free, then the whole
+   chain is started and the next chain builds up behind it */
+typedef struct {
+    int channel;
+    rpi_dma_cb_pool_t pool;
+    rpi_dma_cb_t* queued;
+    rpi_dma_cb_t* queued_tail;
+    rpi_dma_cb_t* volatile running;
+    uint32_t errors;
+    } framebuffer_dma_t;
 
 static framebuffer_info_t framebuffer = {0};
+static framebuffer_dma_t fb_dma = { .channel = -1 };
 
-void RPI_InitFramebuffer( int width, int height, int bpp )
+/* The 8bpp palette, kept so it can be animated and uploaded again after a reallocation */
+static palette_entry_t palette[RPI_PALETTE_SIZE];
+static int palette_set = 0;
+
+/* Draws the newly exposed parts of the world when scrolling */
+static rpi_scroll_draw_t scroll_draw = NULL;
+static void* scroll_arg = NULL;
+
+/* Where the RPI_* drawing functions draw, NULL for the framebuffer's back buffer */
+static surface_t* draw_surface = NULL;
+
+/* The display list the RPI_* drawing functions record into, NULL to draw straight away */
+static tile_list_t* draw_list = NULL;
+
+/* A surface has been presented and its copy queued to the back buffer, which is shown by the next
+   RPI_Present() or RPI_SwitchFramebuffer() */
+static int present_pending = 0;
+
+static void fb_dma_kick( void );
+
+
+/* Called when a chain has finished, from the DMA interrupt or RPI_DmaPoll() */
+static void fb_dma_complete( int channel, int error, void* arg )
+{
+    RPI_DmaCbFreeChain( &fb_dma.pool, fb_dma.running );
+    fb_dma.running = NULL;
+
+    if( error )
+        fb_dma.errors++;
+
+    fb_dma_kick();
+}
+
+
+/* Start the queued chain if the channel is free. Called with IRQs disabled */
+static void fb_dma_kick( void )
+{
+    if( ( fb_dma.running != NULL ) || ( fb_dma.queued == NULL ) )
+        return;
+
+    fb_dma.running = fb_dma.queued;
+    fb_dma.queued = NULL;
+    fb_dma.queued_tail = NULL;
+
+    RPI_DmaStart( fb_dma.channel, fb_dma.running, fb_dma_complete, NULL );
+}
+
+
+/* Get a control block for an operation, or NULL if the operation has to be done by the CPU */
+static rpi_dma_cb_t* fb_dma_alloc( void )
+{
+    rpi_dma_cb_t* cb;
+
+    if( fb_dma.channel < 0 )
+        return NULL;
+
+    while( ( cb = RPI_DmaCbAlloc( &fb_dma.pool ) ) == NULL )
+        RPI_FramebufferFence();
+
+    return cb;
+}
+
+
+static void fb_dma_queue( rpi_dma_cb_t* cb )
+{
+    uint32_t cpsr = RPI_IrqSaveDisable();
+
+    if( fb_dma.queued_tail )
+        RPI_DmaCbChain( fb_dma.queued_tail, cb );
+    else
+        fb_dma.queued = cb;
+
+    fb_dma.queued_tail = cb;
+    fb_dma_kick();
+
+    RPI_IrqRestore( cpsr );
+}
+
+
+/* Replicate a colour across a word for the fills */
+static uint32_t fill_word( int colour )
+{
+    if( framebuffer.bits_per_pixel == 8 )
+        return ( colour & 0xFF ) * 0x01010101;
+    else if( framebuffer.bits_per_pixel == 16 )
+        return ( colour & 0xFFFF ) * 0x00010001;
+
+    return colour;
+}
+
+
+/* The CPU fallback for the fills, when there's no DMA channel */
+static void cpu_fill( uint8_t* dest, int pitch, uint32_t value, int width_bytes, int height )
+{
+    for( int y = 0; y < height; y++ )
+    {
+        uint8_t* row = dest + ( y * pitch );
+
+        for( int b = 0; b < width_bytes; b++ )
+            row[b] = value >> ( ( b & 3 ) * 8 );
+    }
+}
+
+/* Ask the VideoCore for a framebuffer with a physical size of width x height. The virtual size is
+   twice the height for double buffering or vertical scrolling, and twice the width as well for
+   horizontal scrolling */
+static int framebuffer_allocate( int width, int height, int bpp )
 {
     rpi_mailbox_property_t *mp;
+    int virtual_width = width;
+
+    if( framebuffer.scroll_flags & RPI_SCROLL_HORIZONTAL )
+        virtual_width = width * 2;
+
+    framebuffer.buffers[0] = NULL;
+    framebuffer.buffers[1] = NULL;
 
     RPI_PropertyInit();
-    RPI_PropertyAddTag( TAG_ALLOCATE_BUFFER );
+    RPI_PropertyAddTag( TAG_ALLOCATE_BUFFER, 16 );
     RPI_PropertyAddTag( TAG_SET_PHYSICAL_SIZE, width, height );
-    RPI_PropertyAddTag( TAG_SET_VIRTUAL_SIZE, width, height * 2 );
+    RPI_PropertyAddTag( TAG_SET_VIRTUAL_SIZE, virtual_width, height * 2 );
     RPI_PropertyAddTag( TAG_SET_DEPTH, bpp );
     RPI_PropertyAddTag( TAG_GET_PITCH );
     RPI_PropertyAddTag( TAG_GET_PHYSICAL_SIZE );
@@ -70,7 +233,7 @@ void RPI_InitFramebuffer( int width, int height, int bpp )
 
     if( ( mp = RPI_PropertyGet( TAG_ALLOCATE_BUFFER ) ) )
     {
-        framebuffer.buffers[0] = (volatile uint32_t*)(mp->data.buffer_32[0] & ~0xC0000000);
+        framebuffer.buffers[0] = (volatile uint32_t*)RPI_BusToPhys( mp->data.buffer_32[0] );
 
         /* The second framebuffer for double buffering is at the following address */
         framebuffer.buffers[1] = framebuffer.buffers[0] + framebuffer.buffer_size;
@@ -78,15 +241,206 @@ void RPI_InitFramebuffer( int width, int height, int bpp )
         /* Start by displaying the current buffer */
         framebuffer.current_buffer = framebuffer.buffers[0];
 
+        for( int b = 0; b < 2; b++ )
+        {
+            SURFACE_Init( &framebuffer.surfaces[b],
+                          framebuffer.physical_width,
+                          framebuffer.physical_height,
+                          framebuffer.pitch,
+                          SURFACE_FormatFromDepth( framebuffer.bits_per_pixel ),
+                          (void*)framebuffer.buffers[b],
+                          0 );
+        }
+
+        framebuffer.current_surface = &framebuffer.surfaces[0];
+
         printf( "Framebuffer addresses: 0x%8.8X 0x%8.8X\r\n",
                 (unsigned int)framebuffer.buffers[0],
                 (unsigned int)framebuffer.buffers[1] );
     }
+
+    return ( framebuffer.buffers[0] != NULL ) ? 0 : -1;
 }
 
 
-void RPI_SwitchFramebuffer( void )
+/* The physical size for a display dimension at the current scale. Keep it a multiple of four so
+   every depth has whole words per row */
+static int framebuffer_scaled( int size )
+{
+    return ( ( size * framebuffer.scale ) / 100 ) & ~3;
+}
+
+
+void RPI_InitFramebuffer( int width, int height, int bpp )
+{
+    framebuffer.display_width = width;
+    framebuffer.display_height = height;
+
+    if( framebuffer.scale == 0 )
+        framebuffer.scale = RPI_FB_SCALE_NATIVE;
+
+    framebuffer_allocate( framebuffer_scaled( width ), framebuffer_scaled( height ), bpp );
+
+    /* Clears and blits are done with a 2D capable DMA channel when we can get one */
+    if( fb_dma.channel < 0 )
+    {
+        fb_dma.channel = RPI_DmaAllocChannel( RPI_DMA_CHANNEL_FULL );
+
+        if( ( fb_dma.channel >= 0 ) && ( RPI_DmaCbPoolInit( &fb_dma.pool, FB_DMA_CB_COUNT ) != 0 ) )
+        {
+            RPI_DmaFreeChannel( fb_dma.channel );
+            fb_dma.channel = -1;
+        }
+
+        if( fb_dma.channel >= 0 )
+            printf( "Framebuffer DMA channel: %d\r\n", fb_dma.channel );
+        else
+            printf( "Framebuffer DMA unavailable, using the CPU\r\n" );
+    }
+}
+
+
+/**
+    @brief Wait for every queued framebuffer operation to finish
+*/
+void RPI_FramebufferFence( void )
+{
+    while( fb_dma.running || fb_dma.queued )
+    {
+        /* Don't depend on the completion interrupt being taken, the fence may be waited on with
+           interrupts disabled */
+        RPI_DmaPoll( fb_dma.channel );
+    }
+}
+
+
+/**
+    @brief Queue filling a rectangle of the current buffer with a colour
+*/
+void RPI_QueueFillRectangle( int x, int y, int width, int height, int colour )
+{
+    uint8_t* dest;
+    rpi_dma_cb_t* cb;
+
+    if( x < 0 )
+    {
+        width += x;
+        x = 0;
+    }
+
+    if( y < 0 )
+    {
+        height += y;
+        y = 0;
+    }
+
+    if( ( x + width ) > framebuffer.physical_width )
+        width = framebuffer.physical_width - x;
+    if( ( y + height ) > framebuffer.physical_height )
+        height = framebuffer.physical_height - y;
+
+    if( ( width <= 0 ) || ( height <= 0 ) )
+        return;
+
+    dest = (uint8_t*)framebuffer.current_buffer + ( y * framebuffer.pitch ) +
+           ( x * framebuffer.bytes_per_pixel );
+
+    if( ( cb = fb_dma_alloc() ) == NULL )
+    {
+        cpu_fill( dest, framebuffer.pitch, fill_word( colour ), width * framebuffer.bytes_per_pixel, height );
+        return;
+    }
+
+    RPI_DmaCbFill2D( cb, dest, framebuffer.pitch, fill_word( colour ),
+                     width * framebuffer.bytes_per_pixel, height );
+    fb_dma_queue( cb );
+}
+
+
+/**
+    @brief Queue copying a rectangle of pixels to the current buffer
+    @param data The top left pixel of the source, which must be the same depth as the framebuffer
+    @param pitch The distance in bytes between the source's rows
+
+    The source is cleaned from the data cache when the copy is queued.
+*/
+void RPI_QueueBlitRectangle( int x, int y, const void* data, int pitch, int width, int height )
+{
+    const uint8_t* src = data;
+    uint8_t* dest;
+    rpi_dma_cb_t* cb;
+    int width_bytes;
+
+    if( x < 0 )
+    {
+        src -= x * framebuffer.bytes_per_pixel;
+        width += x;
+        x = 0;
+    }
+
+    if( y < 0 )
+    {
+        src -= y * pitch;
+        height += y;
+        y = 0;
+    }
+
+    if( ( x + width ) > framebuffer.physical_width )
+        width = framebuffer.physical_width - x;
+    if( ( y + height ) > framebuffer.physical_height )
+        height = framebuffer.physical_height - y;
+
+    if( ( width <= 0 ) || ( height <= 0 ) )
+        return;
+
+    width_bytes = width * framebuffer.bytes_per_pixel;
+    dest = (uint8_t*)framebuffer.current_buffer + ( y * framebuffer.pitch ) +
+           ( x * framebuffer.bytes_per_pixel );
+
+    if( ( cb = fb_dma_alloc() ) == NULL )
+    {
+        for( int row = 0; row < height; row++ )
+            memcpy( dest + ( row * framebuffer.pitch ), src + ( row * pitch ), width_bytes );
+
+        return;
+    }
+
+    RPI_CacheCleanRange( src, ( ( height - 1 ) * pitch ) + width_bytes );
+    RPI_DmaCb2D( cb, dest, framebuffer.pitch, src, pitch, width_bytes, height );
+    fb_dma_queue( cb );
+}
+
+
+/**
+    @brief Queue clearing the whole of the current buffer to a colour
+*/
+void RPI_QueueClearScreen( int colour )
+{
+    rpi_dma_cb_t* cb;
+
+    if( ( cb = fb_dma_alloc() ) == NULL )
+    {
+        cpu_fill( (uint8_t*)framebuffer.current_buffer, framebuffer.buffer_size,
+                  fill_word( colour ), framebuffer.buffer_size, 1 );
+        return;
+    }
+
+    RPI_DmaCbFill( cb, (void*)framebuffer.current_buffer, fill_word( colour ), framebuffer.buffer_size );
+    fb_dma_queue( cb );
+}
+
+
+/* Show the back buffer and make the other buffer the back buffer */
+static void framebuffer_flip( void )
 {
+    /* Don't show a buffer that's still being drawn by the DMA */
+    RPI_FramebufferFence();
+    present_pending = 0;
+
+    /* When scrolling there's only the one buffer, and it's always on screen */
+    if( framebuffer.scroll_flags )
+        return;
+
     if( framebuffer.current_buffer == framebuffer.buffers[0] )
     {
         /* We've been drawing to buffer 0 - so now show that on the screen and flip the graphics
@@ -96,6 +450,7 @@ void RPI_SwitchFramebuffer( void )
         RPI_PropertyProcess();
 
         framebuffer.current_buffer = framebuffer.buffers[1];
+        framebuffer.current_surface = &framebuffer.surfaces[1];
     }
     else
     {
@@ -104,21 +459,166 @@ void RPI_SwitchFramebuffer( void )
         RPI_PropertyProcess();
 
         framebuffer.current_buffer = framebuffer.buffers[0];
+        framebuffer.current_surface = &framebuffer.surfaces[0];
     }
 }
 
 
+void RPI_SwitchFramebuffer( void )
+{
+    framebuffer_flip();
+
+    /* The frame's finished with, so is its scratch memory */
+    ARENA_EndFrame();
+}
+
+
 framebuffer_info_t* RPI_GetFramebuffer( void )
 {
     return &framebuffer;
 }
 
 
+/* Give the framebuffer back and allocate it again after a change of scale or scrolling mode */
+static int framebuffer_reallocate( void )
+{
+    RPI_FramebufferFence();
+
+    present_pending = 0;
+
+    RPI_PropertyInit();
+    RPI_PropertyAddTag( TAG_RELEASE_BUFFER );
+    RPI_PropertyProcess();
+
+    if( framebuffer_allocate( framebuffer_scaled( framebuffer.display_width ),
+                              framebuffer_scaled( framebuffer.display_height ),
+                              framebuffer.bits_per_pixel ) != 0 )
+        return -1;
+
+    /* A new buffer comes with the firmware's default palette */
+    if( palette_set && ( framebuffer.bits_per_pixel == 8 ) )
+        RPI_SetPalette( 0, RPI_PALETTE_SIZE, palette );
+
+    if( framebuffer.scroll_flags )
+        RPI_ScrollRedraw();
+
+    return 0;
+}
+
+
+/**
+    @brief Change the number of pixels drawn for the display, trading quality for fill rate
+    @param percent The physical size as a percentage of the display size in each direction, between
+    RPI_FB_SCALE_MIN and RPI_FB_SCALE_MAX. At RPI_FB_SCALE_PERFORMANCE a quarter of the pixels are
+    drawn and the VideoCore's scaler makes them up to the display for free
+    @return 0 on success, -1 if the framebuffer couldn't be allocated at the new size
+
+    The framebuffer is reallocated, so its contents are lost and anything sized from its physical
+    size (like a surface passed to RPI_Present()) must be recreated.
+*/
+int RPI_SetFramebufferScale( int percent )
+{
+    if( percent < RPI_FB_SCALE_MIN )
+        percent = RPI_FB_SCALE_MIN;
+
+    if( percent > RPI_FB_SCALE_MAX )
+        percent = RPI_FB_SCALE_MAX;
+
+    if( percent == framebuffer.scale )
+        return 0;
+
+    framebuffer.scale = percent;
+
+    return framebuffer_reallocate();
+}
+
+
+/**
+    @brief Draw into a surface rather than the framebuffer
+    @param surface The surface the RPI_* drawing functions draw into, or NULL to go back to drawing
+    into the framebuffer's back buffer
+*/
+void RPI_SetDrawSurface( surface_t* surface )
+{
+    draw_surface = surface;
+}
+
+
+/**
+    @brief Return the surface the RPI_* drawing functions draw into
+*/
+surface_t* RPI_GetDrawSurface( void )
+{
+    return draw_surface ? draw_surface : framebuffer.current_surface;
+}
+
+
+/**
+    @brief Record the RPI_* drawing functions into a display list rather than drawing
+    @param list The list to record into, or NULL to go back to drawing into the draw surface
+*/
+void RPI_SetDrawList( tile_list_t* list )
+{
+    draw_list = list;
+}
+
+
+tile_list_t* RPI_GetDrawList( void )
+{
+    return draw_list;
+}
+
+
+/**
+    @brief Queue copying a finished surface to the back buffer, to be shown next
+    @return 0 on success, -1 if the surface can't be converted to the framebuffer's format
+
+    The surface is copied in one streaming pass, by the DMA when there's a channel or with the CPU's
+    burst stores when there isn't, so the uncached framebuffer memory is only ever written in
+    whole rows. A surface of another format is converted into the back buffer by the CPU instead,
+    which is much slower.
+
+    This only queues the copy, the frame presented last time is what's shown now. The next frame
+    can be drawn while the DMA copies this one, as long as it's drawn into another surface - the
+    presented surface mustn't be drawn into until the next RPI_Present() (so alternating between
+    two surfaces needs no waiting) or RPI_FramebufferFence().
+*/
+int RPI_Present( surface_t* surface )
+{
+    if( !BLIT_CanConvert( surface->format, framebuffer.current_surface->format ) )
+        return -1;
+
+    /* The last frame's copy has had this frame to finish */
+    if( present_pending )
+        framebuffer_flip();
+
+    if( surface->format == framebuffer.current_surface->format )
+    {
+        RPI_QueueBlitRectangle( 0, 0, surface->memory, surface->pitch, surface->width,
+                                surface->height );
+    }
+    else
+    {
+        /* Don't convert under anything still queued for the back buffer */
+        RPI_FramebufferFence();
+        BLIT_Convert( framebuffer.current_surface, 0, 0, surface->memory, surface->pitch,
+                      surface->format, surface->width, surface->height, NULL, 0 );
+    }
+
+    present_pending = 1;
+
+    /* The frame's been drawn, so its scratch memory is finished with */
+    ARENA_EndFrame();
+
+    return 0;
+}
+
+
 /**
  * @fn void RPI_BlitV( int x, int y, void* data, int datacount, uint32_t pitch )
  * @brief Vertical pixel blitter. Will blit vertical line of pixels at x,y to x,y+datacount
- * @param x Horizontal pixel location to start blitting into the current framebuffer
- * @param y Vertical pixel location to start blitting into the current framebuffer
+ * @param x Horizontal pixel location to start blitting into the draw surface
+ * @param y Vertical pixel location to start blitting into the draw surface
  * @param data Souce pixel data
  * @param datacount The amount of vertical pixels to blit
  * @param pitch The pitch (in bytes) of the source image to get to the next vertical pixel data
@@ -128,16 +628,29 @@ framebuffer_info_t* RPI_GetFramebuffer( void )
  */
 void RPI_BlitV( int x, int y, void* data, int datacount, uint32_t pitch )
 {
-    if( ( x < 0 ) || ( x >= framebuffer.physical_height) )
+    surface_t* surface = RPI_GetDrawSurface();
+
+    if( draw_list )
+    {
+        TILE_Blit( draw_list, x, y, data, pitch, 1, datacount );
+        return;
+    }
+
+    if( ( x < 0 ) || ( x >= surface->width ) )
         return;
 
     for( int py = 0; py < datacount; py++ )
     {
-        if( ( ( py + y ) >= 0 ) && ( ( py + y ) < framebuffer.physical_height ) )
+        if( ( ( py + y ) >= 0 ) && ( ( py + y ) < surface->height ) )
         {
-            *(short*)(framebuffer.current_buffer +
-                     ( ( py + y ) * framebuffer.pitch ) +
-                     ( x * framebuffer.bytes_per_pixel ) ) = *(unsigned short*)data;
+            uint8_t* pixel = SURFACE_PixelAddress( surface, x, y + py );
+
+            if( surface->bytes_per_pixel == 2 )
+                *(uint16_t*)pixel = *(uint16_t*)data;
+            else if( surface->bytes_per_pixel == 4 )
+                *(uint32_t*)pixel = *(uint32_t*)data;
+            else
+                *pixel = *(uint8_t*)data;
         }
         data += pitch;
     }
@@ -145,80 +658,160 @@ void RPI_BlitV( int x, int y, void* data, int datacount, uint32_t pitch )
 
 void RPI_Blit( int x, int y, void* data, int datacount )
 {
-    if( ( x < 0 ) || ( x >= framebuffer.physical_height) )
+    surface_t* surface = RPI_GetDrawSurface();
+
+    if( draw_list )
+    {
+        TILE_Blit( draw_list, x, y, data, datacount * surface->bytes_per_pixel, datacount, 1 );
         return;
+    }
 
-    if( ( y < 0 ) || ( y >= framebuffer.physical_height ) )
+    if( ( y < 0 ) || ( y >= surface->height ) )
         return;
 
-    /* Splat the data to the screen buffer */
-    memcpy( (char*)framebuffer.current_buffer + ( y * framebuffer.pitch ) + ( x * framebuffer.bytes_per_pixel ),
-            data, datacount * framebuffer.bytes_per_pixel );
+    if( x < 0 )
+    {
+        data += -x * surface->bytes_per_pixel;
+        datacount += x;
+        x = 0;
+    }
+
+    if( ( x + datacount ) > surface->width )
+        datacount = surface->width - x;
+
+    if( datacount <= 0 )
+        return;
+
+    /* Splat the data to the surface */
+    memcpy( SURFACE_PixelAddress( surface, x, y ), data, datacount * surface->bytes_per_pixel );
 }
 
 void RPI_PutPixel( int x, int y, int colour )
 {
-    if( framebuffer.bits_per_pixel == 8 )
+    surface_t* surface = RPI_GetDrawSurface();
+    uint8_t* pixel;
+
+    if( draw_list )
     {
-        *(unsigned char*)(framebuffer.current_buffer + ( y * framebuffer.pitch ) + x ) = colour;
+        TILE_Pixel( draw_list, x, y, colour );
+        return;
     }
-    else if ( framebuffer.bits_per_pixel == 16 )
+
+    if( ( x < 0 ) || ( y < 0 ) || ( x >= surface->width ) || ( y >= surface->height ) )
+        return;
+
+    pixel = SURFACE_PixelAddress( surface, x, y );
+
+    if( surface->bytes_per_pixel == 1 )
+        *pixel = colour;
+    else if ( surface->bytes_per_pixel == 2 )
+        *(uint16_t*)pixel = colour;
+    else
+        *(uint32_t*)pixel = colour;
+}
+
+
+/**
+    @brief Clear the back buffer and wait for it to be cleared. RPI_QueueClearScreen() doesn't wait
+*/
+void RPI_ClearScreen( void )
+{
+    RPI_QueueClearScreen( 0 );
+    RPI_FramebufferFence();
+}
+
+
+/* Record a rectangle as a fill and the four sides of its border */
+static void record_rectangle( graphic_rectangle_t* rectangle )
+{
+    int x = rectangle->position_x;
+    int y = rectangle->position_y;
+    int width = rectangle->width;
+    int height = rectangle->height;
+    int border = rectangle->border;
+    uint32_t border_colour = rectangle->border_colour;
+    uint32_t fill_colour = rectangle->fill_colour;
+
+    if( draw_list->bytes_per_pixel == 1 )
     {
-        *(short*)(framebuffer.current_buffer + ( y * framebuffer.pitch ) + ( x * framebuffer.bytes_per_pixel ) ) = colour;
+        border_colour %= 256;
+        fill_colour %= 256;
     }
-    else if ( framebuffer.bits_per_pixel == 16 )
+
+    if( ( border * 2 >= width ) || ( border * 2 >= height ) )
     {
-        *(unsigned int*)(framebuffer.current_buffer + ( y * framebuffer.pitch ) + x ) = colour;
+        TILE_Rectangle( draw_list, x, y, width, height, border_colour );
+        return;
     }
-    else
+
+    if( border > 0 )
     {
-        printf("RPI_PutPixel Unsupported bits_per_pixel(%d)\r\n", framebuffer.bits_per_pixel );
+        TILE_Rectangle( draw_list, x, y, width, border, border_colour );
+        TILE_Rectangle( draw_list, x, y + height - border, width, border, border_colour );
+        TILE_Rectangle( draw_list, x, y + border, border, height - ( border * 2 ), border_colour );
+        TILE_Rectangle( draw_list, x + width - border, y + border, border, height - ( border * 2 ),
+                        border_colour );
     }
-}
 
-
-void RPI_ClearScreen( void )
-{
-    memset( (char*)framebuffer.current_buffer, 0, framebuffer.buffer_size );
+    TILE_Rectangle( draw_list, x + border, y + border, width - ( border * 2 ),
+                    height - ( border * 2 ), fill_colour );
 }
 
 
 void RPI_DrawRectangle( graphic_rectangle_t* rectangle )
 {
+    if( draw_list )
+    {
+        record_rectangle( rectangle );
+        return;
+    }
+
     int px, py;
-    uint32_t border[rectangle->width];
-    uint32_t line[rectangle->width];
-    uint16_t* short_border = (uint16_t*)&border[0];
-    uint16_t* short_line = (uint16_t*)&line[0];
-    uint8_t* byte_border = (uint8_t*)&border[0];
-    uint8_t* byte_line = (uint8_t*)&line[0];
+    uint32_t mark = ARENA_Mark();
+    int bits_per_pixel = RPI_GetDrawSurface()->bytes_per_pixel * 8;
+    int line_bytes = rectangle->width * RPI_GetDrawSurface()->bytes_per_pixel;
+
+    /* The two lines of pixels we blit come from the frame arena rather than the stack, the
+       rectangle can be as wide as the screen */
+    uint32_t* border = ARENA_Alloc( line_bytes );
+    uint32_t* line = ARENA_Alloc( line_bytes );
+    uint16_t* short_border = (uint16_t*)border;
+    uint16_t* short_line = (uint16_t*)line;
+    uint8_t* byte_border = (uint8_t*)border;
+    uint8_t* byte_line = (uint8_t*)line;
+
+    if( ( border == NULL ) || ( line == NULL ) )
+    {
+        ARENA_Release( mark );
+        return;
+    }
 
     for( px = 0; px < rectangle->width; px++ )
     {
         if( ( px < rectangle->border ) || ( px > ( rectangle->width - rectangle->border - 1) ) )
         {
-            if( framebuffer.bits_per_pixel == 8 )
+            if( bits_per_pixel == 8 )
                 byte_line[px] = rectangle->border_colour % 256;
-            else if(framebuffer.bits_per_pixel == 16 )
+            else if(bits_per_pixel == 16 )
                 short_line[px] = rectangle->border_colour;
-            else if(framebuffer.bits_per_pixel == 32 )
+            else if(bits_per_pixel == 32 )
                 line[px] = rectangle->border_colour;
         }
         else
         {
-            if( framebuffer.bits_per_pixel == 8 )
+            if( bits_per_pixel == 8 )
                 byte_line[px] = rectangle->fill_colour % 256;
-            else if(framebuffer.bits_per_pixel == 16 )
+            else if(bits_per_pixel == 16 )
                 short_line[px] = rectangle->fill_colour;
-            else if(framebuffer.bits_per_pixel == 32 )
+            else if(bits_per_pixel == 32 )
                 line[px] = rectangle->fill_colour;
         }
 
-        if( framebuffer.bits_per_pixel == 8 )
+        if( bits_per_pixel == 8 )
             byte_border[px] = rectangle->border_colour % 256;
-        else if(framebuffer.bits_per_pixel == 16 )
+        else if(bits_per_pixel == 16 )
             short_border[px] = rectangle->border_colour;
-        else if(framebuffer.bits_per_pixel == 32 )
+        else if(bits_per_pixel == 32 )
             border[px] = rectangle->border_colour;
     }
 
@@ -229,6 +822,8 @@ void RPI_DrawRectangle( graphic_rectangle_t* rectangle )
         else
             RPI_Blit( rectangle->position_x, rectangle->position_y + py, line, rectangle->width );
     }
+
+    ARENA_Release( mark );
 }
 
 
@@ -266,32 +861,370 @@ void RPI_DrawMovingRectangle( graphic_moving_rectangle_t* mrectangle )
 }
 
 
+/**
+    @brief Draw an image on the draw surface, converting it if it isn't the surface's format
+
+    8bpp images are drawn with their own palette, or the framebuffer's when they haven't got one.
+    While recording, an image that needs converting is converted into the frame arena so the list
+    has something of its own depth to blit.
+*/
 void RPI_DrawImage( int x, int y, image_t* image )
 {
-    int blit_y = 0;
+    surface_format_t format = SURFACE_FormatFromDepth( image->bytes_per_pixel * 8 );
+
+    if( draw_list )
+    {
+        surface_t converted;
+        uint8_t* pixels;
+
+        if( image->bytes_per_pixel == draw_list->bytes_per_pixel )
+        {
+            TILE_Image( draw_list, x, y, image );
+            return;
+        }
+
+        pixels = ARENA_Alloc( image->width * image->height * draw_list->bytes_per_pixel );
+
+        if( pixels == NULL )
+            return;
+
+        SURFACE_Init( &converted, image->width, image->height,
+                      image->width * draw_list->bytes_per_pixel,
+                      SURFACE_FormatFromDepth( draw_list->bytes_per_pixel * 8 ), pixels, 1 );
 
-    /* NOTE: We only support images that have the same bits-per-pixel as the display. We do not
-             fall back to a slower method. But, we could */
+        if( BLIT_Convert( &converted, 0, 0, image->pixel_data, image->pitch, format,
+                          image->width, image->height, image->palette, 0 ) == 0 )
+            TILE_Blit( draw_list, x, y, pixels, converted.pitch, image->width, image->height );
+
+        return;
+    }
 
-    if( ( RPI_GetFramebuffer()->bits_per_pixel == 16 ) && ( image->bytes_per_pixel == 2 ) )
+    BLIT_Convert( RPI_GetDrawSurface(), x, y, image->pixel_data, image->pitch, format,
+                  image->width, image->height, image->palette, 0 );
+}
+
+
+/**
+    @brief Draw a sprite on the draw surface, skipping its transparent pixels
+    @param alpha A constant alpha from 0 to SPRITE_OPAQUE
+*/
+void RPI_DrawSprite( int x, int y, const sprite_t* sprite, int alpha )
+{
+    if( draw_list )
+        TILE_Sprite( draw_list, x, y, sprite, alpha );
+    else
+        SPRITE_Draw( RPI_GetDrawSurface(), x, y, sprite, alpha );
+}
+
+
+/* Queue copying a rectangle of the framebuffer to somewhere else in the framebuffer */
+static void fb_queue_copy( uint8_t* dest, const uint8_t* src, int width_bytes, int height )
+{
+    rpi_dma_cb_t* cb;
+
+    if( ( cb = fb_dma_alloc() ) == NULL )
     {
-        for( blit_y = 0; blit_y < image->height; blit_y++ )
-            RPI_Blit( x, y + blit_y,
-                     (short*)&image->pixel_data[ blit_y * image->width * image->bytes_per_pixel ],
-                      image->width );
+        for( int y = 0; y < height; y++ )
+            memcpy( dest + ( y * framebuffer.pitch ), src + ( y * framebuffer.pitch ), width_bytes );
+
+        return;
     }
-    else if( ( RPI_GetFramebuffer()->bits_per_pixel == 8 ) && ( image->bytes_per_pixel == 1 ) )
+
+    RPI_DmaCb2D( cb, dest, framebuffer.pitch, src, framebuffer.pitch, width_bytes, height );
+    fb_dma_queue( cb );
+}
+
+
+static int scroll_wrap( int value, int size )
+{
+    value %= size;
+
+    return ( value < 0 ) ? value + size : value;
+}
+
+
+/* Draw a rectangle of the world at its place in the top left copy of the world, and queue copying
+   it to the other copies */
+static void scroll_draw_piece( int x, int y, int width, int height, int world_x, int world_y )
+{
+    const int bpp = framebuffer.bytes_per_pixel;
+    uint8_t* dest = (uint8_t*)framebuffer.buffers[0] + ( y * framebuffer.pitch ) + ( x * bpp );
+    uint8_t* right = dest + ( framebuffer.physical_width * bpp );
+    int below = framebuffer.physical_height * framebuffer.pitch;
+    surface_t region;
+
+    SURFACE_Init( &region, width, height, framebuffer.pitch,
+                  SURFACE_FormatFromDepth( framebuffer.bits_per_pixel ), dest, 0 );
+    scroll_draw( &region, world_x, world_y, scroll_arg );
+
+    if( framebuffer.scroll_flags & RPI_SCROLL_HORIZONTAL )
+        fb_queue_copy( right, dest, width * bpp, height );
+
+    if( framebuffer.scroll_flags & RPI_SCROLL_VERTICAL )
+        fb_queue_copy( dest + below, dest, width * bpp, height );
+
+    if( ( framebuffer.scroll_flags & RPI_SCROLL_HORIZONTAL ) &&
+        ( framebuffer.scroll_flags & RPI_SCROLL_VERTICAL ) )
+        fb_queue_copy( right + below, dest, width * bpp, height );
+}
+
+
+/* Draw a rectangle of the world, split into pieces where it wraps around the copies */
+static void scroll_draw_rectangle( int x, int y, int width, int height )
+{
+    int py, px;
+
+    for( py = 0; py < height; )
     {
-        for( blit_y = 0; blit_y < image->height; blit_y++ )
-            RPI_Blit( x, y + blit_y,
-                      &image->pixel_data[ blit_y * image->width * image->bytes_per_pixel ],
-                      image->width );
+        int by = scroll_wrap( y + py, framebuffer.physical_height );
+        int piece_height = framebuffer.physical_height - by;
+
+        if( piece_height > ( height - py ) )
+            piece_height = height - py;
+
+        for( px = 0; px < width; )
+        {
+            int bx = scroll_wrap( x + px, framebuffer.physical_width );
+            int piece_width = framebuffer.physical_width - bx;
+
+            if( piece_width > ( width - px ) )
+                piece_width = width - px;
+
+            scroll_draw_piece( bx, by, piece_width, piece_height, x + px, y + py );
+            px += piece_width;
+        }
+
+        py += piece_height;
     }
-    else if( ( RPI_GetFramebuffer()->bits_per_pixel == 32 ) && ( image->bytes_per_pixel == 4 ) )
+}
+
+
+/* Wait for the copies and show the window at the scroll position */
+static void scroll_show( void )
+{
+    int x = 0;
+    int y = 0;
+
+    if( framebuffer.scroll_flags & RPI_SCROLL_HORIZONTAL )
+        x = scroll_wrap( framebuffer.scroll_x, framebuffer.physical_width );
+
+    if( framebuffer.scroll_flags & RPI_SCROLL_VERTICAL )
+        y = scroll_wrap( framebuffer.scroll_y, framebuffer.physical_height );
+
+    RPI_FramebufferFence();
+
+    RPI_PropertyInit();
+    RPI_PropertyAddTag( TAG_SET_VIRTUAL_OFFSET, x, y );
+    RPI_PropertyProcess();
+
+    framebuffer.virtual_offset = ( y * framebuffer.pitch ) + ( x * framebuffer.bytes_per_pixel );
+}
+
+
+/**
+    @brief Switch between double buffering and hardware scrolling
+    @param flags RPI_SCROLL_HORIZONTAL and/or RPI_SCROLL_VERTICAL, or 0 to go back to double
+    buffering
+    @param draw Called to draw each newly exposed part of the world
+    @return 0 on success, -1 if the framebuffer couldn't be allocated
+
+    The framebuffer is reallocated and the whole screen is drawn at scroll position 0, 0. While
+    scrolling, RPI_SwitchFramebuffer() doesn't flip and the drawing functions shouldn't be used on
+    the framebuffer, anything drawn outside of the draw callback isn't copied to the mirrors.
+*/
+int RPI_InitScrolling( int flags, rpi_scroll_draw_t draw, void* arg )
+{
+    RPI_FramebufferFence();
+
+    framebuffer.scroll_flags = draw ? ( flags & ( RPI_SCROLL_HORIZONTAL | RPI_SCROLL_VERTICAL ) ) : 0;
+    framebuffer.scroll_x = 0;
+    framebuffer.scroll_y = 0;
+    scroll_draw = draw;
+    scroll_arg = arg;
+
+    return framebuffer_reallocate();
+}
+
+
+/**
+    @brief Scroll the screen by dx, dy pixels
+
+    Only the rows and columns that scroll on to the screen are drawn. Scrolling in a direction that
+    wasn't enabled with RPI_InitScrolling() is ignored.
+*/
+void RPI_Scroll( int dx, int dy )
+{
+    const int width = framebuffer.physical_width;
+    const int height = framebuffer.physical_height;
+    int x, y;
+
+    if( framebuffer.scroll_flags == 0 )
+        return;
+
+    if( ( framebuffer.scroll_flags & RPI_SCROLL_HORIZONTAL ) == 0 )
+        dx = 0;
+
+    if( ( framebuffer.scroll_flags & RPI_SCROLL_VERTICAL ) == 0 )
+        dy = 0;
+
+    if( ( dx == 0 ) && ( dy == 0 ) )
+        return;
+
+    x = framebuffer.scroll_x;
+    y = framebuffer.scroll_y;
+    framebuffer.scroll_x += dx;
+    framebuffer.scroll_y += dy;
+
+    if( ( dx >= width ) || ( -dx >= width ) || ( dy >= height ) || ( -dy >= height ) )
     {
-        for( blit_y = 0; blit_y < image->height; blit_y++ )
-            RPI_Blit( x, y + blit_y,
-                      &image->pixel_data[ blit_y * image->width * image->bytes_per_pixel ],
-                      image->width );
+        RPI_ScrollRedraw();
+        return;
     }
+
+    /* Don't draw under anything still queued */
+    RPI_FramebufferFence();
+
+    /* The exposed rows across the whole new window, then the exposed columns beside the rest */
+    if( dy > 0 )
+        scroll_draw_rectangle( x + dx, y + height, width, dy );
+    else if( dy < 0 )
+        scroll_draw_rectangle( x + dx, y + dy, width, -dy );
+
+    if( dx > 0 )
+        scroll_draw_rectangle( x + width, ( dy > 0 ) ? y + dy : y, dx, height - abs( dy ) );
+    else if( dx < 0 )
+        scroll_draw_rectangle( x + dx, ( dy > 0 ) ? y + dy : y, -dx, height - abs( dy ) );
+
+    scroll_show();
+}
+
+
+/**
+    @brief Draw the whole screen at the current scroll position
+*/
+void RPI_ScrollRedraw( void )
+{
+    if( framebuffer.scroll_flags == 0 )
+        return;
+
+    RPI_FramebufferFence();
+    scroll_draw_rectangle( framebuffer.scroll_x, framebuffer.scroll_y,
+                           framebuffer.physical_width, framebuffer.physical_height );
+    scroll_show();
+}
+
+
+/**
+    @brief Draw a rectangle of the world again where it's on the screen, after it's changed
+    @param x The world position of the rectangle, as passed to the draw callback
+*/
+void RPI_ScrollInvalidate( int x, int y, int width, int height )
+{
+    if( framebuffer.scroll_flags == 0 )
+        return;
+
+    if( x < framebuffer.scroll_x )
+    {
+        width -= framebuffer.scroll_x - x;
+        x = framebuffer.scroll_x;
+    }
+
+    if( y < framebuffer.scroll_y )
+    {
+        height -= framebuffer.scroll_y - y;
+        y = framebuffer.scroll_y;
+    }
+
+    if( ( x + width ) > ( framebuffer.scroll_x + framebuffer.physical_width ) )
+        width = framebuffer.scroll_x + framebuffer.physical_width - x;
+
+    if( ( y + height ) > ( framebuffer.scroll_y + framebuffer.physical_height ) )
+        height = framebuffer.scroll_y + framebuffer.physical_height - y;
+
+    if( ( width <= 0 ) || ( height <= 0 ) )
+        return;
+
+    RPI_FramebufferFence();
+    scroll_draw_rectangle( x, y, width, height );
+    RPI_FramebufferFence();
+}
+
+
+/* Upload a range of the palette to the firmware */
+static int palette_upload( int first, int count )
+{
+    rpi_mailbox_property_t* mp;
+
+    RPI_PropertyInit();
+    RPI_PropertyAddTag( TAG_SET_PALETTE, first, count, &palette[first] );
+    RPI_PropertyProcess();
+
+    /* The firmware answers 0 when the palette was valid */
+    if( ( mp = RPI_PropertyGet( TAG_SET_PALETTE ) ) == NULL )
+        return -1;
+
+    return ( mp->data.buffer_32[0] == 0 ) ? 0 : -1;
+}
+
+
+/**
+    @brief Set count palette entries from first, for 8bpp framebuffers
+    @param entries Made with RPI_PALETTE_RGB(), the same as an image_t palette
+    @return 0 on success, -1 if the range is invalid or the firmware refused it
+
+    Only the entries that are set are sent to the firmware. Nothing in the framebuffer is touched,
+    so changing the palette changes the colour of everything drawn with it at no cost in bandwidth.
+*/
+int RPI_SetPalette( int first, int count, const palette_entry_t* entries )
+{
+    if( ( first < 0 ) || ( count <= 0 ) || ( ( first + count ) > RPI_PALETTE_SIZE ) )
+        return -1;
+
+    if( entries != &palette[first] )
+        memmove( &palette[first], entries, count * sizeof( palette_entry_t ) );
+
+    palette_set = 1;
+
+    return palette_upload( first, count );
+}
+
+
+/**
+    @brief Use an image's palette, such as the one read by image8_from_bitmap()
+*/
+int RPI_SetImagePalette( const image_t* image )
+{
+    if( ( image == NULL ) || ( image->palette == NULL ) )
+        return -1;
+
+    return RPI_SetPalette( 0, RPI_PALETTE_SIZE, image->palette );
+}
+
+
+/**
+    @brief Rotate count palette entries from first by step places, the classic colour cycling
+    effect. A positive step moves each colour to a higher index
+*/
+int RPI_RotatePalette( int first, int count, int step )
+{
+    palette_entry_t rotated[RPI_PALETTE_SIZE];
+
+    if( ( first < 0 ) || ( count <= 0 ) || ( ( first + count ) > RPI_PALETTE_SIZE ) )
+        return -1;
+
+    step %= count;
+
+    if( step < 0 )
+        step += count;
+
+    for( int i = 0; i < count; i++ )
+        rotated[( i + step ) % count] = palette[first + i];
+
+    return RPI_SetPalette( first, count, rotated );
+}
+
+
+const palette_entry_t* RPI_GetPalette( void )
+{
+    return palette;
 }
@@ -12,12 +12,39 @@
 #define RPI_FRAMEBUFFER_H
 
 #include "image.h"
+#include "sprite.h"
+#include "surface.h"
+
+struct tile_list_t;
+
+/** @brief Settings for RPI_SetFramebufferScale(). Below 100% fewer pixels are drawn and the
+    VideoCore scales them up to the display, above it more are drawn and it scales them down */
+#define RPI_FB_SCALE_MIN            25
+#define RPI_FB_SCALE_PERFORMANCE    50
+#define RPI_FB_SCALE_BALANCED       75
+#define RPI_FB_SCALE_NATIVE         100
+#define RPI_FB_SCALE_SUPERSAMPLE    200
+#define RPI_FB_SCALE_MAX            200
+
+/** @brief Make a palette entry. The firmware takes the red in the low byte */
+#define RPI_PALETTE_RGB( r, g, b )  ( ( ( b ) << 16 ) | ( ( g ) << 8 ) | ( r ) )
+#define RPI_PALETTE_SIZE            256
+
+/** @brief Flags for RPI_InitScrolling() */
+#define RPI_SCROLL_HORIZONTAL       ( 1 << 0 )
+#define RPI_SCROLL_VERTICAL         ( 1 << 1 )
 
 /* A structure can hold all sorts of information about our framebuffer so we don't need to keep
 going through the mailbox interface in order to get information */
 typedef struct {
     int physical_width;
     int physical_height;
+    int display_width;              /**< The size asked for, which the physical size is scaled to */
+    int display_height;
+    int scale;                      /**< The physical size as a percentage of the display size */
+    int scroll_flags;               /**< RPI_SCROLL_* when scrolling, 0 when double buffering */
+    int scroll_x;                   /**< The scroll position, the world pixel at the top left */
+    int scroll_y;
     int virtual_width;
     int virtual_height;
     int pitch;
@@ -29,6 +56,8 @@ typedef struct {
     int buffer_size;
     volatile void* buffers[2];
     volatile void* current_buffer;
+    surface_t surfaces[2];          /**< The two buffers as surfaces */
+    surface_t* current_surface;     /**< The surface of current_buffer, the one not on screen */
 } framebuffer_info_t __attribute__( ( aligned (16) ) );
 
 
@@ -65,13 +94,40 @@ typedef struct {
 
 extern void RPI_InitFramebuffer( int width, int height, int bpp );
 extern framebuffer_info_t* RPI_GetFramebuffer( void );
+extern int RPI_SetFramebufferScale( int percent );
 extern void RPI_ClearScreen( void );
 extern void RPI_DrawRectangle( graphic_rectangle_t* rectangle );
 extern void RPI_DrawMovingRectangle( graphic_moving_rectangle_t* mrectangle );
 extern void RPI_DrawImage( int x, int y, image_t* image );
+extern void RPI_DrawSprite( int x, int y, const sprite_t* sprite, int alpha );
 extern void RPI_Blit( int x, int y, void* data, int datacount );
 extern void RPI_BlitV( int x, int y, void* data, int datacount, uint32_t pitch );
 extern void RPI_SwitchFramebuffer( void );
 extern void RPI_PutPixel( int x, int y, int colour );
 
+extern void RPI_SetDrawSurface( surface_t* surface );
+extern surface_t* RPI_GetDrawSurface( void );
+extern void RPI_SetDrawList( struct tile_list_t* list );
+extern struct tile_list_t* RPI_GetDrawList( void );
+extern int RPI_Present( surface_t* surface );
+
+extern void RPI_QueueFillRectangle( int x, int y, int width, int height, int colour );
+extern void RPI_QueueBlitRectangle( int x, int y, const void* data, int pitch, int width, int height );
+extern void RPI_QueueClearScreen( int colour );
+extern void RPI_FramebufferFence( void );
+
+extern int RPI_SetPalette( int first, int count, const palette_entry_t* entries );
+extern int RPI_SetImagePalette( const image_t* image );
+extern int RPI_RotatePalette( int first, int count, int step );
+extern const palette_entry_t* RPI_GetPalette( void );
+
+/** @brief Draws the part of the scrolling world at x, y into a region of the framebuffer. The
+    region is a surface the size of the part to draw */
+typedef void (*rpi_scroll_draw_t)( surface_t* region, int x, int y, void* arg );
+
+extern int RPI_InitScrolling( int flags, rpi_scroll_draw_t draw, void* arg );
+extern void RPI_Scroll( int dx, int dy );
+extern void RPI_ScrollRedraw( void );
+extern void RPI_ScrollInvalidate( int x, int y, int width, int height );
+
 #endif
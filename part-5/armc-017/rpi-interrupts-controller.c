@@ -34,6 +34,16 @@
 #define RPI_BASIC_ACCESS_ERROR_1_IRQ    (1 << 6)
 #define RPI_BASIC_ACCESS_ERROR_0_IRQ    (1 << 7)
 
+/** @brief Bits in the Enable_IRQs_1 register for the system timer compare channels available to
+    the ARM. See the BCM2835 ARM Peripherals manual, section 7.5 */
+#define RPI_IRQ_1_SYSTEM_TIMER_1        (1 << 1)
+#define RPI_IRQ_1_SYSTEM_TIMER_3        (1 << 3)
+
+/** @brief Bits in the Enable_IRQs_1 register for the DMA channels. Channels 0 to 10 have an
+    interrupt each, channels 11 to 14 share one */
+#define RPI_IRQ_1_DMA( channel )        (1 << ( 16 + ( channel ) ) )
+#define RPI_IRQ_1_DMA_SHARED            (1 << 27)
+
 
 extern void RPI_EnableGICInterrupts(void);
 
@@ -73,3 +83,23 @@ void RPI_EnableARMTimerInterrupt(void)
 #endif
     RPI_GetIrqController()->Enable_Basic_IRQs = RPI_BASIC_ARM_TIMER_IRQ;
 }
+
+void RPI_EnableSystemTimerInterrupt(void)
+{
+    RPI_GetIrqController()->Enable_IRQs_1 = RPI_IRQ_1_SYSTEM_TIMER_1;
+}
+
+void RPI_EnableDmaInterrupts( uint32_t channels )
+{
+    uint32_t irqs = 0;
+
+    for( int channel = 0; channel < 15; channel++ )
+    {
+        if( ( channels & ( 1 << channel ) ) == 0 )
+            continue;
+
+        irqs |= ( channel <= 10 ) ? RPI_IRQ_1_DMA( channel ) : RPI_IRQ_1_DMA_SHARED;
+    }
+
+    RPI_GetIrqController()->Enable_IRQs_1 = irqs;
+}
@@ -8,12 +8,20 @@
 
 */
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "irq-stats.h"
 #include "rpi-armtimer.h"
 #include "rpi-base.h"
+#include "rpi-core-message.h"
+#include "rpi-dma.h"
 #include "rpi-gpio.h"
 #include "rpi-interrupts.h"
+#include "rpi-local-intc.h"
+#include "rpi-systimer.h"
+#include "task.h"
+#include "work-queue.h"
 
 extern void outbyte( char b );
 
@@ -109,6 +117,27 @@ void __attribute__((interrupt("ABORT"))) data_abort_vector(void)
 }
 
 
+/**
+    @brief Flip the ACT LED. Deferred from the ARM Timer interrupt to the work queue because
+    there's no need to be toggling GPIO in the interrupt handler
+*/
+static void led_toggle( void* arg )
+{
+    static int lit = 0;
+
+    if( lit )
+    {
+        LED_OFF();
+        lit = 0;
+    }
+    else
+    {
+        LED_ON();
+        lit = 1;
+    }
+}
+
+
 /**
     @brief The IRQ Interrupt handler
 
@@ -116,37 +145,90 @@ void __attribute__((interrupt("ABORT"))) data_abort_vector(void)
     up to the handler to determine the source of the interrupt and most
     importantly clear the interrupt flag so that the interrupt won't
     immediately put us back into the start of the handler again.
+
+    It's called from _irq_entry in armc-start.S which saves and restores
+    the interrupted context so that the scheduler can switch task on the way
+    out of the interrupt.
 */
-void __attribute__((interrupt("IRQ"))) interrupt_vector(void)
+void interrupt_vector(void)
 {
-    static int lit = 0;
     static int jiffies = 0;
+    int gpu_pending = 1;
+    int handled = 0;
+    int32_t latency;
+    uint32_t start = IRQSTAT_Start();
 
-    if( RPI_GetArmTimer()->MaskedIRQ ) {
-        /* Clear the ARM Timer interrupt - it's the only interrupt we have
-           enabled, so we want don't have to work out which interrupt source
-           caused us to interrupt */
+#if defined( RPI_LOCAL_BASE )
+    /* Service the per-core generic timer tick first, it's the most time critical source */
+    uint32_t local_source = RPI_LocalInterruptHandler();
+
+    if( local_source & ( RPI_LOCAL_SRC_CNTPNS | RPI_LOCAL_SRC_CNTV ) )
+    {
+        IRQSTAT_Record( IRQSTAT_LOCAL_TIMER, start, -1 );
+        handled = 1;
+    }
+
+    if( local_source & RPI_LOCAL_SRC_MAILBOX( RPI_CORE_MESSAGE_MAILBOX ) )
+    {
+        start = IRQSTAT_Start();
+        RPI_CoreMessageInterruptHandler();
+        IRQSTAT_Record( IRQSTAT_CORE_MESSAGE, start, -1 );
+        handled = 1;
+    }
+
+    /* Every core comes through here, but only the core the GPU interrupts are routed to may
+       service the (shared) ARM Timer */
+    gpu_pending = ( local_source & RPI_LOCAL_SRC_GPU );
+#endif
+
+    if( gpu_pending && RPI_GetArmTimer()->MaskedIRQ ) {
+        start = IRQSTAT_Start();
+
+        /* Clear the ARM Timer interrupt */
         RPI_GetArmTimer()->IRQClear = 1;
 
+        /* The ARM Timer is the scheduler tick. Every half a second flip the LED once we're back in
+           thread context */
         jiffies++;
-        if( jiffies == 2 )
+        if( ( jiffies % ( TASK_TICK_HZ / 2 ) ) == 0 )
+            WQ_Post( WQ_PRIORITY_LOW, led_toggle, NULL );
+
+        if( jiffies == TASK_TICK_HZ )
         {
             jiffies = 0;
             uptime++;
         }
 
-        /* Flip the LED */
-        if( lit )
+        TASK_Tick();
+
+        IRQSTAT_Record( IRQSTAT_ARM_TIMER, start, -1 );
+        handled = 1;
+    }
+
+    if( gpu_pending )
+    {
+        /* The system timer compare tells us exactly when it raised the interrupt, so it gives us
+           a measure of the interrupt entry latency */
+        start = IRQSTAT_Start();
+        latency = RPI_SystemTimerCompareHandler();
+
+        if( latency >= 0 )
         {
-            LED_OFF();
-            lit = 0;
+            IRQSTAT_Record( IRQSTAT_SYSTEM_TIMER, start, latency );
+            handled = 1;
         }
-        else
+
+        start = IRQSTAT_Start();
+
+        if( RPI_DmaInterruptHandler() )
         {
-            LED_ON();
-            lit = 1;
+            IRQSTAT_Record( IRQSTAT_DMA, start, -1 );
+            handled = 1;
         }
     }
+
+    if( !handled )
+        IRQSTAT_Record( IRQSTAT_UNHANDLED, start, -1 );
 }
 
 
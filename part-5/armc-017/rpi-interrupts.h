@@ -15,7 +15,28 @@
 
 #include "rpi-base.h"
 
+/**
+    @brief Disable IRQs on the calling core and return the previous CPSR so that the previous
+    interrupt state can be restored with RPI_IrqRestore()
+*/
+static inline uint32_t RPI_IrqSaveDisable( void )
+{
+    uint32_t cpsr;
+    __asm__ volatile( "mrs %0, cpsr\n\tcpsid i" : "=r" (cpsr) : : "memory" );
+    return cpsr;
+}
+
+/**
+    @brief Restore the interrupt state saved by RPI_IrqSaveDisable()
+*/
+static inline void RPI_IrqRestore( uint32_t cpsr )
+{
+    __asm__ volatile( "msr cpsr_c, %0" : : "r" (cpsr) : "memory" );
+}
+
 extern volatile int uptime;
 extern void RPI_EnableARMTimerInterrupt(void);
+extern void RPI_EnableSystemTimerInterrupt(void);
+extern void RPI_EnableDmaInterrupts( uint32_t channels );
 
 #endif
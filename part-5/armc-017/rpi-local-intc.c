@@ -0,0 +1,205 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* Driver for the ARM-local interrupt controller of the BCM2836/BCM2837. Each core has its own
+   pair of generic timers (CNTP and CNTV) which are banked in the CP15 register space, so each core
+   programs its own tick without contending on the shared ARM timer peripheral. The local
+   controller then decides which core receives the timer, mailbox and GPU interrupts. */
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+#include "rpi-local-intc.h"
+
+#if defined( RPI_LOCAL_BASE )
+
+/** @brief Generic timer control register bits (CNTP_CTL / CNTV_CTL) */
+#define GENERIC_TIMER_CTL_ENABLE    ( 1 << 0 )
+#define GENERIC_TIMER_CTL_IMASK     ( 1 << 1 )
+#define GENERIC_TIMER_CTL_ISTATUS   ( 1 << 2 )
+
+typedef struct {
+    rpi_local_timer_t timer;
+    uint32_t reload;
+    volatile uint32_t ticks;
+    rpi_local_tick_handler_t handler;
+    } rpi_local_core_tick_t;
+
+static rpi_local_t* rpiLocal = (rpi_local_t*)RPI_LOCAL_BASE;
+
+/* Each core only ever touches its own entry */
+static rpi_local_core_tick_t core_ticks[RPI_LOCAL_CORE_COUNT];
+
+
+static void generic_timer_set_control( rpi_local_timer_t timer, uint32_t control )
+{
+    if( timer == RPI_LOCAL_TIMER_PHYSICAL )
+        __asm__ volatile( "mcr p15, 0, %0, c14, c2, 1" : : "r" (control) );
+    else
+        __asm__ volatile( "mcr p15, 0, %0, c14, c3, 1" : : "r" (control) );
+
+    __asm__ volatile( "isb" ::: "memory" );
+}
+
+
+static uint64_t generic_timer_get_compare( rpi_local_timer_t timer )
+{
+    uint32_t lo, hi;
+
+    if( timer == RPI_LOCAL_TIMER_PHYSICAL )
+        __asm__ volatile( "mrrc p15, 2, %0, %1, c14" : "=r" (lo), "=r" (hi) );
+    else
+        __asm__ volatile( "mrrc p15, 3, %0, %1, c14" : "=r" (lo), "=r" (hi) );
+
+    return ( (uint64_t)hi << 32 ) | lo;
+}
+
+
+static void generic_timer_set_compare( rpi_local_timer_t timer, uint64_t compare )
+{
+    uint32_t lo = (uint32_t)compare;
+    uint32_t hi = (uint32_t)( compare >> 32 );
+
+    if( timer == RPI_LOCAL_TIMER_PHYSICAL )
+        __asm__ volatile( "mcrr p15, 2, %0, %1, c14" : : "r" (lo), "r" (hi) );
+    else
+        __asm__ volatile( "mcrr p15, 3, %0, %1, c14" : : "r" (lo), "r" (hi) );
+
+    __asm__ volatile( "isb" ::: "memory" );
+}
+
+
+static uint64_t generic_timer_get_count( rpi_local_timer_t timer )
+{
+    uint32_t lo, hi;
+
+    if( timer == RPI_LOCAL_TIMER_PHYSICAL )
+        __asm__ volatile( "mrrc p15, 0, %0, %1, c14" : "=r" (lo), "=r" (hi) );
+    else
+        __asm__ volatile( "mrrc p15, 1, %0, %1, c14" : "=r" (lo), "=r" (hi) );
+
+    return ( (uint64_t)hi << 32 ) | lo;
+}
+
+
+rpi_local_t* RPI_GetLocal( void )
+{
+    return rpiLocal;
+}
+
+
+/**
+    @brief Route the GPU (BCM2835 interrupt controller) IRQ and FIQ to a single core
+
+    Only one core can receive the GPU interrupts at any time. By default the firmware routes them
+    to core 0.
+*/
+void RPI_LocalRouteGpuInterrupts( int core )
+{
+    core &= 0x3;
+    rpiLocal->gpu_interrupt_routing = ( core << 2 ) | core;
+}
+
+
+/**
+    @brief Start a periodic tick on the calling core using one of its generic timers
+    @param timer The generic timer to use for the tick
+    @param hz The tick rate in Hz
+    @param handler Called (in IRQ context) on every tick, can be NULL
+
+    The generic timer registers are banked per core, so this must be called from the core that
+    wants to receive the tick. Interrupts must be enabled on that core to receive the tick.
+*/
+void RPI_LocalTimerInit( rpi_local_timer_t timer, uint32_t hz, rpi_local_tick_handler_t handler )
+{
+    int core = RPI_GetCoreId();
+    rpi_local_core_tick_t* tick = &core_ticks[core];
+    uint32_t frequency = RPI_GenericTimerGetFrequency();
+
+    if( hz == 0 )
+        return;
+
+    /* Older firmware doesn't initialise CNTFRQ, in which case the timers run from the crystal */
+    if( frequency == 0 )
+        frequency = RPI_LOCAL_DEFAULT_TIMER_FREQ;
+
+    /* Mask the timer while we configure it */
+    generic_timer_set_control( timer, GENERIC_TIMER_CTL_IMASK );
+
+    tick->timer = timer;
+    tick->reload = frequency / hz;
+    tick->ticks = 0;
+    tick->handler = handler;
+
+    /* Use the absolute compare value rather than the down-counter so that the tick doesn't drift
+       by the interrupt latency every period */
+    generic_timer_set_compare( timer, generic_timer_get_count( timer ) + tick->reload );
+    generic_timer_set_control( timer, GENERIC_TIMER_CTL_ENABLE );
+
+    if( timer == RPI_LOCAL_TIMER_PHYSICAL )
+        rpiLocal->core_timer_interrupt_control[core] |= RPI_LOCAL_CNTPNS_IRQ;
+    else
+        rpiLocal->core_timer_interrupt_control[core] |= RPI_LOCAL_CNTV_IRQ;
+}
+
+
+/**
+    @brief Stop the tick running on the calling core
+*/
+void RPI_LocalTimerStop( void )
+{
+    int core = RPI_GetCoreId();
+    rpi_local_core_tick_t* tick = &core_ticks[core];
+
+    if( tick->reload == 0 )
+        return;
+
+    generic_timer_set_control( tick->timer, GENERIC_TIMER_CTL_IMASK );
+    rpiLocal->core_timer_interrupt_control[core] &= ~( RPI_LOCAL_CNTPNS_IRQ | RPI_LOCAL_CNTV_IRQ );
+    tick->reload = 0;
+}
+
+
+/**
+    @brief Return the number of ticks a core has received since its tick was started
+*/
+uint32_t RPI_LocalTimerGetTicks( int core )
+{
+    return core_ticks[core & 0x3].ticks;
+}
+
+
+/**
+    @brief Service the ARM-local interrupt sources for the calling core
+    @return The core interrupt source bits that were pending on entry
+
+    Called from the IRQ handler. The per-core tick is serviced here, the other sources are returned
+    to the caller so that it can dispatch them.
+*/
+uint32_t RPI_LocalInterruptHandler( void )
+{
+    int core = RPI_GetCoreId();
+    rpi_local_core_tick_t* tick = &core_ticks[core];
+    uint32_t source = rpiLocal->core_irq_source[core];
+
+    if( ( tick->reload != 0 ) && ( source & ( RPI_LOCAL_SRC_CNTPNS | RPI_LOCAL_SRC_CNTV ) ) )
+    {
+        /* Moving the compare value on clears the timer condition */
+        generic_timer_set_compare( tick->timer, generic_timer_get_compare( tick->timer ) + tick->reload );
+        tick->ticks++;
+
+        if( tick->handler )
+            tick->handler( core, tick->ticks );
+    }
+
+    return source;
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_LOCAL_INTC_H
+#define RPI_LOCAL_INTC_H
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+
+/** @brief The number of ARM cores served by the ARM-local peripherals */
+#define RPI_LOCAL_CORE_COUNT            4
+
+/** @brief Bits in the GPU interrupt routing register. See section 4.3 of the BCM2836 ARM-local
+    peripherals documentation */
+#define RPI_LOCAL_GPU_IRQ_CORE_MASK     ( 0x3 << 0 )
+#define RPI_LOCAL_GPU_FIQ_CORE_MASK     ( 0x3 << 2 )
+
+/** @brief Bits in the Core timers interrupt control registers (section 4.6) */
+#define RPI_LOCAL_CNTPS_IRQ             ( 1 << 0 )
+#define RPI_LOCAL_CNTPNS_IRQ            ( 1 << 1 )
+#define RPI_LOCAL_CNTHP_IRQ             ( 1 << 2 )
+#define RPI_LOCAL_CNTV_IRQ              ( 1 << 3 )
+
+/** @brief Bits in the Core interrupt source registers (section 4.10) */
+#define RPI_LOCAL_SRC_CNTPS             ( 1 << 0 )
+#define RPI_LOCAL_SRC_CNTPNS            ( 1 << 1 )
+#define RPI_LOCAL_SRC_CNTHP             ( 1 << 2 )
+#define RPI_LOCAL_SRC_CNTV              ( 1 << 3 )
+#define RPI_LOCAL_SRC_MAILBOX( n )      ( 1 << ( 4 + ( n ) ) )
+#define RPI_LOCAL_SRC_GPU               ( 1 << 8 )
+#define RPI_LOCAL_SRC_PMU               ( 1 << 9 )
+#define RPI_LOCAL_SRC_AXI               ( 1 << 10 )
+#define RPI_LOCAL_SRC_LOCAL_TIMER       ( 1 << 11 )
+
+/** @brief The crystal frequency that drives the generic timers when the firmware has not set
+    CNTFRQ for us */
+#define RPI_LOCAL_DEFAULT_TIMER_FREQ    ( 19200000UL )
+
+/** @brief The ARM-local peripheral register set. See section 4 of the BCM2836 ARM-local
+    peripherals documentation (QA7_rev3.4.pdf) */
+typedef struct {
+    volatile uint32_t control;
+    volatile uint32_t reserved0;
+    volatile uint32_t core_timer_prescaler;
+    volatile uint32_t gpu_interrupt_routing;
+    volatile uint32_t pmu_routing_set;
+    volatile uint32_t pmu_routing_clear;
+    volatile uint32_t reserved1;
+    volatile uint32_t core_timer_ls;
+    volatile uint32_t core_timer_ms;
+    volatile uint32_t local_interrupt_routing;
+    volatile uint32_t reserved2;
+    volatile uint32_t axi_outstanding_counters;
+    volatile uint32_t axi_outstanding_irq;
+    volatile uint32_t local_timer_control;
+    volatile uint32_t local_timer_flags;
+    volatile uint32_t reserved3;
+    volatile uint32_t core_timer_interrupt_control[RPI_LOCAL_CORE_COUNT];
+    volatile uint32_t core_mailbox_interrupt_control[RPI_LOCAL_CORE_COUNT];
+    volatile uint32_t core_irq_source[RPI_LOCAL_CORE_COUNT];
+    volatile uint32_t core_fiq_source[RPI_LOCAL_CORE_COUNT];
+
+    /** Writing a 1 to a bit sets the bit in the mailbox */
+    volatile uint32_t core_mailbox_write_set[RPI_LOCAL_CORE_COUNT][4];
+
+    /** Reading returns the mailbox value, writing a 1 to a bit clears the bit */
+    volatile uint32_t core_mailbox_read_clear[RPI_LOCAL_CORE_COUNT][4];
+    } rpi_local_t;
+
+/** @brief The two generic timers each core can use for its own tick */
+typedef enum {
+    RPI_LOCAL_TIMER_PHYSICAL = 0,   /**< CNTP - Non-secure physical timer */
+    RPI_LOCAL_TIMER_VIRTUAL,        /**< CNTV - Virtual timer */
+    } rpi_local_timer_t;
+
+/** @brief A per-core tick handler, called in IRQ context on the core that owns the tick */
+typedef void (*rpi_local_tick_handler_t)( int core, uint32_t ticks );
+
+/**
+    @brief Return the number (0-3) of the core we're executing on
+*/
+static inline int RPI_GetCoreId( void )
+{
+#if defined( RPI0 ) || defined( RPI1 )
+    /* The ARM1176 is single core and doesn't implement the MPIDR */
+    return 0;
+#else
+    uint32_t mpidr;
+    __asm__ volatile( "mrc p15, 0, %0, c0, c0, 5" : "=r" (mpidr) );
+    return mpidr & 0x3;
+#endif
+}
+
+/**
+    @brief Return the frequency of the generic timer counter in Hz (CNTFRQ)
+*/
+static inline uint32_t RPI_GenericTimerGetFrequency( void )
+{
+    uint32_t frequency;
+    __asm__ volatile( "mrc p15, 0, %0, c14, c0, 0" : "=r" (frequency) );
+    return frequency;
+}
+
+/**
+    @brief Return the 64-bit physical count of the generic timer (CNTPCT)
+*/
+static inline uint64_t RPI_GenericTimerGetCount( void )
+{
+    uint32_t lo, hi;
+    __asm__ volatile( "mrrc p15, 0, %0, %1, c14" : "=r" (lo), "=r" (hi) );
+    return ( (uint64_t)hi << 32 ) | lo;
+}
+
+#if defined( RPI_LOCAL_BASE )
+extern rpi_local_t* RPI_GetLocal( void );
+extern void RPI_LocalRouteGpuInterrupts( int core );
+extern void RPI_LocalTimerInit( rpi_local_timer_t timer, uint32_t hz, rpi_local_tick_handler_t handler );
+extern void RPI_LocalTimerStop( void );
+extern uint32_t RPI_LocalTimerGetTicks( int core );
+extern uint32_t RPI_LocalInterruptHandler( void );
+#endif
+
+#endif
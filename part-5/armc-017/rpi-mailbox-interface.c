@@ -12,13 +12,16 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "rpi-base.h"
+#include "rpi-cache.h"
 #include "rpi-mailbox.h"
 #include "rpi-mailbox-interface.h"
 
 /* Make sure the property tag buffer is aligned to a 16-byte boundary because
    we only have 28-bits available in the property interface protocol to pass
-   the address of the buffer to the VC. */
-static int pt[8192] __attribute__((aligned(16)));
+   the address of the buffer to the VC. It's cache line aligned so that the
+   cache maintenance around each request can't touch anything else. */
+static int pt[8192] __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
 static int pt_index = 0;
 
 
@@ -72,6 +75,12 @@ void RPI_PropertyAddTag( rpi_mailbox_tag_t tag, ... )
             pt_index += 256 >> 2;
             break;
 
+        case TAG_RELEASE_BUFFER:
+            /* No request or response data */
+            pt[pt_index++] = 0;
+            pt[pt_index++] = 0; /* Request */
+            break;
+
         case TAG_ALLOCATE_BUFFER:
         case TAG_GET_MAX_CLOCK_RATE:
         case TAG_GET_MIN_CLOCK_RATE:
@@ -157,6 +166,42 @@ void RPI_PropertyAddTag( rpi_mailbox_tag_t tag, ... )
             }
             break;
 
+        case TAG_SET_PALETTE:
+        {
+            int offset = va_arg( vl, int );
+            int length = va_arg( vl, int );
+            const uint32_t* entries = va_arg( vl, const uint32_t* );
+
+            pt[pt_index++] = 8 + ( length << 2 );
+            pt[pt_index++] = 0; /* Request */
+            pt[pt_index++] = offset;
+            pt[pt_index++] = length;
+
+            for( int i = 0; i < length; i++ )
+                pt[pt_index++] = entries[i];
+            break;
+        }
+
+        case TAG_SET_CURSOR_INFO:
+            pt[pt_index++] = 24;
+            pt[pt_index++] = 0; /* Request */
+            pt[pt_index++] = va_arg( vl, int ); /* Width */
+            pt[pt_index++] = va_arg( vl, int ); /* Height */
+            pt[pt_index++] = 0;                 /* Unused */
+            pt[pt_index++] = va_arg( vl, int ); /* Bus address of the ARGB pixels */
+            pt[pt_index++] = va_arg( vl, int ); /* Hotspot x */
+            pt[pt_index++] = va_arg( vl, int ); /* Hotspot y */
+            break;
+
+        case TAG_SET_CURSOR_STATE:
+            pt[pt_index++] = 16;
+            pt[pt_index++] = 0; /* Request */
+            pt[pt_index++] = va_arg( vl, int ); /* Enable */
+            pt[pt_index++] = va_arg( vl, int ); /* x */
+            pt[pt_index++] = va_arg( vl, int ); /* y */
+            pt[pt_index++] = va_arg( vl, int ); /* Flags, bit 0 set for framebuffer coordinates */
+            break;
+
         default:
             /* Unsupported tags, just remove the tag from the list */
             pt_index--;
@@ -185,9 +230,14 @@ int RPI_PropertyProcess( void )
     for( int i = 0; i < (pt[PT_OSIZE] >> 2); i++ )
         printf( "Request: %3d %8.8X\r\n", i, pt[i] );
 #endif
-    RPI_Mailbox0Write( MB0_TAGS_ARM_TO_VC, (unsigned int)pt );
+    /* The VC reads the request from memory and writes the response there, so
+       the request has to be written back from the data cache first and the
+       stale copy discarded afterwards */
+    RPI_CacheCleanRange( pt, pt[PT_OSIZE] );
+    RPI_Mailbox0Write( MB0_TAGS_ARM_TO_VC, RPI_PhysToBus( pt ) );
 
     result = RPI_Mailbox0Read( MB0_TAGS_ARM_TO_VC );
+    RPI_CacheInvalidateRange( pt, pt[PT_OSIZE] );
 
 #if( PRINT_PROP_DEBUG == 1 )
     for( int i = 0; i < (pt[PT_OSIZE] >> 2); i++ )
@@ -0,0 +1,123 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A flat (identity) MMU mapping. Without the MMU all data accesses on the ARMv7 and ARMv8 cores
+   are treated as strongly ordered and are never cached no matter what SCTLR.C says, so the MMU is
+   the only way to get the data cache working.
+
+   Every address maps to itself in 1MiB sections so no pointer changes meaning when the MMU is
+   switched on. The ARM's memory is normal cached memory except for the range the page allocator
+   uses for coherent (DMA) buffers, which is normal uncached memory. The VideoCore's memory above
+   the ARM's (where the framebuffer lives) is normal uncached and the peripherals are device
+   memory. */
+
+#include <stdint.h>
+
+#include "rpi-barrier.h"
+#include "rpi-base.h"
+#include "rpi-mmu.h"
+
+/* The translation table must be aligned to its own size */
+static uint32_t mmu_table[RPI_MMU_SECTION_COUNT] __attribute__((aligned(16384)));
+
+/* The memory below the peripherals that the VideoCore can hand to us (the first GiB on every
+   model). Anything above it that isn't a peripheral is left as device memory so the core never
+   speculatively reads from memory that may not exist */
+#if ( PERIPHERAL_BASE < 0x40000000UL )
+    #define MMU_VC_MEMORY_END       PERIPHERAL_BASE
+#else
+    #define MMU_VC_MEMORY_END       0x40000000UL
+#endif
+
+/* Memory on the multi-core models has to be shareable for the SCU to keep the cores' data
+   caches coherent */
+#if defined( RPI_LOCAL_BASE )
+    #define MMU_SHAREABLE           RPI_MMU_S
+#else
+    #define MMU_SHAREABLE           0
+#endif
+
+#define SCTLR_M     ( 1 << 0 )
+#define SCTLR_XP    ( 1 << 23 )
+
+
+/**
+    @brief Build the translation table and enable the MMU on the calling core
+
+    @param arm_end The end of the ARM's memory as reported by TAG_GET_ARM_MEMORY
+    @param uncached_start The (1MiB aligned) start of the range of ARM memory to map uncached
+    @param uncached_end The (1MiB aligned) end of the uncached range
+*/
+void RPI_MmuInit( uint32_t arm_end, uint32_t uncached_start, uint32_t uncached_end )
+{
+    for( uint32_t section = 0; section < RPI_MMU_SECTION_COUNT; section++ )
+    {
+        uint32_t address = section << RPI_MMU_SECTION_SHIFT;
+        uint32_t attributes;
+
+        if( ( address >= uncached_start ) && ( address < uncached_end ) )
+            attributes = RPI_MMU_NORMAL_UNCACHED | MMU_SHAREABLE;
+        else if( address < arm_end )
+            attributes = RPI_MMU_NORMAL_CACHED | MMU_SHAREABLE;
+        else if( address < MMU_VC_MEMORY_END )
+            attributes = RPI_MMU_NORMAL_UNCACHED | MMU_SHAREABLE;
+        else
+            attributes = RPI_MMU_DEVICE;
+
+        mmu_table[section] = address | attributes | RPI_MMU_AP_RW | RPI_MMU_SECTION;
+    }
+
+    RPI_MmuEnable();
+}
+
+
+/**
+    @brief Enable the MMU on the calling core using the table built by RPI_MmuInit(). The
+    secondary cores call this as they start
+*/
+void RPI_MmuEnable( void )
+{
+    uint32_t sctlr;
+
+    /* Make sure the table has reached memory, the table walk doesn't look in the data cache */
+    RPI_DataSyncBarrier();
+
+#if defined( RPI0 ) || defined( RPI1 )
+    /* The ARM1176 may have cached data with the MMU off. Write it back and empty the data cache
+       so nothing stale is hit once the mapping changes */
+    __asm__ volatile( "mcr p15, 0, %0, c7, c14, 0" : : "r" (0) : "memory" );
+#endif
+
+    /* Invalidate the TLBs */
+    __asm__ volatile( "mcr p15, 0, %0, c8, c7, 0" : : "r" (0) : "memory" );
+
+    /* Domain 0 is a client domain so the access permissions in the table are checked */
+    __asm__ volatile( "mcr p15, 0, %0, c3, c0, 0" : : "r" (1) : "memory" );
+
+    /* TTBCR = 0, TTBR0 translates the whole address space */
+    __asm__ volatile( "mcr p15, 0, %0, c2, c0, 2" : : "r" (0) : "memory" );
+    __asm__ volatile( "mcr p15, 0, %0, c2, c0, 0" : : "r" ((uint32_t)mmu_table) : "memory" );
+
+    RPI_DataSyncBarrier();
+    RPI_InstructionSyncBarrier();
+
+    /* Enable the MMU. XP selects the ARMv6 descriptor format on the ARM1176 and is always set on
+       the later cores */
+    __asm__ volatile( "mrc p15, 0, %0, c1, c0, 0" : "=r" (sctlr) );
+    sctlr |= SCTLR_M | SCTLR_XP;
+    __asm__ volatile( "mcr p15, 0, %0, c1, c0, 0" : : "r" (sctlr) : "memory" );
+    RPI_InstructionSyncBarrier();
+
+    /* Invalidate the instruction cache and branch predictor */
+    __asm__ volatile( "mcr p15, 0, %0, c7, c5, 0" : : "r" (0) : "memory" );
+    __asm__ volatile( "mcr p15, 0, %0, c7, c5, 6" : : "r" (0) : "memory" );
+    RPI_DataSyncBarrier();
+    RPI_InstructionSyncBarrier();
+}
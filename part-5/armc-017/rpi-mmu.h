@@ -0,0 +1,44 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_MMU_H
+#define RPI_MMU_H
+
+#include <stdint.h>
+
+/** @brief The MMU maps memory in 1MiB sections */
+#define RPI_MMU_SECTION_SHIFT       20
+#define RPI_MMU_SECTION_SIZE        ( 1 << RPI_MMU_SECTION_SHIFT )
+#define RPI_MMU_SECTION_COUNT       4096
+
+/* Short descriptor section entry bits. See the ARMv7-A ARM section B3.5.1 (and the ARM1176JZF-S
+   TRM section 6.11 which is the same layout with SCTLR.XP set) */
+#define RPI_MMU_SECTION             ( 2 << 0 )
+#define RPI_MMU_B                   ( 1 << 2 )
+#define RPI_MMU_C                   ( 1 << 3 )
+#define RPI_MMU_XN                  ( 1 << 4 )
+#define RPI_MMU_AP_RW               ( 3 << 10 )
+#define RPI_MMU_TEX( x )            ( ( x ) << 12 )
+#define RPI_MMU_S                   ( 1 << 16 )
+
+/** @brief Normal memory, write-back write-allocate cached */
+#define RPI_MMU_NORMAL_CACHED       ( RPI_MMU_TEX( 1 ) | RPI_MMU_C | RPI_MMU_B )
+
+/** @brief Normal memory, not cached. Writes can still be merged in the write buffer so this is
+    a good fit for memory the VideoCore reads, such as the framebuffer */
+#define RPI_MMU_NORMAL_UNCACHED     ( RPI_MMU_TEX( 1 ) )
+
+/** @brief Shareable device memory for the peripherals. Never executable */
+#define RPI_MMU_DEVICE              ( RPI_MMU_B | RPI_MMU_XN )
+
+extern void RPI_MmuInit( uint32_t arm_end, uint32_t uncached_start, uint32_t uncached_end );
+extern void RPI_MmuEnable( void );
+
+#endif
@@ -0,0 +1,71 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_PMU_H
+#define RPI_PMU_H
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+
+/* The cycle counter of the Performance Monitor Unit. Each core has its own PMU, so every core that
+   wants to count cycles must call RPI_PmuInit().
+
+   The ARM1176 (ARMv6) has a system validation PMU in CP15 c15, see section 3.2.51 of the
+   ARM1176JZF-S TRM. ARMv7 and ARMv8 (in AArch32) have the architected PMU in CP15 c9 */
+
+#if defined( RPI0 ) || defined( RPI1 )
+
+/** @brief PMNC - Enable all counters and reset the cycle counter */
+#define RPI_PMU_PMNC_ENABLE         ( 1 << 0 )
+#define RPI_PMU_PMNC_CYCLE_RESET    ( 1 << 2 )
+
+static inline void RPI_PmuInit( void )
+{
+    uint32_t pmnc = RPI_PMU_PMNC_ENABLE | RPI_PMU_PMNC_CYCLE_RESET;
+    __asm__ volatile( "mcr p15, 0, %0, c15, c12, 0" : : "r" (pmnc) );
+}
+
+static inline uint32_t RPI_PmuGetCycles( void )
+{
+    uint32_t cycles;
+    __asm__ volatile( "mrc p15, 0, %0, c15, c12, 1" : "=r" (cycles) );
+    return cycles;
+}
+
+#else
+
+/** @brief PMCR - Enable all counters and reset the cycle counter */
+#define RPI_PMU_PMCR_ENABLE         ( 1 << 0 )
+#define RPI_PMU_PMCR_CYCLE_RESET    ( 1 << 2 )
+
+/** @brief PMCNTENSET - The cycle counter enable bit */
+#define RPI_PMU_PMCNTEN_CYCLES      ( 1UL << 31 )
+
+static inline void RPI_PmuInit( void )
+{
+    uint32_t pmcr;
+
+    __asm__ volatile( "mrc p15, 0, %0, c9, c12, 0" : "=r" (pmcr) );
+    pmcr |= RPI_PMU_PMCR_ENABLE | RPI_PMU_PMCR_CYCLE_RESET;
+    __asm__ volatile( "mcr p15, 0, %0, c9, c12, 0" : : "r" (pmcr) );
+    __asm__ volatile( "mcr p15, 0, %0, c9, c12, 1" : : "r" (RPI_PMU_PMCNTEN_CYCLES) );
+}
+
+static inline uint32_t RPI_PmuGetCycles( void )
+{
+    uint32_t cycles;
+    __asm__ volatile( "mrc p15, 0, %0, c9, c13, 0" : "=r" (cycles) );
+    return cycles;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,126 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* Secondary core start-up for the multi-core RPI models. The secondary cores are parked in
+   armc-start.S (or by the firmware's armstub) waiting for an address in their local start mailbox.
+   We post the address of _secondary_start which sets up the core's stacks, caches and VFP before
+   calling into _secondary_cstartup below */
+
+#include <stdint.h>
+
+#include "rpi-barrier.h"
+#include "rpi-base.h"
+#include "rpi-cache.h"
+#include "rpi-local-intc.h"
+#include "rpi-mmu.h"
+#include "rpi-pmu.h"
+#include "rpi-smp.h"
+
+#if defined( RPI_LOCAL_BASE )
+
+extern void _secondary_start( void );
+
+/* The stack tops for each core, read by _secondary_start in armc-start.S. The first word is
+   the IRQ mode stack and the second word is the SVC mode stack */
+uint32_t _core_stack_top[RPI_CORE_COUNT][2];
+
+static uint8_t core_svc_stacks[RPI_CORE_COUNT][RPI_CORE_SVC_STACK_SIZE] __attribute__((aligned(8)));
+static uint8_t core_irq_stacks[RPI_CORE_COUNT][RPI_CORE_IRQ_STACK_SIZE] __attribute__((aligned(8)));
+
+static volatile rpi_core_entry_t core_entry[RPI_CORE_COUNT];
+static volatile rpi_core_state_t core_state[RPI_CORE_COUNT];
+
+
+/**
+    @brief Start a secondary core running entry()
+    @return 0 on success, -1 if the core doesn't exist or is already running
+
+    Returns once the secondary core is executing C code
+*/
+int RPI_CoreStart( int core, rpi_core_entry_t entry )
+{
+    if( ( core <= 0 ) || ( core >= RPI_CORE_COUNT ) || ( entry == 0 ) )
+        return -1;
+
+    if( core_state[core] != RPI_CORE_PARKED )
+        return -1;
+
+    _core_stack_top[core][0] = (uint32_t)&core_irq_stacks[core][RPI_CORE_IRQ_STACK_SIZE];
+    _core_stack_top[core][1] = (uint32_t)&core_svc_stacks[core][RPI_CORE_SVC_STACK_SIZE];
+    core_entry[core] = entry;
+    core_state[core] = RPI_CORE_STARTING;
+
+    /* _secondary_start reads its stack tops before its MMU (and so its view of our data cache) is
+       enabled */
+    RPI_CacheCleanRange( _core_stack_top[core], sizeof( _core_stack_top[core] ) );
+
+    /* Make sure everything is visible before the core sees its start address */
+    RPI_DataSyncBarrier();
+    RPI_GetLocal()->core_mailbox_write_set[core][RPI_CORE_START_MAILBOX] = (uint32_t)_secondary_start;
+    RPI_SendEvent();
+
+    while( core_state[core] == RPI_CORE_STARTING )
+    {
+        /* Wait for the core to come up */
+    }
+
+    return 0;
+}
+
+
+rpi_core_state_t RPI_CoreGetState( int core )
+{
+    if( ( core < 0 ) || ( core >= RPI_CORE_COUNT ) )
+        return RPI_CORE_PARKED;
+
+    return core_state[core];
+}
+
+
+/**
+    @brief The C entry point of the secondary cores, called from _secondary_start
+*/
+void _secondary_cstartup( int core )
+{
+    rpi_core_entry_t entry;
+
+    /* Use the same translation table as core 0. Until this is done the core's data accesses are
+       uncached and don't see what's in the other cores' data caches */
+    RPI_MmuEnable();
+
+    entry = core_entry[core];
+
+    /* Each core has its own cycle counter for the interrupt statistics */
+    RPI_PmuInit();
+
+    core_state[core] = RPI_CORE_RUNNING;
+    RPI_DataSyncBarrier();
+
+    entry( core );
+
+    core_state[core] = RPI_CORE_PARKED;
+    RPI_DataSyncBarrier();
+}
+
+#else
+
+int RPI_CoreStart( int core, rpi_core_entry_t entry )
+{
+    /* Single core processor */
+    return -1;
+}
+
+
+rpi_core_state_t RPI_CoreGetState( int core )
+{
+    return RPI_CORE_PARKED;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_SMP_H
+#define RPI_SMP_H
+
+#include "rpi-base.h"
+
+/** @brief The number of cores we can run code on */
+#if defined( RPI_LOCAL_BASE )
+    #define RPI_CORE_COUNT          4
+#else
+    #define RPI_CORE_COUNT          1
+#endif
+
+/** @brief Stack sizes for each of the secondary cores */
+#define RPI_CORE_SVC_STACK_SIZE     ( 16 * 1024 )
+#define RPI_CORE_IRQ_STACK_SIZE     ( 4 * 1024 )
+
+/** @brief The local mailbox used to hand a start address to a parked core. This is the same
+    mailbox the firmware's armstub uses so cores parked by either the firmware or by us in
+    armc-start.S are started in the same way */
+#define RPI_CORE_START_MAILBOX      3
+
+typedef enum {
+    RPI_CORE_PARKED = 0,
+    RPI_CORE_STARTING,
+    RPI_CORE_RUNNING,
+    } rpi_core_state_t;
+
+/** @brief The entry function of a secondary core. When it returns the core parks again */
+typedef void (*rpi_core_entry_t)( int core );
+
+extern int RPI_CoreStart( int core, rpi_core_entry_t entry );
+extern rpi_core_state_t RPI_CoreGetState( int core );
+
+#endif
@@ -0,0 +1,198 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef RPI_SPINLOCK_H
+#define RPI_SPINLOCK_H
+
+#include <stdint.h>
+
+#include "rpi-atomic.h"
+#include "rpi-barrier.h"
+#include "rpi-interrupts.h"
+
+/* Locks for data shared between cores. They only protect against the other cores - code that is
+   also shared with interrupt handlers must mask IRQs before taking the lock (use the _IrqSave
+   variants) or an interrupt handler could spin forever on a lock held by the code it interrupted.
+
+   Like the atomics they're built on, a lock must be in normal cached memory. A core waiting for a
+   lock sleeps in WFE until the holder releases it and signals an event. */
+
+/* A ticket lock. A core takes the next ticket and waits until the owner count reaches it, so the
+   lock is granted in the order it was asked for and no core can be starved. The owner count is
+   the low half-word of the lock word and the next ticket is the high half-word */
+#define RPI_SPINLOCK_TICKET_SHIFT   16
+
+typedef union {
+    rpi_atomic_t word;
+    struct {
+        volatile uint16_t owner;
+        volatile uint16_t next;
+        } tickets;
+    } rpi_spinlock_t;
+
+#define RPI_SPINLOCK_INIT           { RPI_ATOMIC_INIT( 0 ) }
+
+/* A reader-writer lock. Any number of readers can hold it at once, or a single writer. The top
+   bit is set while a writer holds the lock and the rest of the word counts the readers. A steady
+   stream of readers can keep a writer waiting */
+#define RPI_RWLOCK_WRITER           0x80000000UL
+
+typedef struct {
+    rpi_atomic_t word;
+    } rpi_rwlock_t;
+
+#define RPI_RWLOCK_INIT             { RPI_ATOMIC_INIT( 0 ) }
+
+
+/** @brief Wake any cores waiting for a lock. The store releasing it must be visible first */
+static inline void RPI_LockWake( void )
+{
+    RPI_DataSyncBarrier();
+    RPI_SendEvent();
+}
+
+
+static inline void RPI_SpinLockInit( rpi_spinlock_t* lock )
+{
+    RPI_AtomicStore( &lock->word, 0 );
+}
+
+
+static inline void RPI_SpinLock( rpi_spinlock_t* lock )
+{
+    uint16_t ticket = RPI_AtomicFetchAddRelaxed( &lock->word, 1 << RPI_SPINLOCK_TICKET_SHIFT ) >> RPI_SPINLOCK_TICKET_SHIFT;
+
+    while( lock->tickets.owner != ticket )
+        RPI_WaitForEvent();
+
+    RPI_SmpMemoryBarrier();
+}
+
+
+/** @return 1 if the lock was taken, 0 if it's held */
+static inline int RPI_SpinTryLock( rpi_spinlock_t* lock )
+{
+    uint32_t word = RPI_AtomicLoad( &lock->word );
+
+    if( ( word >> RPI_SPINLOCK_TICKET_SHIFT ) != ( word & 0xFFFF ) )
+        return 0;
+
+    if( RPI_AtomicCompareExchangeRelaxed( &lock->word, word, word + ( 1 << RPI_SPINLOCK_TICKET_SHIFT ) ) != word )
+        return 0;
+
+    RPI_SmpMemoryBarrier();
+    return 1;
+}
+
+
+static inline void RPI_SpinUnlock( rpi_spinlock_t* lock )
+{
+    /* Only the holder writes the owner count. The store breaks the reservation of any core taking
+       a ticket at the same time so it retries */
+    RPI_SmpMemoryBarrier();
+    lock->tickets.owner++;
+    RPI_LockWake();
+}
+
+
+/** @return 1 if any core holds or is waiting for the lock */
+static inline int RPI_SpinIsLocked( rpi_spinlock_t* lock )
+{
+    uint32_t word = RPI_AtomicLoad( &lock->word );
+    return ( word >> RPI_SPINLOCK_TICKET_SHIFT ) != ( word & 0xFFFF );
+}
+
+
+/** @return The interrupt state to pass to RPI_SpinUnlockIrqRestore() */
+static inline uint32_t RPI_SpinLockIrqSave( rpi_spinlock_t* lock )
+{
+    uint32_t cpsr = RPI_IrqSaveDisable();
+    RPI_SpinLock( lock );
+    return cpsr;
+}
+
+
+static inline void RPI_SpinUnlockIrqRestore( rpi_spinlock_t* lock, uint32_t cpsr )
+{
+    RPI_SpinUnlock( lock );
+    RPI_IrqRestore( cpsr );
+}
+
+
+static inline void RPI_RwLockInit( rpi_rwlock_t* lock )
+{
+    RPI_AtomicStore( &lock->word, 0 );
+}
+
+
+static inline int RPI_ReadTryLock( rpi_rwlock_t* lock )
+{
+    uint32_t word = RPI_AtomicLoad( &lock->word );
+
+    if( ( word & RPI_RWLOCK_WRITER ) || ( RPI_AtomicCompareExchangeRelaxed( &lock->word, word, word + 1 ) != word ) )
+        return 0;
+
+    RPI_SmpMemoryBarrier();
+    return 1;
+}
+
+
+static inline void RPI_ReadLock( rpi_rwlock_t* lock )
+{
+    while( 1 )
+    {
+        uint32_t word = RPI_AtomicLoad( &lock->word );
+
+        if( word & RPI_RWLOCK_WRITER )
+            RPI_WaitForEvent();
+        else if( RPI_AtomicCompareExchangeRelaxed( &lock->word, word, word + 1 ) == word )
+            break;
+    }
+
+    RPI_SmpMemoryBarrier();
+}
+
+
+static inline void RPI_ReadUnlock( rpi_rwlock_t* lock )
+{
+    RPI_SmpMemoryBarrier();
+
+    /* The last reader out wakes any waiting writer */
+    if( RPI_AtomicFetchAddRelaxed( &lock->word, -1 ) == 1 )
+        RPI_LockWake();
+}
+
+
+static inline int RPI_WriteTryLock( rpi_rwlock_t* lock )
+{
+    if( RPI_AtomicCompareExchangeRelaxed( &lock->word, 0, RPI_RWLOCK_WRITER ) != 0 )
+        return 0;
+
+    RPI_SmpMemoryBarrier();
+    return 1;
+}
+
+
+static inline void RPI_WriteLock( rpi_rwlock_t* lock )
+{
+    while( RPI_AtomicCompareExchangeRelaxed( &lock->word, 0, RPI_RWLOCK_WRITER ) != 0 )
+        RPI_WaitForEvent();
+
+    RPI_SmpMemoryBarrier();
+}
+
+
+static inline void RPI_WriteUnlock( rpi_rwlock_t* lock )
+{
+    RPI_AtomicStoreRelease( &lock->word, 0 );
+    RPI_LockWake();
+}
+
+#endif
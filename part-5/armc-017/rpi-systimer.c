@@ -12,6 +12,7 @@
 #include "rpi-systimer.h"
 
 static rpi_sys_timer_t* rpiSystemTimer = (rpi_sys_timer_t*)RPI_SYSTIMER_BASE;
+static uint32_t compare_period = 0;
 
 rpi_sys_timer_t* RPI_GetSystemTimer(void)
 {
@@ -65,6 +66,49 @@ void RPI_TimeEvent( rpi_cpu_time_t* cputime, uint32_t us )
     }
 }
 
+/**
+* @fn void RPI_SystemTimerCompareInit( uint32_t period_us )
+* @brief Start a periodic interrupt from compare channel 1 of the system timer
+*
+* The interrupt also needs enabling in the interrupt controller with
+* RPI_EnableSystemTimerInterrupt()
+*/
+void RPI_SystemTimerCompareInit( uint32_t period_us )
+{
+    compare_period = period_us;
+    rpiSystemTimer->compare1 = rpiSystemTimer->counter_lo + period_us;
+    rpiSystemTimer->control_status = RPI_SYSTIMER_CS_M1;
+}
+
+/**
+* @fn int32_t RPI_SystemTimerCompareHandler( void )
+* @brief Service the compare channel 1 interrupt
+* @return The interrupt entry latency in microseconds, or -1 if the compare hadn't matched
+*
+* The compare value is exactly when the interrupt was raised, so the difference between it and the
+* counter gives us the time it took to get into the handler.
+*/
+int32_t RPI_SystemTimerCompareHandler( void )
+{
+    uint32_t now = rpiSystemTimer->counter_lo;
+    uint32_t compare;
+
+    if( ( rpiSystemTimer->control_status & RPI_SYSTIMER_CS_M1 ) == 0 )
+        return -1;
+
+    compare = rpiSystemTimer->compare1;
+
+    /* Schedule the next compare from the last one so that the period doesn't drift. If we've
+       been held off for longer than a period, don't try to catch up */
+    rpiSystemTimer->compare1 = compare + compare_period;
+    if( (int32_t)( compare + compare_period - now ) <= 0 )
+        rpiSystemTimer->compare1 = now + compare_period;
+
+    rpiSystemTimer->control_status = RPI_SYSTIMER_CS_M1;
+
+    return (int32_t)( now - compare );
+}
+
 void RPI_WaitMicroSeconds( uint32_t us )
 {
     volatile uint32_t ts = rpiSystemTimer->counter_lo;
@@ -17,6 +17,11 @@
 
 #define RPI_SYSTIMER_BASE       ( PERIPHERAL_BASE + 0x3000 )
 
+/** @brief The compare match bits in the control/status register. Compare channels 0 and 2 are
+    used by the GPU, so only channels 1 and 3 are available to the ARM. Write 1 to clear */
+#define RPI_SYSTIMER_CS_M1      ( 1 << 1 )
+#define RPI_SYSTIMER_CS_M3      ( 1 << 3 )
+
 typedef struct {
   uint32_t lo;
   uint32_t hi;
@@ -37,5 +42,7 @@ extern rpi_sys_timer_t* RPI_GetSystemTimer(void);
 extern void RPI_WaitMicroSeconds( uint32_t us );
 extern void RPI_GetCurrentCpuTime( rpi_cpu_time_t* cputime );
 extern void RPI_TimeEvent( rpi_cpu_time_t* cputime, uint32_t us );
+extern void RPI_SystemTimerCompareInit( uint32_t period_us );
+extern int32_t RPI_SystemTimerCompareHandler( void );
 
 #endif
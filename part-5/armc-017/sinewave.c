@@ -13,12 +13,18 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include "pool.h"
 #include "rpi-framebuffer.h"
 #include "sinewave.h"
 
+POOL_DEFINE( sinewave, sinewave_t, 16 )
+
 sinewave_t* SIN_New( int amplitude, int frequency, framebuffer_info_t* fb)
 {
-    sinewave_t* newsine = malloc( sizeof(sinewave_t) );
+    sinewave_t* newsine = sinewave_pool_alloc();
+
+    if( newsine == NULL )
+        return NULL;
 
     newsine->amplitude = amplitude;
     newsine->steps = (fb) ? fb->physical_width : 360;
@@ -36,3 +42,13 @@ sinewave_t* SIN_New( int amplitude, int frequency, framebuffer_info_t* fb)
 
     return newsine;
 }
+
+
+void SIN_Free( sinewave_t* sine )
+{
+    if( sine == NULL )
+        return;
+
+    free( sine->data );
+    sinewave_pool_free( sine );
+}
@@ -20,5 +20,6 @@ typedef struct {
     } sinewave_t;
 
 extern sinewave_t* SIN_New( int amplitude, int frequency, framebuffer_info_t* fb );
+extern void SIN_Free( sinewave_t* sine );
 
 #endif
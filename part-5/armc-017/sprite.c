@@ -0,0 +1,318 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* Sprites with transparency.
+
+   Testing every pixel of a sprite against a colour key (or its alpha) as it's drawn costs a
+   compare and a branch per pixel, and most of those pixels are usually transparent. Instead each
+   row of the sprite is scanned once, when it's created, into spans - runs of pixels that are
+   drawn. Opaque spans are copied with memcpy(), spans of partly transparent pixels are blended,
+   and the transparent pixels between them are never read at all.
+
+   A sprite can also be drawn with a constant alpha, which is applied on top of its own. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sprite.h"
+
+/* What to do with a pixel */
+typedef enum {
+    SPRITE_PIXEL_TRANSPARENT = 0,
+    SPRITE_PIXEL_OPAQUE,
+    SPRITE_PIXEL_BLEND,
+    } sprite_pixel_t;
+
+
+static sprite_pixel_t sprite_classify( const uint8_t* pixel, int bpp, uint32_t key, int flags )
+{
+    uint32_t value;
+    uint32_t mask;
+
+    if( bpp == 1 )
+    {
+        value = *pixel;
+        mask = 0xFF;
+    }
+    else if( bpp == 2 )
+    {
+        value = *(const uint16_t*)pixel;
+        mask = 0xFFFF;
+    }
+    else
+    {
+        /* The alpha of a 32bpp pixel isn't part of its colour */
+        value = *(const uint32_t*)pixel;
+        mask = 0x00FFFFFF;
+    }
+
+    if( ( flags & SPRITE_COLOUR_KEY ) && ( ( value & mask ) == ( key & mask ) ) )
+        return SPRITE_PIXEL_TRANSPARENT;
+
+    if( ( flags & SPRITE_ALPHA ) && ( bpp == 4 ) )
+    {
+        if( ( value >> 24 ) == 0 )
+            return SPRITE_PIXEL_TRANSPARENT;
+
+        if( ( value >> 24 ) != 0xFF )
+            return SPRITE_PIXEL_BLEND;
+    }
+
+    return SPRITE_PIXEL_OPAQUE;
+}
+
+
+/* Find the spans of a row, which starts offset bytes into the pixels. Returns the number of spans
+   and fills in spans when it isn't NULL */
+static int sprite_row( const uint8_t* row, uint32_t offset, int width, int bpp, uint32_t key,
+                       int flags, sprite_span_t* spans )
+{
+    int count = 0;
+    int x = 0;
+
+    while( x < width )
+    {
+        sprite_pixel_t type = sprite_classify( row + ( x * bpp ), bpp, key, flags );
+        int start = x++;
+
+        if( type == SPRITE_PIXEL_TRANSPARENT )
+            continue;
+
+        while( ( x < width ) && ( sprite_classify( row + ( x * bpp ), bpp, key, flags ) == type ) )
+            x++;
+
+        if( spans )
+        {
+            spans[count].x = start;
+            spans[count].length = x - start;
+            spans[count].blend = ( type == SPRITE_PIXEL_BLEND );
+            spans[count].offset = offset + ( start * bpp );
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+
+/**
+    @brief Create a sprite from width x height pixels
+    @param pixels The pixels, which aren't copied and must stay around as long as the sprite
+    @param key The colour that's transparent with SPRITE_COLOUR_KEY, in the pixels' format
+    @param flags SPRITE_COLOUR_KEY and/or SPRITE_ALPHA
+    @return The sprite, or NULL if there isn't the memory
+
+    The spans are found here, so this is the slow part - create sprites once and keep them.
+*/
+sprite_t* SPRITE_Create( const void* pixels, int pitch, int width, int height,
+                         surface_format_t format, uint32_t key, int flags )
+{
+    const uint8_t* src = pixels;
+    const int bpp = SURFACE_BytesPerPixel( format );
+    sprite_span_t* spans;
+    uint32_t* rows;
+    sprite_t* sprite;
+    int count = 0;
+
+    if( ( width <= 0 ) || ( height <= 0 ) || ( width > 0xFFFF ) )
+        return NULL;
+
+    for( int y = 0; y < height; y++ )
+        count += sprite_row( src + ( y * pitch ), 0, width, bpp, key, flags, NULL );
+
+    /* The sprite, its spans and its row table are one allocation */
+    sprite = malloc( sizeof( sprite_t ) + ( count * sizeof( sprite_span_t ) ) +
+                     ( ( height + 1 ) * sizeof( uint32_t ) ) );
+
+    if( sprite == NULL )
+        return NULL;
+
+    spans = (sprite_span_t*)( sprite + 1 );
+    rows = (uint32_t*)( spans + count );
+    count = 0;
+
+    for( int y = 0; y < height; y++ )
+    {
+        rows[y] = count;
+        count += sprite_row( src + ( y * pitch ), y * pitch, width, bpp, key, flags, &spans[count] );
+    }
+
+    rows[height] = count;
+
+    sprite->width = width;
+    sprite->height = height;
+    sprite->format = format;
+    sprite->bytes_per_pixel = bpp;
+    sprite->pixels = src;
+    sprite->rows = rows;
+    sprite->spans = spans;
+
+    return sprite;
+}
+
+
+sprite_t* SPRITE_FromImage( const image_t* image, uint32_t key, int flags )
+{
+    return SPRITE_Create( image->pixel_data, image->pitch, image->width, image->height,
+                          SURFACE_FormatFromDepth( image->bytes_per_pixel * 8 ), key, flags );
+}
+
+
+/**
+    @brief Free a sprite made by SPRITE_Create(). The const sprites create-sprite.py makes aren't
+    freed
+*/
+void SPRITE_Free( sprite_t* sprite )
+{
+    free( sprite );
+}
+
+
+/* Blend count RGB565 pixels over dest with an alpha of 0 to 32. Both pixels are spread out to
+   0x07E0F81F - green at the top, red and blue at the bottom - so all three channels are blended
+   with one multiply and have room for it */
+static void blend_rgb565_span( uint16_t* dest, const uint16_t* src, int count, uint32_t alpha )
+{
+    for( int i = 0; i < count; i++ )
+    {
+        uint32_t s = src[i];
+        uint32_t d = dest[i];
+
+        s = ( s | ( s << 16 ) ) & 0x07E0F81F;
+        d = ( d | ( d << 16 ) ) & 0x07E0F81F;
+        d = ( ( ( ( s - d ) * alpha ) >> 5 ) + d ) & 0x07E0F81F;
+
+        dest[i] = d | ( d >> 16 );
+    }
+}
+
+
+/* Blend count ARGB8888 pixels over dest with an alpha of 0 to 255, multiplied by each pixel's own
+   alpha when per_pixel is set. Red and blue are blended together, and the destination keeps its
+   alpha */
+static void blend_argb8888_span( uint32_t* dest, const uint32_t* src, int count, uint32_t alpha,
+                                 int per_pixel )
+{
+    for( int i = 0; i < count; i++ )
+    {
+        uint32_t s = src[i];
+        uint32_t d = dest[i];
+        uint32_t a = per_pixel ? ( ( ( s >> 24 ) * ( alpha + 1 ) ) >> 8 ) : alpha;
+        uint32_t rb;
+        uint32_t g;
+
+        /* 0 to 256, so that 255 is the source pixel */
+        a += a >> 7;
+
+        rb = ( ( ( s & 0x00FF00FF ) * a ) + ( ( d & 0x00FF00FF ) * ( 256 - a ) ) ) >> 8;
+        g = ( ( ( s & 0x0000FF00 ) * a ) + ( ( d & 0x0000FF00 ) * ( 256 - a ) ) ) >> 8;
+
+        dest[i] = ( d & 0xFF000000 ) | ( rb & 0x00FF00FF ) | ( g & 0x0000FF00 );
+    }
+}
+
+
+/**
+    @brief Draw some of the columns of a sprite, at x, y on a surface of the same format
+    @param column The first column of the sprite to draw, which is drawn at x + column
+    @param alpha A constant alpha from 0 (nothing is drawn) to SPRITE_OPAQUE
+
+    Palette indices can't be blended, so at 8bpp the sprite is drawn opaque when alpha is at least
+    half and not at all when it's less.
+*/
+void SPRITE_DrawColumns( surface_t* dest, int x, int y, const sprite_t* sprite, int column,
+                         int columns, int alpha )
+{
+    const int bpp = sprite->bytes_per_pixel;
+    int left = x + column;
+    int right = left + columns;
+    int first = 0;
+    int last = sprite->height;
+
+    if( ( dest->format != sprite->format ) || ( alpha <= 0 ) )
+        return;
+
+    if( alpha > SPRITE_OPAQUE )
+        alpha = SPRITE_OPAQUE;
+
+    if( bpp == 1 )
+    {
+        if( alpha < ( SPRITE_OPAQUE + 1 ) / 2 )
+            return;
+
+        alpha = SPRITE_OPAQUE;
+    }
+
+    if( left < x )
+        left = x;
+
+    if( left < 0 )
+        left = 0;
+
+    if( right > dest->width )
+        right = dest->width;
+
+    if( y < 0 )
+        first = -y;
+
+    if( ( y + last ) > dest->height )
+        last = dest->height - y;
+
+    if( left >= right )
+        return;
+
+    for( int row = first; row < last; row++ )
+    {
+        uint8_t* out = SURFACE_PixelAddress( dest, 0, y + row );
+
+        for( uint32_t s = sprite->rows[row]; s < sprite->rows[row + 1]; s++ )
+        {
+            const sprite_span_t* span = &sprite->spans[s];
+            const uint8_t* in = sprite->pixels + span->offset;
+            int x0 = x + span->x;
+            int x1 = x0 + span->length;
+
+            /* Spans are in order, so none of the rest of the row is visible either */
+            if( x0 >= right )
+                break;
+
+            if( x0 < left )
+            {
+                in += ( left - x0 ) * bpp;
+                x0 = left;
+            }
+
+            if( x1 > right )
+                x1 = right;
+
+            if( x0 >= x1 )
+                continue;
+
+            if( ( alpha == SPRITE_OPAQUE ) && !span->blend )
+                memcpy( out + ( x0 * bpp ), in, ( x1 - x0 ) * bpp );
+            else if( bpp == 2 )
+                blend_rgb565_span( (uint16_t*)out + x0, (const uint16_t*)in, x1 - x0, ( alpha + 4 ) >> 3 );
+            else
+                blend_argb8888_span( (uint32_t*)out + x0, (const uint32_t*)in, x1 - x0, alpha, span->blend );
+        }
+    }
+}
+
+
+/**
+    @brief Draw a sprite at x, y on a surface of the same format. Transparent pixels are skipped
+    @param alpha A constant alpha from 0 to SPRITE_OPAQUE, see SPRITE_DrawColumns()
+*/
+void SPRITE_Draw( surface_t* dest, int x, int y, const sprite_t* sprite, int alpha )
+{
+    SPRITE_DrawColumns( dest, x, y, sprite, 0, sprite->width, alpha );
+}
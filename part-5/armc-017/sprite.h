@@ -0,0 +1,54 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include <stdint.h>
+
+#include "image.h"
+#include "surface.h"
+
+/** @brief Flags for SPRITE_Create() */
+#define SPRITE_COLOUR_KEY       ( 1 << 0 )  /**< Pixels that match the key are transparent */
+#define SPRITE_ALPHA            ( 1 << 1 )  /**< Blend ARGB8888 pixels by their own alpha */
+
+/** @brief The constant alpha that draws a sprite as it is */
+#define SPRITE_OPAQUE           255
+
+/** @brief A run of pixels on a row of a sprite that are drawn */
+typedef struct {
+    uint16_t x;                 /**< The first pixel of the run */
+    uint16_t length;
+    uint8_t blend;              /**< The pixels are partly transparent and are blended */
+    uint32_t offset;            /**< The byte offset of the first pixel from the sprite's pixels */
+    } sprite_span_t;
+
+/** @brief A sprite is its pixels and the runs of them on each row that aren't transparent, so
+    drawing one never looks at a transparent pixel */
+typedef struct {
+    int width;
+    int height;
+    surface_format_t format;
+    int bytes_per_pixel;
+    const uint8_t* pixels;
+    const uint32_t* rows;       /**< height + 1 entries. Row y's spans are rows[y] to rows[y + 1] */
+    const sprite_span_t* spans;
+    } sprite_t;
+
+extern sprite_t* SPRITE_Create( const void* pixels, int pitch, int width, int height,
+                                surface_format_t format, uint32_t key, int flags );
+extern sprite_t* SPRITE_FromImage( const image_t* image, uint32_t key, int flags );
+extern void SPRITE_Free( sprite_t* sprite );
+extern void SPRITE_Draw( surface_t* dest, int x, int y, const sprite_t* sprite, int alpha );
+extern void SPRITE_DrawColumns( surface_t* dest, int x, int y, const sprite_t* sprite, int column,
+                                int columns, int alpha );
+
+#endif
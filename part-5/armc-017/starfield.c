@@ -8,6 +8,7 @@
 
 */
 
+#include "effects.h"
 #include "starfield.h"
 #include "stars.h"
 #include "rpi-framebuffer.h"
@@ -24,9 +25,23 @@ static void init_starfield( void )
     }
 }
 
+/**
+    @brief Set the palette ramp the stars use at 8bpp, from dark to white
+*/
+void starfield_set_palette( void )
+{
+    palette_entry_t entries[RPI_PALETTE_SIZE - STARFIELD_PALETTE_FIRST];
+    int count = RPI_PALETTE_SIZE - STARFIELD_PALETTE_FIRST;
+
+    FX_PaletteGradient( entries, count, RPI_PALETTE_RGB( 0, 0, 32 ), RPI_PALETTE_RGB( 255, 255, 255 ) );
+    RPI_SetPalette( STARFIELD_PALETTE_FIRST, count, entries );
+}
+
 void process_starfield( void )
 {
     static int init = 1;
+    surface_t* surface = RPI_GetDrawSurface();
+    int width = surface->width;
 
     if( init )
     {
@@ -40,12 +55,18 @@ void process_starfield( void )
 
         if( ( stars[i].x >> 4 ) <= 0 )
         {
-            stars[i].x = 800 << 4;
+            stars[i].x = width << 4;
         }
 
-        if( ( stars[i].x >> 4 ) < 800 )
+        if( ( stars[i].x >> 4 ) < width )
         {
-            RPI_PutPixel( stars[i].x >> 4, stars[i].y, star_colours[stars[i].speed] );
+            /* At 8bpp the colour is a palette index, scaled from the 32 speeds to the ramp */
+            if( surface->bytes_per_pixel == 1 )
+                RPI_PutPixel( stars[i].x >> 4, stars[i].y % surface->height,
+                              STARFIELD_PALETTE_FIRST +
+                              ( ( stars[i].speed * ( RPI_PALETTE_SIZE - STARFIELD_PALETTE_FIRST ) ) >> 5 ) );
+            else
+                RPI_PutPixel( stars[i].x >> 4, stars[i].y, star_colours[stars[i].speed] );
         }
     }
 }
@@ -11,6 +11,11 @@
 #ifndef STARTFIELD_H
 #define STARTFIELD_H
 
+/** @brief At 8bpp the stars are drawn with a ramp of palette entries from here to the end of the
+    palette, one for each speed */
+#define STARFIELD_PALETTE_FIRST     224
+
 extern void process_starfield( void );
+extern void starfield_set_palette( void );
 
 #endif
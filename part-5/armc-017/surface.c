@@ -0,0 +1,144 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* Surfaces describe a rectangle of pixels wherever it lives. The framebuffer's two buffers are
+   surfaces in uncached VideoCore memory. Surfaces made with SURFACE_Create() are in cached memory
+   from the heap, which is the place to render anything that reads back what it has drawn
+   (blending, feedback) because reads from the framebuffer are very slow. A finished cached
+   surface is presented to the screen in one streaming copy with RPI_Present() */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rpi-base.h"
+#include "surface.h"
+
+static const int format_bytes_per_pixel[SURFACE_FORMAT_COUNT] = { 1, 2, 4 };
+
+
+int SURFACE_BytesPerPixel( surface_format_t format )
+{
+    return ( format < SURFACE_FORMAT_COUNT ) ? format_bytes_per_pixel[format] : 0;
+}
+
+
+/**
+    @brief Return the surface format for a framebuffer depth
+*/
+surface_format_t SURFACE_FormatFromDepth( int bits_per_pixel )
+{
+    if( bits_per_pixel == 8 )
+        return SURFACE_FORMAT_PAL8;
+    else if( bits_per_pixel == 16 )
+        return SURFACE_FORMAT_RGB565;
+
+    return SURFACE_FORMAT_ARGB8888;
+}
+
+
+/**
+    @brief Describe existing memory as a surface
+*/
+void SURFACE_Init( surface_t* surface, int width, int height, int pitch, surface_format_t format,
+                   void* memory, int cached )
+{
+    surface->width = width;
+    surface->height = height;
+    surface->pitch = pitch;
+    surface->format = format;
+    surface->bytes_per_pixel = SURFACE_BytesPerPixel( format );
+    surface->memory = memory;
+    surface->cached = cached;
+    surface->owned = 0;
+}
+
+
+/**
+    @brief Create a surface in cached memory
+    @return The surface, or NULL if there isn't enough memory
+
+    The memory and every row are aligned to a cache line.
+*/
+surface_t* SURFACE_Create( int width, int height, surface_format_t format )
+{
+    surface_t* surface = malloc( sizeof( surface_t ) );
+    int pitch = width * SURFACE_BytesPerPixel( format );
+    void* memory;
+
+    if( surface == NULL )
+        return NULL;
+
+    pitch = ( pitch + ( SURFACE_PITCH_ALIGN - 1 ) ) & ~( SURFACE_PITCH_ALIGN - 1 );
+    memory = memalign( RPI_CACHE_LINE_SIZE, pitch * height );
+
+    if( memory == NULL )
+    {
+        free( surface );
+        return NULL;
+    }
+
+    SURFACE_Init( surface, width, height, pitch, format, memory, 1 );
+    surface->owned = 1;
+
+    return surface;
+}
+
+
+/**
+    @brief Free a surface from SURFACE_Create()
+*/
+void SURFACE_Free( surface_t* surface )
+{
+    if( surface == NULL )
+        return;
+
+    if( surface->owned )
+    {
+        free( surface->memory );
+        free( surface );
+    }
+}
+
+
+/**
+    @brief Fill a whole surface with a colour
+*/
+void SURFACE_Clear( surface_t* surface, uint32_t colour )
+{
+    uint32_t word = colour;
+
+    if( surface->bytes_per_pixel == 1 )
+        word = ( colour & 0xFF ) * 0x01010101;
+    else if( surface->bytes_per_pixel == 2 )
+        word = ( colour & 0xFFFF ) * 0x00010001;
+
+    for( int y = 0; y < surface->height; y++ )
+    {
+        uint8_t* row = surface->memory + ( y * surface->pitch );
+
+        /* Most clears are to black, which is a memset whatever the format */
+        if( word == ( word & 0xFF ) * 0x01010101 )
+        {
+            memset( row, word & 0xFF, surface->width * surface->bytes_per_pixel );
+        }
+        else if( surface->bytes_per_pixel == 2 )
+        {
+            for( int x = 0; x < surface->width; x++ )
+                ( (uint16_t*)row )[x] = colour;
+        }
+        else
+        {
+            for( int x = 0; x < surface->width; x++ )
+                ( (uint32_t*)row )[x] = colour;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef SURFACE_H
+#define SURFACE_H
+
+#include <stdint.h>
+
+#include "rpi-base.h"
+
+/** @brief The pixel formats a surface can hold */
+typedef enum {
+    SURFACE_FORMAT_PAL8 = 0,        /**< 8-bit palette indices */
+    SURFACE_FORMAT_RGB565,
+    SURFACE_FORMAT_ARGB8888,
+    SURFACE_FORMAT_COUNT,
+    } surface_format_t;
+
+/** @brief Rows of surfaces created by SURFACE_Create() start on a cache line so that rows don't
+    share lines, which keeps the cache maintenance for a rectangle to the rectangle */
+#define SURFACE_PITCH_ALIGN     RPI_CACHE_LINE_SIZE
+
+/** @brief A rectangle of pixels in memory. The framebuffer's buffers are surfaces, and so is
+    anything else that can be drawn into */
+typedef struct {
+    int width;
+    int height;
+    int pitch;                  /**< The distance in bytes between the start of each row */
+    surface_format_t format;
+    int bytes_per_pixel;
+    uint8_t* memory;            /**< The top left pixel */
+    int cached;                 /**< The memory is cached, so must be cleaned before the GPU or a
+                                     DMA engine reads it */
+    int owned;                  /**< The memory was allocated by SURFACE_Create() */
+    } surface_t;
+
+/**
+    @brief Return the address of a pixel. There's no clipping
+*/
+static inline uint8_t* SURFACE_PixelAddress( const surface_t* surface, int x, int y )
+{
+    return surface->memory + ( y * surface->pitch ) + ( x * surface->bytes_per_pixel );
+}
+
+extern int SURFACE_BytesPerPixel( surface_format_t format );
+extern surface_format_t SURFACE_FormatFromDepth( int bits_per_pixel );
+extern void SURFACE_Init( surface_t* surface, int width, int height, int pitch,
+                          surface_format_t format, void* memory, int cached );
+extern surface_t* SURFACE_Create( int width, int height, surface_format_t format );
+extern void SURFACE_Free( surface_t* surface );
+extern void SURFACE_Clear( surface_t* surface, uint32_t colour );
+
+#endif
@@ -0,0 +1,775 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A preemptive, fixed-priority task scheduler. The highest priority ready task always runs, and
+   tasks of equal priority share the processor in time slices. Each task has its own stack. The
+   context switch itself is _task_switch in armc-start.S.
+
+   A switch happens either in thread context when the running task sleeps, blocks, yields or makes
+   a higher priority task ready, or on the way out of an interrupt (see _irq_entry in
+   armc-start.S) when the interrupt handler has made a higher priority task ready or the time
+   slice has run out. Interrupt handlers run on the stack of the task they interrupt, so a task
+   preempted by an interrupt is simply switched away from in the middle of the interrupt exit path
+   and finishes returning from the interrupt when it's next switched back to.
+
+   Each core runs its own scheduler with its own ready queues, and a task only ever runs on the
+   core that created it. Core 0's scheduler is ticked by the ARM Timer, which only interrupts core
+   0, and the other cores' schedulers by their own generic timers. The semaphores and mutexes are for tasks on the same core. Everything
+   here runs with IRQs masked, so a task that's switched back to returns with the IRQ mask it had
+   when it was switched away from. */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rpi-barrier.h"
+#include "rpi-interrupts.h"
+#include "rpi-local-intc.h"
+#include "rpi-smp.h"
+#include "rpi-systimer.h"
+#include "task.h"
+
+/* The number of words in the frame _task_switch pushes: d8-d15, r4-r11 and lr */
+#define TASK_FRAME_WORDS    ( 16 + 8 + 1 )
+#define TASK_FRAME_R4       ( 16 )
+#define TASK_FRAME_R5       ( 17 )
+#define TASK_FRAME_LR       ( 24 )
+
+#define TASK_IDLE_STACK_SIZE    ( 4 * 1024 )
+
+typedef struct {
+    task_t* current;
+    task_t* ready_head[TASK_PRIORITY_COUNT];
+    task_t* ready_tail[TASK_PRIORITY_COUNT];
+    uint32_t ready_mask;        /**< Bit n is set when there's a ready task at priority n */
+    task_t* sleeping;           /**< Sorted by wake time, soonest first */
+    task_t* dead;               /**< Tasks waiting for their stacks to be freed */
+    task_t main_task;           /**< The context that called TASK_Init() */
+    int in_interrupt;
+    int need_switch;            /**< Switch task on the way out of the interrupt */
+    uint32_t slice_ticks;
+    task_stats_t stats;
+    } task_scheduler_t;
+
+extern void _task_switch( uint32_t* save_sp, uint32_t restore_sp );
+extern void _task_start( void );
+
+static task_scheduler_t schedulers[RPI_CORE_COUNT];
+
+
+/* Wrap-safe comparison of two system timer values */
+static inline int time_reached( uint32_t now, uint32_t time )
+{
+    return (int32_t)( now - time ) >= 0;
+}
+
+
+static inline int highest_ready( task_scheduler_t* scheduler )
+{
+    if( scheduler->ready_mask == 0 )
+        return TASK_PRIORITY_COUNT;
+
+    return __builtin_ctz( scheduler->ready_mask );
+}
+
+
+static void ready_push( task_scheduler_t* scheduler, task_t* task )
+{
+    int priority = task->priority;
+
+    task->state = TASK_READY;
+    task->next = NULL;
+
+    if( scheduler->ready_tail[priority] )
+        scheduler->ready_tail[priority]->next = task;
+    else
+        scheduler->ready_head[priority] = task;
+
+    scheduler->ready_tail[priority] = task;
+    scheduler->ready_mask |= ( 1UL << priority );
+}
+
+
+static task_t* ready_pop( task_scheduler_t* scheduler )
+{
+    int priority = highest_ready( scheduler );
+    task_t* task;
+
+    if( priority == TASK_PRIORITY_COUNT )
+        return NULL;
+
+    task = scheduler->ready_head[priority];
+    scheduler->ready_head[priority] = task->next;
+
+    if( scheduler->ready_head[priority] == NULL )
+    {
+        scheduler->ready_tail[priority] = NULL;
+        scheduler->ready_mask &= ~( 1UL << priority );
+    }
+
+    task->next = NULL;
+    return task;
+}
+
+
+static void ready_remove( task_scheduler_t* scheduler, task_t* task )
+{
+    int priority = task->priority;
+    task_t** link = &scheduler->ready_head[priority];
+    task_t* previous = NULL;
+
+    while( *link && ( *link != task ) )
+    {
+        previous = *link;
+        link = &(*link)->next;
+    }
+
+    if( *link == NULL )
+        return;
+
+    *link = task->next;
+
+    if( scheduler->ready_tail[priority] == task )
+        scheduler->ready_tail[priority] = previous;
+
+    if( scheduler->ready_head[priority] == NULL )
+        scheduler->ready_mask &= ~( 1UL << priority );
+
+    task->next = NULL;
+}
+
+
+/* Wait lists are kept in priority order so that the highest priority waiter is always woken
+   first. Waiters of equal priority are woken in the order they started waiting */
+static void wait_insert( task_t** list, task_t* task )
+{
+    while( *list && ( (*list)->priority <= task->priority ) )
+        list = &(*list)->next;
+
+    task->next = *list;
+    *list = task;
+}
+
+
+static void wait_remove( task_t** list, task_t* task )
+{
+    while( *list && ( *list != task ) )
+        list = &(*list)->next;
+
+    if( *list )
+        *list = task->next;
+
+    task->next = NULL;
+}
+
+
+static task_t* wait_pop( task_t** list )
+{
+    task_t* task = *list;
+
+    if( task )
+    {
+        *list = task->next;
+        task->next = NULL;
+    }
+
+    return task;
+}
+
+
+static void set_priority( task_scheduler_t* scheduler, task_t* task, int priority )
+{
+    if( task->priority == priority )
+        return;
+
+    if( task->state == TASK_READY )
+    {
+        ready_remove( scheduler, task );
+        task->priority = priority;
+        ready_push( scheduler, task );
+    }
+    else if( ( task->state == TASK_BLOCKED ) && task->blocked_on )
+    {
+        wait_remove( &task->blocked_on->waiters, task );
+        task->priority = priority;
+        wait_insert( &task->blocked_on->waiters, task );
+    }
+    else
+    {
+        task->priority = priority;
+    }
+}
+
+
+static void wake_sleepers( task_scheduler_t* scheduler )
+{
+    uint32_t now = RPI_GetSystemTimer()->counter_lo;
+
+    while( scheduler->sleeping && time_reached( now, scheduler->sleeping->wake_time ) )
+    {
+        task_t* task = scheduler->sleeping;
+        scheduler->sleeping = task->next;
+        ready_push( scheduler, task );
+    }
+}
+
+
+static void reap_dead( task_scheduler_t* scheduler )
+{
+    while( scheduler->dead && ( scheduler->dead != scheduler->current ) )
+    {
+        task_t* task = scheduler->dead;
+        scheduler->dead = task->next;
+        free( task->stack );
+        free( task );
+    }
+}
+
+
+/* Switch to the highest priority ready task. The current task must already have been put on a
+   ready queue, the sleeping list, a wait list or the dead list. The idle task is always ready so
+   there's always something to switch to */
+static void schedule( task_scheduler_t* scheduler )
+{
+    task_t* previous = scheduler->current;
+    task_t* next = ready_pop( scheduler );
+
+    next->state = TASK_RUNNING;
+    scheduler->current = next;
+    scheduler->slice_ticks = 0;
+
+    if( next != previous )
+    {
+        scheduler->stats.switches++;
+        _task_switch( &previous->sp, next->sp );
+    }
+
+    /* We're now running as the next task (from its point of view, it's returned from here) */
+    reap_dead( scheduler );
+}
+
+
+/* A task may have been made ready that's a higher priority than the running task. Switch to it
+   now, or on the way out of the interrupt if we're in an interrupt handler */
+static void preempt( task_scheduler_t* scheduler )
+{
+    task_t* current = scheduler->current;
+
+    if( ( current == NULL ) || ( highest_ready( scheduler ) >= current->priority ) )
+        return;
+
+    if( scheduler->in_interrupt )
+    {
+        scheduler->need_switch = 1;
+    }
+    else
+    {
+        ready_push( scheduler, current );
+        schedule( scheduler );
+    }
+}
+
+
+static int effective_priority( task_t* task )
+{
+    int priority = task->base_priority;
+
+    for( task_mutex_t* mutex = task->held; mutex; mutex = mutex->next_held )
+    {
+        if( mutex->waiters && ( mutex->waiters->priority < priority ) )
+            priority = mutex->waiters->priority;
+    }
+
+    return priority;
+}
+
+
+/* Every task starts here from _task_start */
+static void task_bootstrap( task_t* task )
+{
+    task->function( task->arg );
+    TASK_Exit();
+}
+
+
+static void idle_task( void* arg )
+{
+    while( 1 )
+    {
+        RPI_WaitForInterrupt();
+    }
+}
+
+
+/**
+    @brief Called by _irq_entry in armc-start.S before the interrupt handler
+*/
+void _task_interrupt_enter( void )
+{
+    schedulers[RPI_GetCoreId()].in_interrupt = 1;
+}
+
+
+/**
+    @brief Called by _irq_entry in armc-start.S after the interrupt handler. If the handler has
+    made a higher priority task ready (or the time slice has run out) we switch task here
+*/
+void _task_interrupt_exit( void )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    task_t* current = scheduler->current;
+
+    scheduler->in_interrupt = 0;
+
+    if( !scheduler->need_switch )
+        return;
+
+    scheduler->need_switch = 0;
+
+    if( current && ( highest_ready( scheduler ) <= current->priority ) )
+    {
+        scheduler->stats.preemptions++;
+        ready_push( scheduler, current );
+        schedule( scheduler );
+    }
+}
+
+
+#if defined( RPI_LOCAL_BASE )
+/* The tick of the cores the ARM Timer interrupt doesn't go to */
+static void local_tick( int core, uint32_t ticks )
+{
+    TASK_Tick();
+}
+#endif
+
+
+/**
+    @brief Initialise the scheduler of the calling core. The caller becomes the first task and runs
+    at priority
+
+    On any core but 0 this starts the core's generic timer tick, and IRQs must be enabled on the
+    core for it to sleep or be preempted.
+*/
+void TASK_Init( int priority )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+
+    if( ( priority < 0 ) || ( priority >= TASK_PRIORITY_IDLE ) )
+        priority = TASK_PRIORITY_NORMAL;
+
+    scheduler->main_task.name = "main";
+    scheduler->main_task.state = TASK_RUNNING;
+    scheduler->main_task.priority = priority;
+    scheduler->main_task.base_priority = priority;
+    scheduler->main_task.stack = NULL;
+    scheduler->current = &scheduler->main_task;
+
+    TASK_Create( "idle", idle_task, NULL, TASK_IDLE_STACK_SIZE, TASK_PRIORITY_IDLE );
+
+#if defined( RPI_LOCAL_BASE )
+    if( RPI_GetCoreId() != 0 )
+        RPI_LocalTimerInit( RPI_LOCAL_TIMER_PHYSICAL, TASK_TICK_HZ, local_tick );
+#endif
+}
+
+
+/**
+    @brief Create a new task on the calling core. It runs straight away if it's a higher priority
+    than the calling task
+    @return The new task, or NULL if there wasn't enough memory
+*/
+task_t* TASK_Create( const char* name, task_function_t function, void* arg, uint32_t stack_size, int priority )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    task_t* task;
+    uint32_t* frame;
+    uint32_t cpsr;
+
+    if( stack_size == 0 )
+        stack_size = TASK_DEFAULT_STACK_SIZE;
+
+    if( priority < 0 )
+        priority = 0;
+
+    if( priority > TASK_PRIORITY_IDLE )
+        priority = TASK_PRIORITY_IDLE;
+
+    task = malloc( sizeof( task_t ) );
+    if( task == NULL )
+        return NULL;
+
+    task->stack = malloc( stack_size );
+    if( task->stack == NULL )
+    {
+        free( task );
+        return NULL;
+    }
+
+    task->name = name;
+    task->priority = priority;
+    task->base_priority = priority;
+    task->blocked_on = NULL;
+    task->held = NULL;
+    task->function = function;
+    task->arg = arg;
+    task->stack_size = stack_size;
+
+    /* Build the frame _task_switch will pop when it first switches to the task. The stack must be
+       8-byte aligned once the frame has been popped */
+    frame = (uint32_t*)( ( (uint32_t)task->stack + stack_size ) & ~7 );
+    frame -= TASK_FRAME_WORDS;
+
+    for( int i = 0; i < TASK_FRAME_WORDS; i++ )
+        frame[i] = 0;
+
+    frame[TASK_FRAME_R4] = (uint32_t)task;
+    frame[TASK_FRAME_R5] = (uint32_t)task_bootstrap;
+    frame[TASK_FRAME_LR] = (uint32_t)_task_start;
+    task->sp = (uint32_t)frame;
+
+    cpsr = RPI_IrqSaveDisable();
+    ready_push( scheduler, task );
+    preempt( scheduler );
+    RPI_IrqRestore( cpsr );
+
+    return task;
+}
+
+
+task_t* TASK_Current( void )
+{
+    return schedulers[RPI_GetCoreId()].current;
+}
+
+
+/**
+    @brief Let any other ready task of the same or higher priority run before returning
+*/
+void TASK_Yield( void )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    uint32_t cpsr = RPI_IrqSaveDisable();
+
+    wake_sleepers( scheduler );
+
+    if( highest_ready( scheduler ) <= scheduler->current->priority )
+    {
+        ready_push( scheduler, scheduler->current );
+        schedule( scheduler );
+    }
+
+    RPI_IrqRestore( cpsr );
+}
+
+
+/**
+    @brief Sleep the current task until the system timer reaches time (in microseconds)
+
+    Sleeping tasks are woken by the scheduler tick, so the wake-up is accurate to a tick
+*/
+void TASK_SleepUntil( uint32_t time )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    task_t* task = scheduler->current;
+    task_t** insert = &scheduler->sleeping;
+    uint32_t cpsr;
+
+    if( time_reached( RPI_GetSystemTimer()->counter_lo, time ) )
+    {
+        TASK_Yield();
+        return;
+    }
+
+    cpsr = RPI_IrqSaveDisable();
+
+    task->state = TASK_SLEEPING;
+    task->wake_time = time;
+
+    while( *insert && time_reached( time, (*insert)->wake_time ) )
+        insert = &(*insert)->next;
+
+    task->next = *insert;
+    *insert = task;
+
+    schedule( scheduler );
+
+    RPI_IrqRestore( cpsr );
+}
+
+
+/**
+    @brief Sleep the current task for us microseconds
+*/
+void TASK_Sleep( uint32_t us )
+{
+    TASK_SleepUntil( RPI_GetSystemTimer()->counter_lo + us );
+}
+
+
+/**
+    @brief End the current task. Its stack is freed once another task is running
+*/
+void TASK_Exit( void )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    task_t* task = scheduler->current;
+
+    RPI_IrqSaveDisable();
+
+    /* The main task's stack isn't ours to free, it just never runs again */
+    task->state = TASK_DEAD;
+    if( task->stack )
+    {
+        task->next = scheduler->dead;
+        scheduler->dead = task;
+    }
+
+    schedule( scheduler );
+
+    while( 1 )
+    {
+        /* Never reached */
+    }
+}
+
+
+/**
+    @brief The scheduler tick of the calling core. Called at TASK_TICK_HZ from the ARM Timer
+    interrupt handler on core 0, and from the generic timer tick on the other cores
+*/
+void TASK_Tick( void )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    task_t* current = scheduler->current;
+
+    if( current == NULL )
+        return;
+
+    scheduler->stats.ticks++;
+    wake_sleepers( scheduler );
+
+    /* Round-robin between tasks of the same priority */
+    scheduler->slice_ticks++;
+    if( ( scheduler->slice_ticks >= TASK_TIME_SLICE_TICKS ) &&
+        ( highest_ready( scheduler ) <= current->priority ) )
+    {
+        scheduler->need_switch = 1;
+    }
+
+    preempt( scheduler );
+}
+
+
+void TASK_GetStats( task_stats_t* stats )
+{
+    *stats = schedulers[RPI_GetCoreId()].stats;
+}
+
+
+void TASK_SemaphoreInit( task_semaphore_t* semaphore, int32_t count )
+{
+    semaphore->count = count;
+    semaphore->waiters = NULL;
+}
+
+
+/**
+    @brief Take a count from the semaphore, blocking until one is available
+*/
+void TASK_SemaphoreWait( task_semaphore_t* semaphore )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    uint32_t cpsr = RPI_IrqSaveDisable();
+
+    if( semaphore->count > 0 )
+    {
+        semaphore->count--;
+    }
+    else
+    {
+        /* TASK_SemaphorePost() hands its count straight to us */
+        scheduler->current->state = TASK_BLOCKED;
+        scheduler->current->blocked_on = NULL;
+        wait_insert( &semaphore->waiters, scheduler->current );
+        schedule( scheduler );
+    }
+
+    RPI_IrqRestore( cpsr );
+}
+
+
+/**
+    @brief Take a count from the semaphore if one is available
+    @return 1 if a count was taken, 0 otherwise
+*/
+int TASK_SemaphoreTryWait( task_semaphore_t* semaphore )
+{
+    uint32_t cpsr = RPI_IrqSaveDisable();
+    int taken = 0;
+
+    if( semaphore->count > 0 )
+    {
+        semaphore->count--;
+        taken = 1;
+    }
+
+    RPI_IrqRestore( cpsr );
+
+    return taken;
+}
+
+
+/**
+    @brief Give a count to the semaphore, waking the highest priority waiter
+
+    Safe to call from an interrupt handler, in which case any switch to the woken task happens on
+    the way out of the interrupt
+*/
+void TASK_SemaphorePost( task_semaphore_t* semaphore )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    uint32_t cpsr = RPI_IrqSaveDisable();
+    task_t* task = wait_pop( &semaphore->waiters );
+
+    if( task )
+    {
+        ready_push( scheduler, task );
+        preempt( scheduler );
+    }
+    else
+    {
+        semaphore->count++;
+    }
+
+    RPI_IrqRestore( cpsr );
+}
+
+
+void TASK_MutexInit( task_mutex_t* mutex )
+{
+    mutex->owner = NULL;
+    mutex->waiters = NULL;
+    mutex->next_held = NULL;
+}
+
+
+static void mutex_take( task_mutex_t* mutex, task_t* task )
+{
+    mutex->owner = task;
+    mutex->next_held = task->held;
+    task->held = mutex;
+}
+
+
+/**
+    @brief Lock the mutex, blocking until it's available
+
+    While we're blocked the owner (and anything the owner is blocked on in turn) inherits our
+    priority so that a lower priority task can't hold us up by preempting the owner
+*/
+void TASK_MutexLock( task_mutex_t* mutex )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    task_t* current = scheduler->current;
+    uint32_t cpsr = RPI_IrqSaveDisable();
+
+    if( mutex->owner == NULL )
+    {
+        mutex_take( mutex, current );
+    }
+    else
+    {
+        task_mutex_t* chain = mutex;
+
+        current->state = TASK_BLOCKED;
+        current->blocked_on = mutex;
+        wait_insert( &mutex->waiters, current );
+
+        while( chain && chain->owner && ( current->priority < chain->owner->priority ) )
+        {
+            task_t* owner = chain->owner;
+
+            set_priority( scheduler, owner, current->priority );
+            chain = ( owner->state == TASK_BLOCKED ) ? owner->blocked_on : NULL;
+        }
+
+        /* TASK_MutexUnlock() hands the mutex straight to us */
+        schedule( scheduler );
+    }
+
+    RPI_IrqRestore( cpsr );
+}
+
+
+/**
+    @brief Lock the mutex if it's available
+    @return 1 if the mutex was locked, 0 otherwise
+*/
+int TASK_MutexTryLock( task_mutex_t* mutex )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    uint32_t cpsr = RPI_IrqSaveDisable();
+    int locked = 0;
+
+    if( mutex->owner == NULL )
+    {
+        mutex_take( mutex, scheduler->current );
+        locked = 1;
+    }
+
+    RPI_IrqRestore( cpsr );
+
+    return locked;
+}
+
+
+/**
+    @brief Unlock the mutex, handing it to the highest priority waiter. Any priority we inherited
+    through the mutex is dropped
+*/
+void TASK_MutexUnlock( task_mutex_t* mutex )
+{
+    task_scheduler_t* scheduler = &schedulers[RPI_GetCoreId()];
+    task_t* current = scheduler->current;
+    task_mutex_t** held = &current->held;
+    task_t* task;
+    uint32_t cpsr = RPI_IrqSaveDisable();
+
+    if( mutex->owner != current )
+    {
+        RPI_IrqRestore( cpsr );
+        return;
+    }
+
+    while( *held && ( *held != mutex ) )
+        held = &(*held)->next_held;
+
+    if( *held )
+        *held = mutex->next_held;
+
+    mutex->next_held = NULL;
+    mutex->owner = NULL;
+
+    task = wait_pop( &mutex->waiters );
+    if( task )
+    {
+        task->blocked_on = NULL;
+        mutex_take( mutex, task );
+        ready_push( scheduler, task );
+
+        /* The new owner inherits from anything still waiting for the mutex */
+        set_priority( scheduler, task, effective_priority( task ) );
+    }
+
+    current->priority = effective_priority( current );
+    preempt( scheduler );
+
+    RPI_IrqRestore( cpsr );
+}
@@ -0,0 +1,121 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef TASK_H
+#define TASK_H
+
+#include <stdint.h>
+
+/** @brief The default stack size for a new task. Interrupt handlers run on the stack of the task
+    they interrupt, so every stack needs some room for them too */
+#define TASK_DEFAULT_STACK_SIZE     ( 16 * 1024 )
+
+/** @brief The scheduler tick rate, driven by the ARM Timer interrupt */
+#define TASK_TICK_HZ                1000
+
+/** @brief The number of ticks a task runs for before another ready task of the same priority is
+    given the processor */
+#define TASK_TIME_SLICE_TICKS       10
+
+/** @brief Task priorities. 0 is the highest priority. The lowest priority is reserved for the idle
+    task */
+#define TASK_PRIORITY_COUNT         32
+#define TASK_PRIORITY_HIGH          0
+#define TASK_PRIORITY_NORMAL        8
+#define TASK_PRIORITY_LOW           16
+#define TASK_PRIORITY_IDLE          ( TASK_PRIORITY_COUNT - 1 )
+
+typedef enum {
+    TASK_READY = 0,
+    TASK_RUNNING,
+    TASK_SLEEPING,
+    TASK_BLOCKED,
+    TASK_DEAD,
+    } task_state_t;
+
+typedef void (*task_function_t)( void* arg );
+
+typedef struct task_t task_t;
+typedef struct task_mutex_t task_mutex_t;
+
+struct task_t {
+    /** The saved stack pointer while the task isn't running. Must be the first member */
+    uint32_t sp;
+
+    const char* name;
+    task_state_t state;
+
+    /** The priority the task is scheduled at, raised above base_priority while it holds a mutex
+        a higher priority task is waiting for */
+    int priority;
+    int base_priority;
+
+    /** The system timer (counter_lo) value to wake at while sleeping */
+    uint32_t wake_time;
+
+    /** The next task in the ready queue, sleeping list or wait list the task is on */
+    task_t* next;
+
+    /** The mutex the task is blocked on, if any */
+    task_mutex_t* blocked_on;
+
+    /** The mutexes the task holds */
+    task_mutex_t* held;
+
+    task_function_t function;
+    void* arg;
+
+    /** The task's stack, NULL for the task that called TASK_Init() */
+    uint8_t* stack;
+    uint32_t stack_size;
+    };
+
+/** @brief A counting semaphore. TASK_SemaphorePost() may be called from an interrupt handler */
+typedef struct {
+    volatile int32_t count;
+    task_t* waiters;
+    } task_semaphore_t;
+
+/** @brief A mutex with priority inheritance. Only the owner may unlock it and it may not be used
+    from an interrupt handler */
+struct task_mutex_t {
+    task_t* owner;
+    task_t* waiters;
+    task_mutex_t* next_held;
+    };
+
+/** @brief Scheduler statistics for the calling core */
+typedef struct {
+    uint32_t switches;      /**< All context switches */
+    uint32_t preemptions;   /**< Context switches made on the way out of an interrupt */
+    uint32_t ticks;
+    } task_stats_t;
+
+extern void TASK_Init( int priority );
+extern task_t* TASK_Create( const char* name, task_function_t function, void* arg, uint32_t stack_size, int priority );
+extern task_t* TASK_Current( void );
+extern void TASK_Yield( void );
+extern void TASK_SleepUntil( uint32_t time );
+extern void TASK_Sleep( uint32_t us );
+extern void TASK_Exit( void );
+extern void TASK_Tick( void );
+extern void TASK_GetStats( task_stats_t* stats );
+
+extern void TASK_SemaphoreInit( task_semaphore_t* semaphore, int32_t count );
+extern void TASK_SemaphoreWait( task_semaphore_t* semaphore );
+extern int TASK_SemaphoreTryWait( task_semaphore_t* semaphore );
+extern void TASK_SemaphorePost( task_semaphore_t* semaphore );
+
+extern void TASK_MutexInit( task_mutex_t* mutex );
+extern void TASK_MutexLock( task_mutex_t* mutex );
+extern int TASK_MutexTryLock( task_mutex_t* mutex );
+extern void TASK_MutexUnlock( task_mutex_t* mutex );
+
+#endif
@@ -0,0 +1,511 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A tile binned display list renderer.
+
+   Drawing straight into a surface in submission order means every primitive walks over a
+   different part of an 800x600 screen, and every one drags its own cache lines through the L1.
+   Instead the draw calls are recorded as commands, and each command is binned into every
+   TILE_WIDTH x TILE_HEIGHT tile it touches. Each tile is then rendered on its own in a scratch
+   buffer small enough to stay in the L1, and written to the target once, a whole row at a time.
+
+   Tiles don't depend on each other, so TILE_Render() hands them out to whichever cores are
+   available. Every core takes the next tile from a shared counter until they've all been done.
+
+   Commands are recorded into the frame arena of the core building the list (see frame-arena.c) so
+   a list only lasts until the end of the frame. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "frame-arena.h"
+#include "rpi-atomic.h"
+#include "rpi-barrier.h"
+#include "rpi-local-intc.h"
+#include "rpi-smp.h"
+#include "sprite.h"
+#include "tile-render.h"
+
+typedef enum {
+    TILE_COMMAND_RECTANGLE = 0,
+    TILE_COMMAND_BLIT,
+    TILE_COMMAND_PIXEL,
+    TILE_COMMAND_SPRITE,
+    } tile_command_type_t;
+
+struct tile_command_t {
+    uint8_t type;
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+    uint32_t colour;            /**< Or the constant alpha of a sprite */
+    union {
+        const uint8_t* data;
+        const sprite_t* sprite;
+        };
+    int pitch;                  /**< Or the first column of a sprite that's drawn */
+    };
+
+struct tile_bin_entry_t {
+    const tile_command_t* command;
+    tile_bin_entry_t* next;
+    };
+
+/* Each core renders into its own scratch tile */
+static uint8_t tile_scratch[RPI_CORE_COUNT][TILE_WIDTH * TILE_HEIGHT * 4]
+    __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
+
+/* The frame being rendered, for the secondary cores */
+static tile_list_t* render_list;
+static surface_t* render_target;
+static rpi_atomic_t render_cores_done;
+
+
+static void* list_alloc( tile_list_t* list, uint32_t size )
+{
+    void* memory;
+
+    size = ( size + 3 ) & ~3;
+
+    if( size > list->chunk_remaining )
+    {
+        list->chunk = ARENA_Alloc( TILE_CHUNK_SIZE );
+        list->chunk_remaining = list->chunk ? TILE_CHUNK_SIZE : 0;
+
+        if( list->chunk == NULL )
+            return NULL;
+    }
+
+    memory = list->chunk;
+    list->chunk += size;
+    list->chunk_remaining -= size;
+
+    return memory;
+}
+
+
+/* Clip a command to the list and add it to the bin of every tile it touches */
+static void list_add( tile_list_t* list, tile_command_t* command )
+{
+    int x0 = command->x;
+    int y0 = command->y;
+    int x1 = command->x + command->width;
+    int y1 = command->y + command->height;
+
+    if( x0 < 0 )
+        x0 = 0;
+
+    if( y0 < 0 )
+        y0 = 0;
+
+    if( x1 > list->width )
+        x1 = list->width;
+
+    if( y1 > list->height )
+        y1 = list->height;
+
+    if( ( x0 >= x1 ) || ( y0 >= y1 ) )
+        return;
+
+    list->commands++;
+
+    for( int ty = y0 / TILE_HEIGHT; ty <= ( y1 - 1 ) / TILE_HEIGHT; ty++ )
+    {
+        for( int tx = x0 / TILE_WIDTH; tx <= ( x1 - 1 ) / TILE_WIDTH; tx++ )
+        {
+            tile_bin_t* bin = &list->bins[( ty * list->tiles_x ) + tx];
+            tile_bin_entry_t* entry = list_alloc( list, sizeof( tile_bin_entry_t ) );
+
+            if( entry == NULL )
+            {
+                list->dropped++;
+                return;
+            }
+
+            entry->command = command;
+            entry->next = NULL;
+
+            if( bin->tail )
+                bin->tail->next = entry;
+            else
+                bin->head = entry;
+
+            bin->tail = entry;
+        }
+    }
+}
+
+
+static tile_command_t* command_new( tile_list_t* list, tile_command_type_t type, int x, int y,
+                                    int width, int height )
+{
+    tile_command_t* command = list_alloc( list, sizeof( tile_command_t ) );
+
+    if( command == NULL )
+    {
+        list->dropped++;
+        return NULL;
+    }
+
+    command->type = type;
+    command->x = x;
+    command->y = y;
+    command->width = width;
+    command->height = height;
+
+    return command;
+}
+
+
+/**
+    @brief Start recording a display list for a target of width x height pixels
+    @param clear Non-zero to start every tile as clear_colour, otherwise the tiles start with the
+    target's pixels
+    @return 0 on success, -1 if there isn't room in the frame arena for the bins
+*/
+int TILE_Begin( tile_list_t* list, int width, int height, surface_format_t format, int clear,
+                uint32_t clear_colour )
+{
+    int bins;
+
+    list->width = width;
+    list->height = height;
+    list->bytes_per_pixel = SURFACE_BytesPerPixel( format );
+    list->tiles_x = ( width + TILE_WIDTH - 1 ) / TILE_WIDTH;
+    list->tiles_y = ( height + TILE_HEIGHT - 1 ) / TILE_HEIGHT;
+    list->clear = clear;
+    list->clear_colour = clear_colour;
+    list->chunk = NULL;
+    list->chunk_remaining = 0;
+    list->commands = 0;
+    list->dropped = 0;
+
+    bins = list->tiles_x * list->tiles_y;
+    list->bins = ARENA_Alloc( bins * sizeof( tile_bin_t ) );
+
+    if( list->bins == NULL )
+        return -1;
+
+    memset( list->bins, 0, bins * sizeof( tile_bin_t ) );
+
+    return 0;
+}
+
+
+void TILE_Rectangle( tile_list_t* list, int x, int y, int width, int height, uint32_t colour )
+{
+    tile_command_t* command = command_new( list, TILE_COMMAND_RECTANGLE, x, y, width, height );
+
+    if( command == NULL )
+        return;
+
+    command->colour = colour;
+    list_add( list, command );
+}
+
+
+/**
+    @brief Record copying a rectangle of pixels, which must be the same depth as the list. The
+    pixels are read when the list is rendered
+*/
+void TILE_Blit( tile_list_t* list, int x, int y, const void* data, int pitch, int width, int height )
+{
+    tile_command_t* command = command_new( list, TILE_COMMAND_BLIT, x, y, width, height );
+
+    if( command == NULL )
+        return;
+
+    command->data = data;
+    command->pitch = pitch;
+    list_add( list, command );
+}
+
+
+void TILE_Image( tile_list_t* list, int x, int y, const image_t* image )
+{
+    if( image->bytes_per_pixel != list->bytes_per_pixel )
+        return;
+
+    TILE_Blit( list, x, y, image->pixel_data, image->pitch, image->width, image->height );
+}
+
+
+void TILE_Pixel( tile_list_t* list, int x, int y, uint32_t colour )
+{
+    tile_command_t* command;
+
+    if( ( x < 0 ) || ( y < 0 ) || ( x >= list->width ) || ( y >= list->height ) )
+        return;
+
+    if( ( command = command_new( list, TILE_COMMAND_PIXEL, x, y, 1, 1 ) ) == NULL )
+        return;
+
+    command->colour = colour;
+    list_add( list, command );
+}
+
+
+/* Record drawing the columns column to column + columns - 1 of a sprite at x, y */
+static void record_sprite( tile_list_t* list, int x, int y, const sprite_t* sprite, int column,
+                           int columns, int alpha )
+{
+    tile_command_t* command;
+
+    if( ( alpha <= 0 ) || ( sprite->bytes_per_pixel != list->bytes_per_pixel ) )
+        return;
+
+    command = command_new( list, TILE_COMMAND_SPRITE, x + column, y, columns, sprite->height );
+
+    if( command == NULL )
+        return;
+
+    command->sprite = sprite;
+    command->pitch = column;
+    command->colour = alpha;
+    list_add( list, command );
+}
+
+
+/**
+    @brief Record drawing a sprite, which must be the same depth as the list, with a constant
+    alpha (see SPRITE_Draw())
+*/
+void TILE_Sprite( tile_list_t* list, int x, int y, const sprite_t* sprite, int alpha )
+{
+    record_sprite( list, x, y, sprite, 0, sprite->width, alpha );
+}
+
+
+/**
+    @brief Record a string drawn with an image font, in the same way as font_puts()
+
+    Each character is a blit from the font image, or its sprite when the font is transparent.
+    Effects that move each column of a character (like the sinewave) record a command per column
+    instead.
+*/
+void TILE_GlyphRun( tile_list_t* list, int x, int y, const char* str, image_font_t* font,
+                    effect_info_t* effect )
+{
+    if( ( str == NULL ) || ( font == NULL ) )
+        return;
+
+    for( ; *str != '\0'; str++, x += font->pixel_width )
+    {
+        const uint8_t* glyph = &font->image->pixel_data[font->character_offsets[(int)*str & 0x7F]];
+        const sprite_t* sprite = font->glyphs[(int)*str & 0x7F];
+
+        if( ( effect == NULL ) || ( effect->vertical_blit_y_processor == NULL ) )
+        {
+            if( sprite )
+                record_sprite( list, x, y, sprite, 0, font->pixel_width, SPRITE_OPAQUE );
+            else
+                TILE_Blit( list, x, y, glyph, font->image->pitch, font->pixel_width, font->pixel_height );
+
+            continue;
+        }
+
+        for( int px = 0; px < font->pixel_width; px++ )
+        {
+            int py = effect->vertical_blit_y_processor( x + px, effect );
+
+            if( sprite )
+                record_sprite( list, x, y + py, sprite, px, 1, SPRITE_OPAQUE );
+            else
+                TILE_Blit( list, x + px, y + py, glyph + ( px * font->image->bytes_per_pixel ),
+                           font->image->pitch, 1, font->pixel_height );
+        }
+    }
+}
+
+
+/* Run a command on a scratch tile whose top left corner is at tile_x, tile_y */
+static void run_command( const tile_list_t* list, const tile_command_t* command, uint8_t* scratch,
+                         int tile_x, int tile_y )
+{
+    const int bpp = list->bytes_per_pixel;
+    const int pitch = TILE_WIDTH * bpp;
+    int x0 = command->x - tile_x;
+    int y0 = command->y - tile_y;
+    int x1 = x0 + command->width;
+    int y1 = y0 + command->height;
+    int sx = 0;
+    int sy = 0;
+
+    if( x0 < 0 )
+    {
+        sx = -x0;
+        x0 = 0;
+    }
+
+    if( y0 < 0 )
+    {
+        sy = -y0;
+        y0 = 0;
+    }
+
+    if( x1 > TILE_WIDTH )
+        x1 = TILE_WIDTH;
+
+    if( y1 > TILE_HEIGHT )
+        y1 = TILE_HEIGHT;
+
+    if( ( x0 >= x1 ) || ( y0 >= y1 ) )
+        return;
+
+    switch( command->type )
+    {
+        case TILE_COMMAND_PIXEL:
+        case TILE_COMMAND_RECTANGLE:
+            for( int y = y0; y < y1; y++ )
+            {
+                uint8_t* row = scratch + ( y * pitch );
+
+                if( bpp == 1 )
+                    memset( row + x0, command->colour, x1 - x0 );
+                else if( bpp == 2 )
+                    for( int x = x0; x < x1; x++ )
+                        ( (uint16_t*)row )[x] = command->colour;
+                else
+                    for( int x = x0; x < x1; x++ )
+                        ( (uint32_t*)row )[x] = command->colour;
+            }
+            break;
+
+        case TILE_COMMAND_BLIT:
+        {
+            const uint8_t* src = command->data + ( sy * command->pitch ) + ( sx * bpp );
+
+            for( int y = y0; y < y1; y++ )
+            {
+                memcpy( scratch + ( y * pitch ) + ( x0 * bpp ), src, ( x1 - x0 ) * bpp );
+                src += command->pitch;
+            }
+            break;
+        }
+
+        case TILE_COMMAND_SPRITE:
+        {
+            /* The sprite clips itself to the tile */
+            surface_t tile;
+
+            SURFACE_Init( &tile, TILE_WIDTH, TILE_HEIGHT, pitch, command->sprite->format, scratch, 1 );
+            SPRITE_DrawColumns( &tile, command->x - command->pitch - tile_x, command->y - tile_y,
+                                command->sprite, command->pitch, command->width, command->colour );
+            break;
+        }
+    }
+}
+
+
+/* Render a tile in a core's scratch buffer and write it to the target */
+static void render_tile( tile_list_t* list, surface_t* target, int tile, int core )
+{
+    uint8_t* scratch = tile_scratch[core];
+    const int bpp = list->bytes_per_pixel;
+    const int pitch = TILE_WIDTH * bpp;
+    int tile_x = ( tile % list->tiles_x ) * TILE_WIDTH;
+    int tile_y = ( tile / list->tiles_x ) * TILE_HEIGHT;
+    int width = list->width - tile_x;
+    int height = list->height - tile_y;
+
+    if( width > TILE_WIDTH )
+        width = TILE_WIDTH;
+
+    if( height > TILE_HEIGHT )
+        height = TILE_HEIGHT;
+
+    if( list->clear )
+    {
+        tile_command_t clear = {
+            .type = TILE_COMMAND_RECTANGLE,
+            .x = tile_x, .y = tile_y, .width = TILE_WIDTH, .height = TILE_HEIGHT,
+            .colour = list->clear_colour };
+
+        run_command( list, &clear, scratch, tile_x, tile_y );
+    }
+    else
+    {
+        for( int y = 0; y < height; y++ )
+            memcpy( scratch + ( y * pitch ), SURFACE_PixelAddress( target, tile_x, tile_y + y ), width * bpp );
+    }
+
+    for( tile_bin_entry_t* entry = list->bins[tile].head; entry; entry = entry->next )
+        run_command( list, entry->command, scratch, tile_x, tile_y );
+
+    for( int y = 0; y < height; y++ )
+        memcpy( SURFACE_PixelAddress( target, tile_x, tile_y + y ), scratch + ( y * pitch ), width * bpp );
+}
+
+
+static void render_tiles( tile_list_t* list, surface_t* target, int core )
+{
+    int tiles = list->tiles_x * list->tiles_y;
+    int tile;
+
+    while( ( tile = RPI_AtomicFetchAdd( &list->next_tile, 1 ) ) < tiles )
+        render_tile( list, target, tile, core );
+}
+
+
+#if defined( RPI_LOCAL_BASE )
+
+static void render_core_entry( int core )
+{
+    render_tiles( render_list, render_target, core );
+
+    RPI_AtomicFetchAdd( &render_cores_done, 1 );
+    RPI_SendEvent();
+}
+
+#endif
+
+
+/**
+    @brief Render a display list into a surface
+    @param cores The most cores to render with, including the calling core
+    @return The number of cores that rendered
+
+    Secondary cores that are busy with something else are left alone. The target must be the
+    size and depth the list was recorded for.
+*/
+int TILE_Render( tile_list_t* list, surface_t* target, int cores )
+{
+    int started = 0;
+
+    if( ( target->bytes_per_pixel != list->bytes_per_pixel ) ||
+        ( target->width < list->width ) || ( target->height < list->height ) )
+        return 0;
+
+    RPI_AtomicStore( &list->next_tile, 0 );
+
+#if defined( RPI_LOCAL_BASE )
+    render_list = list;
+    render_target = target;
+    RPI_AtomicStore( &render_cores_done, 0 );
+
+    for( int core = 1; ( core < RPI_CORE_COUNT ) && ( core < cores ); core++ )
+    {
+        if( RPI_CoreGetState( core ) != RPI_CORE_PARKED )
+            continue;
+
+        if( RPI_CoreStart( core, render_core_entry ) == 0 )
+            started++;
+    }
+#endif
+
+    render_tiles( list, target, RPI_GetCoreId() );
+
+    while( (int)RPI_AtomicLoadAcquire( &render_cores_done ) < started )
+        RPI_WaitForEvent();
+
+    return started + 1;
+}
@@ -0,0 +1,72 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef TILE_RENDER_H
+#define TILE_RENDER_H
+
+#include <stdint.h>
+
+#include "image-font.h"
+#include "image.h"
+#include "rpi-atomic.h"
+#include "sprite.h"
+#include "surface.h"
+
+/** @brief The tile size. A 32bpp tile is 8KiB, so a tile and the source pixels drawn into it fit
+    in the L1 data cache */
+#define TILE_WIDTH              64
+#define TILE_HEIGHT             32
+
+/** @brief Commands and bin entries are taken from the frame arena in chunks of this size */
+#define TILE_CHUNK_SIZE         4096
+
+typedef struct tile_command_t tile_command_t;
+typedef struct tile_bin_entry_t tile_bin_entry_t;
+
+/** @brief A tile's commands, in the order they were recorded */
+typedef struct {
+    tile_bin_entry_t* head;
+    tile_bin_entry_t* tail;
+    } tile_bin_t;
+
+/** @brief A display list. Lists are recorded into frame arena memory and are only valid until the
+    end of the frame */
+typedef struct tile_list_t {
+    int width;
+    int height;
+    int bytes_per_pixel;
+    int tiles_x;
+    int tiles_y;
+    int clear;                  /**< Tiles start as clear_colour rather than the target's pixels */
+    uint32_t clear_colour;
+    tile_bin_t* bins;
+
+    uint8_t* chunk;
+    uint32_t chunk_remaining;
+
+    uint32_t commands;
+    uint32_t dropped;           /**< Commands that didn't fit in the frame arena */
+
+    rpi_atomic_t next_tile;     /**< The next tile for a core to render */
+    } tile_list_t;
+
+extern int TILE_Begin( tile_list_t* list, int width, int height, surface_format_t format,
+                       int clear, uint32_t clear_colour );
+extern void TILE_Rectangle( tile_list_t* list, int x, int y, int width, int height, uint32_t colour );
+extern void TILE_Blit( tile_list_t* list, int x, int y, const void* data, int pitch, int width,
+                       int height );
+extern void TILE_Image( tile_list_t* list, int x, int y, const image_t* image );
+extern void TILE_Pixel( tile_list_t* list, int x, int y, uint32_t colour );
+extern void TILE_Sprite( tile_list_t* list, int x, int y, const sprite_t* sprite, int alpha );
+extern void TILE_GlyphRun( tile_list_t* list, int x, int y, const char* str, image_font_t* font,
+                           effect_info_t* effect );
+extern int TILE_Render( tile_list_t* list, surface_t* target, int cores );
+
+#endif
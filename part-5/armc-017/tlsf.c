@@ -0,0 +1,568 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A Two-Level Segregated Fit memory allocator. See "TLSF: a New Dynamic Memory Allocator for
+   Real-Time Systems" by M. Masmano, I. Ripoll, A. Crespo and J. Real.
+
+   Free blocks are kept in lists segregated first by the power of two of their size (the first
+   level) and then by a linear split of that range (the second level). A bitmap for each level
+   records which lists have blocks in, so finding a free block that's big enough is a couple of
+   find-first-set operations and malloc and free are O(1) - there's no searching.
+
+   Every block starts with a header holding the previous physical block and the block size so that
+   free blocks are merged with their neighbours straight away. The low bits of the size, which are
+   always zero because of the alignment, record whether the block and the previous physical block
+   are free. The pool ends with a zero-sized used sentinel block.
+
+   TLSF isn't thread or interrupt safe itself, see heap.c for that. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tlsf.h"
+
+#define BLOCK_FREE          ( 1 << 0 )
+#define BLOCK_PREV_FREE     ( 1 << 1 )
+#define BLOCK_SIZE_MASK     ( ~( TLSF_ALIGN_SIZE - 1 ) )
+
+/* Free blocks need room in their payload for the free list links */
+#define BLOCK_MIN_SIZE      ( 2 * sizeof( tlsf_block_t* ) )
+#define BLOCK_MAX_SIZE      ( 1UL << TLSF_FL_INDEX_MAX )
+
+struct tlsf_block_t {
+    tlsf_block_t* prev_phys;
+    uint32_t size;
+
+    /* The payload starts here. These are only valid while the block is free */
+    tlsf_block_t* next_free;
+    tlsf_block_t* prev_free;
+    };
+
+#define BLOCK_HEADER_SIZE   offsetof( tlsf_block_t, next_free )
+
+
+static inline int bit_fls( uint32_t word )
+{
+    return 31 - __builtin_clz( word );
+}
+
+
+static inline int bit_ffs( uint32_t word )
+{
+    return __builtin_ctz( word );
+}
+
+
+static inline uint32_t block_size( tlsf_block_t* block )
+{
+    return block->size & BLOCK_SIZE_MASK;
+}
+
+
+static inline void* block_to_ptr( tlsf_block_t* block )
+{
+    return (uint8_t*)block + BLOCK_HEADER_SIZE;
+}
+
+
+static inline tlsf_block_t* block_from_ptr( void* ptr )
+{
+    return (tlsf_block_t*)( (uint8_t*)ptr - BLOCK_HEADER_SIZE );
+}
+
+
+static inline tlsf_block_t* block_next( tlsf_block_t* block )
+{
+    return (tlsf_block_t*)( (uint8_t*)block_to_ptr( block ) + block_size( block ) );
+}
+
+
+static inline void block_set_size( tlsf_block_t* block, uint32_t size )
+{
+    block->size = size | ( block->size & ~BLOCK_SIZE_MASK );
+}
+
+
+/* Mark the block free (or used) and tell the next physical block about it */
+static void block_mark_free( tlsf_block_t* block, int free )
+{
+    tlsf_block_t* next = block_next( block );
+
+    if( free )
+    {
+        block->size |= BLOCK_FREE;
+        next->size |= BLOCK_PREV_FREE;
+    }
+    else
+    {
+        block->size &= ~BLOCK_FREE;
+        next->size &= ~BLOCK_PREV_FREE;
+    }
+
+    next->prev_phys = block;
+}
+
+
+static inline uint32_t align_up( uint32_t x, uint32_t align )
+{
+    return ( x + ( align - 1 ) ) & ~( align - 1 );
+}
+
+
+static inline uint32_t adjust_request( size_t size )
+{
+    uint32_t adjusted;
+
+    if( ( size == 0 ) || ( size >= BLOCK_MAX_SIZE ) )
+        return 0;
+
+    adjusted = align_up( size, TLSF_ALIGN_SIZE );
+    return ( adjusted < BLOCK_MIN_SIZE ) ? BLOCK_MIN_SIZE : adjusted;
+}
+
+
+/* The first and second level list indices a block of size belongs in */
+static void mapping_insert( uint32_t size, int* fl, int* sl )
+{
+    if( size < TLSF_SMALL_BLOCK_SIZE )
+    {
+        *fl = 0;
+        *sl = size / ( TLSF_SMALL_BLOCK_SIZE / TLSF_SL_INDEX_COUNT );
+    }
+    else
+    {
+        int f = bit_fls( size );
+        *sl = ( size >> ( f - TLSF_SL_INDEX_COUNT_LOG2 ) ) ^ ( 1 << TLSF_SL_INDEX_COUNT_LOG2 );
+        *fl = f - ( TLSF_FL_INDEX_SHIFT - 1 );
+    }
+}
+
+
+/* The list indices to start searching from for a block of at least size. The size is rounded up
+   to the next list so that any block in the list found is big enough */
+static void mapping_search( uint32_t size, int* fl, int* sl )
+{
+    if( size >= TLSF_SMALL_BLOCK_SIZE )
+        size += ( 1 << ( bit_fls( size ) - TLSF_SL_INDEX_COUNT_LOG2 ) ) - 1;
+
+    mapping_insert( size, fl, sl );
+}
+
+
+static void remove_free_block( tlsf_t* tlsf, tlsf_block_t* block, int fl, int sl )
+{
+    tlsf_block_t* prev = block->prev_free;
+    tlsf_block_t* next = block->next_free;
+
+    if( next )
+        next->prev_free = prev;
+
+    if( prev )
+        prev->next_free = next;
+
+    if( tlsf->blocks[fl][sl] == block )
+    {
+        tlsf->blocks[fl][sl] = next;
+
+        if( next == NULL )
+        {
+            tlsf->sl_bitmap[fl] &= ~( 1UL << sl );
+
+            if( tlsf->sl_bitmap[fl] == 0 )
+                tlsf->fl_bitmap &= ~( 1UL << fl );
+        }
+    }
+
+    tlsf->stats.free -= block_size( block );
+    tlsf->stats.free_blocks--;
+}
+
+
+static void insert_free_block( tlsf_t* tlsf, tlsf_block_t* block, int fl, int sl )
+{
+    tlsf_block_t* current = tlsf->blocks[fl][sl];
+
+    block->next_free = current;
+    block->prev_free = NULL;
+
+    if( current )
+        current->prev_free = block;
+
+    tlsf->blocks[fl][sl] = block;
+    tlsf->fl_bitmap |= ( 1UL << fl );
+    tlsf->sl_bitmap[fl] |= ( 1UL << sl );
+
+    tlsf->stats.free += block_size( block );
+    tlsf->stats.free_blocks++;
+}
+
+
+static void block_remove( tlsf_t* tlsf, tlsf_block_t* block )
+{
+    int fl, sl;
+
+    mapping_insert( block_size( block ), &fl, &sl );
+    remove_free_block( tlsf, block, fl, sl );
+}
+
+
+static void block_insert( tlsf_t* tlsf, tlsf_block_t* block )
+{
+    int fl, sl;
+
+    mapping_insert( block_size( block ), &fl, &sl );
+    insert_free_block( tlsf, block, fl, sl );
+}
+
+
+/* Find a free block of at least size and remove it from its free list */
+static tlsf_block_t* block_locate_free( tlsf_t* tlsf, uint32_t size )
+{
+    uint32_t sl_map, fl_map;
+    tlsf_block_t* block;
+    int fl, sl;
+
+    mapping_search( size, &fl, &sl );
+
+    if( fl >= TLSF_FL_INDEX_COUNT )
+        return NULL;
+
+    sl_map = tlsf->sl_bitmap[fl] & ( ~0UL << sl );
+
+    if( sl_map == 0 )
+    {
+        /* Nothing in this first level range, so take the smallest block from a larger range */
+        if( fl + 1 >= TLSF_FL_INDEX_COUNT )
+            return NULL;
+
+        fl_map = tlsf->fl_bitmap & ( ~0UL << ( fl + 1 ) );
+        if( fl_map == 0 )
+            return NULL;
+
+        fl = bit_ffs( fl_map );
+        sl_map = tlsf->sl_bitmap[fl];
+    }
+
+    sl = bit_ffs( sl_map );
+    block = tlsf->blocks[fl][sl];
+    remove_free_block( tlsf, block, fl, sl );
+
+    return block;
+}
+
+
+/* Split off anything beyond size bytes of the (used) block into a new free block, if there's
+   enough left over to make one */
+static void block_trim( tlsf_t* tlsf, tlsf_block_t* block, uint32_t size )
+{
+    tlsf_block_t* remaining;
+    uint32_t remaining_size;
+
+    if( block_size( block ) < size + BLOCK_HEADER_SIZE + BLOCK_MIN_SIZE )
+        return;
+
+    remaining_size = block_size( block ) - size - BLOCK_HEADER_SIZE;
+    block_set_size( block, size );
+
+    remaining = block_next( block );
+    remaining->prev_phys = block;
+    remaining->size = remaining_size;
+    block_mark_free( remaining, 1 );
+    block_insert( tlsf, remaining );
+}
+
+
+/* Merge a free block with its free physical neighbours. The block must not be on a free list */
+static tlsf_block_t* block_merge( tlsf_t* tlsf, tlsf_block_t* block )
+{
+    tlsf_block_t* next;
+
+    if( block->size & BLOCK_PREV_FREE )
+    {
+        tlsf_block_t* prev = block->prev_phys;
+
+        block_remove( tlsf, prev );
+        block_set_size( prev, block_size( prev ) + BLOCK_HEADER_SIZE + block_size( block ) );
+        block = prev;
+    }
+
+    next = block_next( block );
+
+    if( next->size & BLOCK_FREE )
+    {
+        block_remove( tlsf, next );
+        block_set_size( block, block_size( block ) + BLOCK_HEADER_SIZE + block_size( next ) );
+    }
+
+    block_mark_free( block, 1 );
+
+    return block;
+}
+
+
+static void* block_prepare_used( tlsf_t* tlsf, tlsf_block_t* block, uint32_t size )
+{
+    if( block == NULL )
+    {
+        tlsf->stats.failures++;
+        return NULL;
+    }
+
+    block_trim( tlsf, block, size );
+    block_mark_free( block, 0 );
+
+    tlsf->stats.allocations++;
+    tlsf->stats.used += block_size( block );
+    if( tlsf->stats.used > tlsf->stats.peak_used )
+        tlsf->stats.peak_used = tlsf->stats.used;
+
+    return block_to_ptr( block );
+}
+
+
+/**
+    @brief Create a TLSF pool in memory
+    @return The pool, or NULL if memory is too small
+
+    The control structure is placed at the start of memory and the rest becomes a single free
+    block
+*/
+tlsf_t* TLSF_Create( void* memory, uint32_t bytes )
+{
+    uint32_t start = align_up( (uint32_t)memory, TLSF_ALIGN_SIZE );
+    uint32_t end = ( (uint32_t)memory + bytes ) & BLOCK_SIZE_MASK;
+    uint32_t pool = align_up( start + sizeof( tlsf_t ), TLSF_ALIGN_SIZE );
+    tlsf_t* tlsf = (tlsf_t*)start;
+    tlsf_block_t* block;
+    tlsf_block_t* sentinel;
+    uint32_t size;
+
+    if( end < pool + ( 2 * BLOCK_HEADER_SIZE ) + BLOCK_MIN_SIZE )
+        return NULL;
+
+    size = end - pool - ( 2 * BLOCK_HEADER_SIZE );
+    if( size >= BLOCK_MAX_SIZE )
+        size = ( BLOCK_MAX_SIZE - 1 ) & BLOCK_SIZE_MASK;
+
+    memset( tlsf, 0, sizeof( tlsf_t ) );
+
+    block = (tlsf_block_t*)pool;
+    block->prev_phys = NULL;
+    block->size = size;
+
+    sentinel = block_next( block );
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+
+    block_mark_free( block, 1 );
+    block_insert( tlsf, block );
+
+    tlsf->stats.pool_size = size;
+
+    return tlsf;
+}
+
+
+/**
+    @brief Allocate size bytes, aligned to TLSF_ALIGN_SIZE
+    @return The allocation or NULL if there's no free block big enough
+*/
+void* TLSF_Malloc( tlsf_t* tlsf, size_t size )
+{
+    uint32_t adjusted = adjust_request( size );
+
+    if( adjusted == 0 )
+        return NULL;
+
+    return block_prepare_used( tlsf, block_locate_free( tlsf, adjusted ), adjusted );
+}
+
+
+/**
+    @brief Allocate size bytes aligned to align, which must be a power of two
+
+    Enough is allocated to be sure there's an aligned address far enough into the block to split
+    the start of the block off as a free block of its own
+*/
+void* TLSF_Memalign( tlsf_t* tlsf, size_t align, size_t size )
+{
+    uint32_t adjusted = adjust_request( size );
+    uint32_t gap_minimum = BLOCK_HEADER_SIZE + BLOCK_MIN_SIZE;
+    tlsf_block_t* block;
+    uint32_t ptr, aligned, gap;
+
+    if( align <= TLSF_ALIGN_SIZE )
+        return TLSF_Malloc( tlsf, size );
+
+    if( ( adjusted == 0 ) || ( align & ( align - 1 ) ) )
+        return NULL;
+
+    block = block_locate_free( tlsf, adjusted + align + gap_minimum );
+    if( block == NULL )
+    {
+        tlsf->stats.failures++;
+        return NULL;
+    }
+
+    ptr = (uint32_t)block_to_ptr( block );
+    aligned = align_up( ptr, align );
+    gap = aligned - ptr;
+
+    if( ( gap != 0 ) && ( gap < gap_minimum ) )
+    {
+        aligned = align_up( ptr + gap_minimum, align );
+        gap = aligned - ptr;
+    }
+
+    if( gap )
+    {
+        /* Give the front of the block back as a free block of its own */
+        tlsf_block_t* front = block;
+        uint32_t remaining = block_size( block ) - gap;
+
+        block_set_size( front, gap - BLOCK_HEADER_SIZE );
+        block = block_next( front );
+        block->prev_phys = front;
+        block->size = remaining | BLOCK_PREV_FREE;
+
+        front = block_merge( tlsf, front );
+        block_insert( tlsf, front );
+    }
+
+    return block_prepare_used( tlsf, block, adjusted );
+}
+
+
+/**
+    @brief Return an allocation to the pool, merging it with any free neighbours
+*/
+void TLSF_Free( tlsf_t* tlsf, void* ptr )
+{
+    tlsf_block_t* block;
+
+    if( ptr == NULL )
+        return;
+
+    block = block_from_ptr( ptr );
+    tlsf->stats.used -= block_size( block );
+    tlsf->stats.frees++;
+
+    block = block_merge( tlsf, block );
+    block_insert( tlsf, block );
+}
+
+
+/**
+    @brief Resize an allocation, in place if the next physical block is free and big enough
+*/
+void* TLSF_Realloc( tlsf_t* tlsf, void* ptr, size_t size )
+{
+    tlsf_block_t* block;
+    tlsf_block_t* next;
+    uint32_t current, adjusted, combined;
+    void* moved;
+
+    if( ptr == NULL )
+        return TLSF_Malloc( tlsf, size );
+
+    if( size == 0 )
+    {
+        TLSF_Free( tlsf, ptr );
+        return NULL;
+    }
+
+    block = block_from_ptr( ptr );
+    next = block_next( block );
+    current = block_size( block );
+    adjusted = adjust_request( size );
+    combined = current + BLOCK_HEADER_SIZE + block_size( next );
+
+    if( adjusted == 0 )
+        return NULL;
+
+    if( ( adjusted > current ) && ( !( next->size & BLOCK_FREE ) || ( adjusted > combined ) ) )
+    {
+        moved = TLSF_Malloc( tlsf, size );
+        if( moved )
+        {
+            memcpy( moved, ptr, current );
+            TLSF_Free( tlsf, ptr );
+        }
+
+        return moved;
+    }
+
+    if( adjusted > current )
+    {
+        /* Grow into the free next block */
+        block_remove( tlsf, next );
+        block_set_size( block, combined );
+        block_mark_free( block, 0 );
+    }
+
+    block_trim( tlsf, block, adjusted );
+
+    /* A trimmed off block may be next to another free block */
+    next = block_next( block );
+    if( next->size & BLOCK_FREE )
+    {
+        block_remove( tlsf, next );
+        block_insert( tlsf, block_merge( tlsf, next ) );
+    }
+
+    tlsf->stats.used += block_size( block ) - current;
+    if( tlsf->stats.used > tlsf->stats.peak_used )
+        tlsf->stats.peak_used = tlsf->stats.used;
+
+    return ptr;
+}
+
+
+/**
+    @brief Return the usable size of an allocation, which may be more than was asked for
+*/
+size_t TLSF_BlockSize( void* ptr )
+{
+    if( ptr == NULL )
+        return 0;
+
+    return block_size( block_from_ptr( ptr ) );
+}
+
+
+/**
+    @brief Get the usage and fragmentation statistics of the pool
+
+    Finding the largest free block only has to look through one free list, the highest one in use
+*/
+void TLSF_GetStats( tlsf_t* tlsf, tlsf_stats_t* stats )
+{
+    uint32_t largest = 0;
+
+    if( tlsf->fl_bitmap )
+    {
+        int fl = bit_fls( tlsf->fl_bitmap );
+        int sl = bit_fls( tlsf->sl_bitmap[fl] );
+
+        for( tlsf_block_t* block = tlsf->blocks[fl][sl]; block; block = block->next_free )
+        {
+            if( block_size( block ) > largest )
+                largest = block_size( block );
+        }
+    }
+
+    *stats = tlsf->stats;
+    stats->largest_free = largest;
+    stats->fragmentation = 0;
+
+    if( stats->free )
+        stats->fragmentation = 100 - (uint32_t)( ( largest * 100ULL ) / stats->free );
+}
@@ -0,0 +1,63 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef TLSF_H
+#define TLSF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief All allocations are a multiple of, and aligned to, TLSF_ALIGN_SIZE bytes */
+#define TLSF_ALIGN_SIZE_LOG2    3
+#define TLSF_ALIGN_SIZE         ( 1 << TLSF_ALIGN_SIZE_LOG2 )
+
+/** @brief The number of second level lists each first level (power of two) range is split into */
+#define TLSF_SL_INDEX_COUNT_LOG2    5
+#define TLSF_SL_INDEX_COUNT         ( 1 << TLSF_SL_INDEX_COUNT_LOG2 )
+
+/** @brief Blocks smaller than TLSF_SMALL_BLOCK_SIZE all live in the first first level list */
+#define TLSF_FL_INDEX_SHIFT     ( TLSF_SL_INDEX_COUNT_LOG2 + TLSF_ALIGN_SIZE_LOG2 )
+#define TLSF_FL_INDEX_MAX       31
+#define TLSF_FL_INDEX_COUNT     ( TLSF_FL_INDEX_MAX - TLSF_FL_INDEX_SHIFT + 1 )
+#define TLSF_SMALL_BLOCK_SIZE   ( 1 << TLSF_FL_INDEX_SHIFT )
+
+typedef struct tlsf_block_t tlsf_block_t;
+
+/** @brief Usage and fragmentation statistics for a TLSF pool */
+typedef struct {
+    uint32_t pool_size;         /**< The bytes available for blocks (excludes the control structure) */
+    uint32_t used;              /**< The bytes handed out in allocated blocks */
+    uint32_t peak_used;
+    uint32_t free;              /**< The bytes in free blocks */
+    uint32_t free_blocks;
+    uint32_t largest_free;      /**< The largest allocation that will currently succeed */
+    uint32_t fragmentation;     /**< 0-100%, how much of the free memory isn't in the largest free block */
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;          /**< Allocations that couldn't be satisfied */
+    } tlsf_stats_t;
+
+/** @brief The TLSF control structure. It lives at the start of the memory given to TLSF_Create() */
+typedef struct {
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[TLSF_FL_INDEX_COUNT];
+    tlsf_block_t* blocks[TLSF_FL_INDEX_COUNT][TLSF_SL_INDEX_COUNT];
+    tlsf_stats_t stats;
+    } tlsf_t;
+
+extern tlsf_t* TLSF_Create( void* memory, uint32_t bytes );
+extern void* TLSF_Malloc( tlsf_t* tlsf, size_t size );
+extern void* TLSF_Memalign( tlsf_t* tlsf, size_t align, size_t size );
+extern void* TLSF_Realloc( tlsf_t* tlsf, void* ptr, size_t size );
+extern void TLSF_Free( tlsf_t* tlsf, void* ptr );
+extern size_t TLSF_BlockSize( void* ptr );
+extern void TLSF_GetStats( tlsf_t* tlsf, tlsf_stats_t* stats );
+
+#endif
@@ -0,0 +1,136 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+/* A deferred interrupt work queue (what other kernels call bottom halves). Interrupt handlers
+   should only do what must be done in the handler (acknowledge the source, grab the data) and post
+   the rest of the work here. The work is then run in thread context at a safe point such as the
+   main loop or when idle by calling WQ_Drain().
+
+   Each core has its own queue with a ring for each priority. Work is posted by interrupt handlers
+   and by threads on the core, so the rings are MPSC rings (see ring-buffer.h) and posting needs
+   neither a lock nor IRQs masked - a handler that interrupts a thread part way through posting
+   just posts behind it. The thread draining the queue is the single consumer. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ring-buffer.h"
+#include "rpi-atomic.h"
+#include "rpi-local-intc.h"
+#include "rpi-smp.h"
+#include "work-queue.h"
+
+typedef struct {
+    wq_function_t function;
+    void* arg;
+    } wq_item_t;
+
+RING_MPSC_TYPE( wq_ring_t, wq_item_t, WQ_SLOTS );
+
+typedef struct {
+    wq_ring_t rings[WQ_PRIORITY_COUNT];
+
+    /* Updated by every producer */
+    rpi_atomic_t posted;
+    rpi_atomic_t dropped;
+
+    /* Only updated by the consumer */
+    uint32_t completed;
+    } wq_t;
+
+static wq_t work_queues[RPI_CORE_COUNT] __attribute__((aligned(RPI_CACHE_LINE_SIZE)));
+
+
+/**
+    @brief Post work to the calling core's queue
+    @return 0 on success, -1 if the queue at this priority is full
+
+    Safe to call from both IRQ and thread context. From an IRQ handler this is a handful of
+    instructions.
+*/
+int WQ_Post( wq_priority_t priority, wq_function_t function, void* arg )
+{
+    wq_t* wq = &work_queues[RPI_GetCoreId()];
+    wq_item_t item = { function, arg };
+
+    if( ( priority >= WQ_PRIORITY_COUNT ) || ( function == NULL ) )
+        return -1;
+
+    if( RING_MpscPush( &wq->rings[priority], &item ) != 0 )
+    {
+        RPI_AtomicFetchAddRelaxed( &wq->dropped, 1 );
+        return -1;
+    }
+
+    RPI_AtomicFetchAddRelaxed( &wq->posted, 1 );
+
+    return 0;
+}
+
+
+/**
+    @brief Run pending work on the calling core, highest priority first
+    @param budget The maximum number of work items to run, or 0 to run until the queue is empty
+    @return The number of work items run
+
+    Must be called from thread context. The priorities are re-checked after every item so that
+    high priority work posted while low priority work is running is run next.
+*/
+int WQ_Drain( int budget )
+{
+    wq_t* wq = &work_queues[RPI_GetCoreId()];
+    int done = 0;
+
+    while( ( budget == 0 ) || ( done < budget ) )
+    {
+        wq_item_t item;
+        int p;
+
+        for( p = 0; p < WQ_PRIORITY_COUNT; p++ )
+        {
+            if( RING_MpscPop( &wq->rings[p], &item ) == 0 )
+                break;
+        }
+
+        if( p == WQ_PRIORITY_COUNT )
+            break;
+
+        item.function( item.arg );
+        wq->completed++;
+        done++;
+    }
+
+    return done;
+}
+
+
+/**
+    @brief Return the number of work items pending on the calling core
+*/
+int WQ_Pending( void )
+{
+    wq_t* wq = &work_queues[RPI_GetCoreId()];
+    int pending = 0;
+
+    for( int p = 0; p < WQ_PRIORITY_COUNT; p++ )
+        pending += RING_Count( &wq->rings[p] );
+
+    return pending;
+}
+
+
+void WQ_GetStats( wq_stats_t* stats )
+{
+    wq_t* wq = &work_queues[RPI_GetCoreId()];
+
+    stats->posted = RPI_AtomicLoad( &wq->posted );
+    stats->completed = wq->completed;
+    stats->dropped = RPI_AtomicLoad( &wq->dropped );
+}
@@ -0,0 +1,43 @@
+/*
+    Part of the Raspberry-Pi Bare Metal Tutorials
+    https://www.valvers.com/rpi/bare-metal/
+    Copyright (c) 2013-2020, Brian Sidebotham
+
+    This software is licensed under the MIT License.
+    Please see the LICENSE file included with this software.
+
+*/
+
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <stdint.h>
+
+/** @brief The number of work items that can be pending at each priority on each core. Must be a
+    power of two */
+#define WQ_SLOTS    32
+
+/** @brief Work priorities. Higher priority work is always drained first */
+typedef enum {
+    WQ_PRIORITY_HIGH = 0,
+    WQ_PRIORITY_NORMAL,
+    WQ_PRIORITY_LOW,
+    WQ_PRIORITY_COUNT,
+    } wq_priority_t;
+
+/** @brief A function that does the deferred work in thread context */
+typedef void (*wq_function_t)( void* arg );
+
+/** @brief Statistics for the calling core's work queue */
+typedef struct {
+    uint32_t posted;
+    uint32_t completed;
+    uint32_t dropped;       /**< Work that couldn't be posted because the queue was full */
+    } wq_stats_t;
+
+extern int WQ_Post( wq_priority_t priority, wq_function_t function, void* arg );
+extern int WQ_Drain( int budget );
+extern int WQ_Pending( void );
+extern void WQ_GetStats( wq_stats_t* stats );
+
+#endif